@@ -1,14 +1,190 @@
 // Author: Stefan Lepperdinger
+#include "ExecutionPlan.h"
 #include "HDF5File.h"
 #include "ParameterFile.h"
+#include "ProjectionOperator.h"
 #include "Sky.h"
+#include "runs.h"
+#include "shards.h"
 #include "tensors.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <optional>
 
-int main(int argc, char *argv[]) {
+/**
+ * Reads the projection operator from the file specified by the parameter
+ * projection_operator_file or assembles it (and caches it in that file if the
+ * file doesn't exist yet).
+ */
+ProjectionOperator get_projection_operator(
+    const Sky &sky, const ParameterFile::Parameters &parameters) {
+  const auto &operator_file_path = parameters.projection_operator_file;
+  if (!operator_file_path.empty() &&
+      std::filesystem::exists(operator_file_path)) {
+    HDF5File operator_file(operator_file_path, 'r');
+    auto full_pixel_range =
+        std::array<size_t, 2>{0, sky.get_number_of_sky_pixels()};
+    // operators of older versions don't store their grid centers or their
+    // lines of sight
+    if (!operator_file.has_dataset("projection operator grid x centers") ||
+        !operator_file.has_dataset("projection operator radial step size") ||
+        !operator_file.read_parameters().has_same_geometry(parameters) ||
+        operator_file.read_pixel_range().value_or(full_pixel_range) !=
+            sky.get_pixel_range()) {
+      std::cerr << "error: The projection operator in the file '"
+                << operator_file_path
+                << "' was created with different parameters or by an older "
+                   "version.\n";
+      std::exit(1);
+    }
+    return operator_file.read_projection_operator();
+  }
+  auto projection_operator = sky.make_projection_operator();
+  if (!operator_file_path.empty()) {
+    HDF5File operator_file(operator_file_path, 'w');
+    operator_file.save_projection_operator(projection_operator);
+    operator_file.save_parameters(parameters);
+    operator_file.save_pixel_range(sky.get_pixel_range());
+  }
+  return projection_operator;
+}
+
+/**
+ * @return {size in bytes, last modification time in ticks of the file clock}
+ *         of a file, which identifies the input file of a checkpoint
+ */
+std::array<std::int64_t, 2> get_file_fingerprint(const std::string &path) {
+  auto size = std::filesystem::file_size(path);
+  auto ticks = std::filesystem::last_write_time(path).time_since_epoch();
+  return {static_cast<std::int64_t>(size),
+          static_cast<std::int64_t>(ticks.count())};
+}
+
+/**
+ * Checks that an existing output file was written by a run with the same
+ * input data and parameters, such that its completed skies can be reused.
+ */
+void check_checkpoint(HDF5File &output_file,
+                      const std::string &output_file_path, const Sky &sky,
+                      const ParameterFile::Parameters &parameters,
+                      const std::vector<double> &energies,
+                      const grids::cartesian_grid_3d &emissivity_grid,
+                      const std::array<std::int64_t, 2> &input_fingerprint,
+                      size_t number_of_skies, size_t number_of_band_skies) {
+  auto exit_with_error = [&](const std::string &reason) {
+    std::cerr << "error: The run can't be resumed from the file '"
+              << output_file_path << "': " << reason << '\n';
+    std::exit(1);
+  };
+  if (!output_file.has_dataset("completed gamma ray skies")) {
+    exit_with_error("it doesn't contain a progress record.");
+  }
+  // checkpoints of older versions don't identify their input file
+  if (!output_file.has_dataset("input grid x centers") ||
+      !output_file.has_dataset("input file fingerprint")) {
+    exit_with_error("it was written by an older version.");
+  }
+  // the grids were stored in double precision, so they compare exactly
+  auto stored_grid = output_file.read_input_grid();
+  if (stored_grid.x_centers != emissivity_grid.x_centers ||
+      stored_grid.y_centers != emissivity_grid.y_centers ||
+      stored_grid.z_centers != emissivity_grid.z_centers ||
+      stored_grid.x_boundaries != emissivity_grid.x_boundaries ||
+      stored_grid.y_boundaries != emissivity_grid.y_boundaries ||
+      stored_grid.z_boundaries != emissivity_grid.z_boundaries) {
+    exit_with_error("it was computed from an input file with a different "
+                    "grid.");
+  }
+  if (output_file.read_input_fingerprint() != input_fingerprint) {
+    exit_with_error("it was computed from a different or modified input "
+                    "file.");
+  }
+  auto stored_parameters = output_file.read_parameters();
+  if (!stored_parameters.has_same_geometry(parameters) ||
+      !stored_parameters.has_same_approximations(parameters)) {
+    exit_with_error("it was computed with different parameters.");
+  }
+  // both energies were stored in single precision, so they compare exactly
+  if (output_file.read_energies_dataset() != energies) {
+    exit_with_error("it was computed from an input file with different "
+                    "energies.");
+  }
+  auto shard = output_file.read_shard_specification(
+      sky.get_number_of_sky_pixels(), energies.size());
+  if (shard.pixel_range != sky.get_pixel_range() ||
+      shard.energy_indices != sky.get_energy_indices()) {
+    exit_with_error("it covers different pixels or energies.");
+  }
+  if (output_file.read_completed_skies().size() != number_of_skies ||
+      output_file.read_completed_band_skies().size() != number_of_band_skies) {
+    exit_with_error("it contains different skies.");
+  }
+  if (!parameters.distance_bin_edges.empty() && number_of_skies != 0 &&
+      !output_file.has_dataset("gamma ray sky distance histograms")) {
+    exit_with_error("it doesn't contain distance histograms.");
+  }
+  if (parameters.observer_gradient && number_of_skies != 0 &&
+      !output_file.has_dataset("gamma ray sky observer gradients")) {
+    exit_with_error("it doesn't contain observer gradients.");
+  }
+  const auto &requested_energies = sky.get_requested_energies();
+  if (output_file.has_dataset("requested energies") !=
+      !requested_energies.empty()) {
+    exit_with_error("it contains different requested energies.");
+  }
+  if (!requested_energies.empty()) {
+    auto stored_energies = output_file.read_requested_energies();
+    // the requested energies were stored in single precision
+    if (stored_energies.size() != requested_energies.size() ||
+        !std::equal(stored_energies.cbegin(), stored_energies.cend(),
+                    requested_energies.cbegin(), [](double a, double b) {
+                      return std::abs(a - b) <= 1e-6 * std::abs(b);
+                    })) {
+      exit_with_error("it contains different requested energies.");
+    }
+  }
+  for (const auto &pattern : parameters.emissivity_components) {
+    if (number_of_skies != 0 &&
+        !output_file.has_dataset("gamma ray skies " +
+                                 HDF5File::get_component_name(pattern))) {
+      exit_with_error("it contains different emissivity components.");
+    }
+  }
+  if (number_of_band_skies != 0) {
+    auto stored_bands = output_file.read_band_edges();
+    for (size_t band{}; band != number_of_band_skies; ++band) {
+      for (size_t edge{}; edge != 2; ++edge) {
+        double expected = parameters.energy_bands[band][edge];
+        if (std::abs(stored_bands[band][edge] - expected) >
+            1e-6 * std::abs(expected)) {
+          exit_with_error("it contains different energy bands.");
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Runs gamma_sky.
+ * @throws std::invalid_argument if the arguments or parameters are invalid
+ */
+int run(int argc, char *argv[]) {
   std::string usage =
-      "usage: gamma_rays <parameter file> <input H5 file> <output H5 file>";
-  if (argc != 4) {
+      "usage: gamma_rays <parameter file> <input H5 file> <output H5 file>\n"
+      "                  [--pixels <first>:<last>] [--energies <indices>]\n"
+      "                  [--resume]\n"
+      "\n"
+      "  --pixels    compute only the HEALPix pixels [first, last)\n"
+      "  --energies  compute only the given energy indices, e.g., 0,3,5:9\n"
+      "  --resume    continue an interrupted run that wrote to the output\n"
+      "              file (skips the skies that were already completed)\n"
+      "\n"
+      "Runs with --pixels or --energies write shards that can be combined\n"
+      "with merge_gamma_sky_shards.";
+  if (argc < 4) {
     std::cerr << usage << std::endl;
     std::exit(1);
   }
@@ -17,25 +193,318 @@ int main(int argc, char *argv[]) {
   std::string parameter_file_path(argv[1]);
   std::string input_file_path(argv[2]);
   std::string output_file_path(argv[3]);
+  std::optional<std::array<size_t, 2>> pixel_range;
+  std::optional<std::vector<size_t>> energy_indices;
+  bool resume = false;
+  for (int i{4}; i < argc; ++i) {
+    std::string option(argv[i]);
+    if (option == "--resume") {
+      resume = true;
+      continue;
+    }
+    if (i + 1 == argc) {
+      std::cerr << "error: missing value of the option '" << option << "'\n"
+                << usage << std::endl;
+      std::exit(1);
+    }
+    std::string value(argv[++i]);
+    if (option == "--pixels") {
+      pixel_range = shards::parse_pixel_range(value);
+    } else if (option == "--energies") {
+      energy_indices = shards::parse_energy_indices(value);
+    } else {
+      std::cerr << "error: unknown option '" << option << "'\n"
+                << usage << std::endl;
+      std::exit(1);
+    }
+  }
+  bool is_shard = pixel_range || energy_indices;
+  bool is_resumed = resume && std::filesystem::exists(output_file_path);
 
   // open files
   HDF5File input_file(input_file_path, 'r');
-  HDF5File output_file(output_file_path, 'w');
+  HDF5File output_file(output_file_path, is_resumed ? 'a' : 'w');
   ParameterFile parameter_file(parameter_file_path);
 
-  // get data
+  // get data (the emissivity volumes are loaded according to the execution
+  // plan)
   auto energies = input_file.read_energies();
-  auto emissivities = input_file.read_emissivities();
+  tensors::tensor_4d emissivities(energies.size());
   auto emissivity_grid = input_file.read_emissivity_grid();
   auto parameters = parameter_file.get_parameters();
+  parameters.pixel_range = pixel_range;
+  parameters.energy_indices = energy_indices;
+  runs::check_parameters(parameters, is_shard);
+  const auto &component_patterns = parameters.emissivity_components;
 
-  // compute gamma skies
+  // set up the sky
   Sky sky(energies, emissivities, emissivity_grid, parameters);
-  auto gamma_skies = sky.compute_gamma_skies();
+  bool has_band_skies = runs::has_band_skies(parameters);
+  size_t number_of_skies =
+      parameters.compute_energy_skies ? sky.get_energy_indices().size() : 0;
+  size_t number_of_band_skies =
+      has_band_skies ? parameters.energy_bands.size() : 0;
+
+  // plan the memory usage
+  const auto &range = sky.get_pixel_range();
+  ExecutionPlan plan({{emissivity_grid.x_centers.size(),
+                       emissivity_grid.y_centers.size(),
+                       emissivity_grid.z_centers.size()},
+                      energies.size(),
+                      number_of_skies,
+                      number_of_band_skies,
+                      range[1] - range[0],
+                      std::max<size_t>(component_patterns.size(), 1),
+                      sky.get_placement().get_number_of_replicas()},
+                     parameters);
+  if (parameters.max_memory > 0.) {
+    std::cout << plan.describe();
+  }
+  if (parameters.numa_policy != "first_touch" || parameters.huge_pages) {
+    std::cout << sky.get_placement().describe();
+  }
+  bool progressive_preview = !plan.streams_skies();
+  if (parameters.progressive_preview && !progressive_preview &&
+      number_of_skies != 0) {
+    std::cout << "the progressive previews don't fit into max_memory_in_GB "
+                 "and are skipped"
+              << std::endl;
+  }
+  if (plan.stores_pixel_directions()) {
+    sky.store_pixel_directions();
+  }
+  if (parameters.use_projection_operator) {
+    sky.use_projection_operator(get_projection_operator(sky, parameters));
+  }
+  if (plan.loads_all_energies()) {
+    emissivities = input_file.read_emissivities();
+  }
+  // loads the missing emissivity volumes of the rows of the skies that aren't
+  // skipped (compressed volumes replace their double precision volumes)
+  auto load_emissivities = [&](const std::vector<bool> &skipped_rows) {
+    for (size_t row{}; row != number_of_skies; ++row) {
+      auto energy = sky.get_energy_indices()[row];
+      if (!skipped_rows[row] && emissivities[energy].empty()) {
+        emissivities[energy] = input_file.read_emissivity(energy);
+        if (plan.keeps_compressed_volumes()) {
+          sky.compress_emissivity(energy);
+          tensors::tensor_3d().swap(emissivities[energy]);
+        }
+      }
+    }
+  };
+  if (is_resumed) {
+    check_checkpoint(output_file, output_file_path, sky, parameters, energies,
+                     emissivity_grid, get_file_fingerprint(input_file_path),
+                     number_of_skies, number_of_band_skies);
+  } else {
+    // the metadata and the progress record are written first, such that an
+    // interrupted run can be resumed
+    if (parameters.compute_energy_skies) {
+      if (component_patterns.empty()) {
+        output_file.create_skies(number_of_skies, range[1] - range[0]);
+      }
+      for (const auto &pattern : component_patterns) {
+        output_file.create_skies(number_of_skies, range[1] - range[0],
+                                 HDF5File::get_component_name(pattern));
+      }
+    }
+    if (!parameters.distance_bin_edges.empty() && number_of_skies != 0) {
+      output_file.create_distance_histograms(number_of_skies,
+                                             parameters.distance_bin_edges,
+                                             range[1] - range[0]);
+    }
+    if (parameters.observer_gradient && number_of_skies != 0) {
+      output_file.create_observer_gradients(number_of_skies,
+                                            range[1] - range[0]);
+    }
+    if (has_band_skies) {
+      output_file.create_band_skies(parameters.energy_bands,
+                                    range[1] - range[0]);
+    }
+    runs::save_metadata(output_file, sky, parameters, energies);
+    output_file.save_input_grid(emissivity_grid);
+    output_file.save_input_fingerprint(get_file_fingerprint(input_file_path));
+    output_file.create_progress_record(number_of_skies, number_of_band_skies);
+  }
 
-  // save results and metadata
-  output_file.save_skies(gamma_skies);
-  output_file.save_energies(energies);
-  output_file.save_parameters(parameters);
+  // compute and save gamma skies (each sky is checkpointed when it's done)
+  if (parameters.compute_energy_skies) {
+    auto completed_skies = output_file.read_completed_skies();
+    auto save_sky = [&](size_t row, const tensors::tensor_1d &gamma_sky) {
+      output_file.write_sky(row, 0, gamma_sky);
+      output_file.mark_sky_completed(row);
+    };
+    if (!component_patterns.empty()) {
+      // all components of an energy are integrated together
+      for (size_t row{}; row != number_of_skies; ++row) {
+        if (completed_skies[row]) {
+          continue;
+        }
+        auto energy = sky.get_energy_indices()[row];
+        tensors::tensor_4d components;
+        for (const auto &pattern : component_patterns) {
+          components.push_back(input_file.read_emissivity(energy, pattern));
+        }
+        auto skies = sky.compute_gamma_component_skies(components);
+        for (size_t component{}; component != skies.size(); ++component) {
+          output_file.write_sky(
+              row, 0, skies[component],
+              HDF5File::get_component_name(component_patterns[component]));
+        }
+        output_file.mark_sky_completed(row);
+      }
+    } else if (!parameters.distance_bin_edges.empty()) {
+      // the skies are resolved by distance along the same traversal
+      for (size_t row{}; row != number_of_skies; ++row) {
+        if (completed_skies[row]) {
+          continue;
+        }
+        auto energy = sky.get_energy_indices()[row];
+        if (emissivities[energy].empty()) {
+          emissivities[energy] = input_file.read_emissivity(energy);
+        }
+        auto rows = sky.compute_distance_resolved_sky(emissivities[energy]);
+        output_file.write_sky(row, 0, rows[0]);
+        output_file.write_distance_histograms(row, 0, rows);
+        output_file.mark_sky_completed(row);
+        if (!plan.loads_all_energies()) {
+          tensors::tensor_3d().swap(emissivities[energy]);
+        }
+      }
+    } else if (parameters.observer_gradient) {
+      // the derivatives are integrated along the same traversal
+      for (size_t row{}; row != number_of_skies; ++row) {
+        if (completed_skies[row]) {
+          continue;
+        }
+        auto energy = sky.get_energy_indices()[row];
+        if (emissivities[energy].empty()) {
+          emissivities[energy] = input_file.read_emissivity(energy);
+        }
+        auto rows = sky.compute_observer_gradient_sky(emissivities[energy]);
+        output_file.write_sky(row, 0, rows[0]);
+        output_file.write_observer_gradients(row, 0, rows);
+        output_file.mark_sky_completed(row);
+        if (!plan.loads_all_energies()) {
+          tensors::tensor_3d().swap(emissivities[energy]);
+        }
+      }
+    } else if (plan.integrates_bricks()) {
+      // the volumes are read in bricks of z planes, which are integrated one
+      // after another
+      for (size_t row{}; row != number_of_skies; ++row) {
+        if (completed_skies[row]) {
+          continue;
+        }
+        auto energy = sky.get_energy_indices()[row];
+        save_sky(row, sky.compute_out_of_core_sky(
+                          [&](size_t first_plane, size_t number_of_planes) {
+                            return input_file.read_emissivity_planes(
+                                energy, first_plane, number_of_planes);
+                          }));
+      }
+    } else if (!progressive_preview) {
+      // the skies are computed in batches of resident emissivity volumes
+      size_t batch_size = plan.get_number_of_resident_energies();
+      for (size_t first{}; first < number_of_skies; first += batch_size) {
+        auto skipped_rows = completed_skies;
+        for (size_t row{}; row != number_of_skies; ++row) {
+          if (row < first || row >= first + batch_size) {
+            skipped_rows[row] = true;
+          }
+        }
+        load_emissivities(skipped_rows);
+        sky.compute_gamma_skies(skipped_rows, save_sky);
+        if (!plan.loads_all_energies()) {
+          for (auto energy : sky.get_energy_indices()) {
+            tensors::tensor_3d().swap(emissivities[energy]);
+          }
+        }
+      }
+    } else if (std::count(completed_skies.cbegin(), completed_skies.cend(),
+                          false) != 0) {
+      load_emissivities(std::vector<bool>(number_of_skies, false));
+      auto skies = sky.compute_progressive_gamma_skies(
+          [&](int order, const tensors::tensor_2d &preview_skies) {
+            if (!output_file.has_preview_skies(order)) {
+              output_file.save_preview_skies(order, preview_skies);
+            }
+            std::cout << "preview of HEALPix order " << order << " saved"
+                      << std::endl;
+          });
+      for (size_t row{}; row != skies.size(); ++row) {
+        if (!completed_skies[row]) {
+          save_sky(row, skies[row]);
+        }
+      }
+    }
+    if (!sky.get_requested_energies().empty() &&
+        !output_file.has_dataset("gamma ray skies at requested energies")) {
+      output_file.save_requested_energy_skies(
+          sky.interpolate_requested_skies(output_file.read_skies()));
+      std::cout << "requested energies: "
+                << sky.get_requested_energies().size()
+                << " skies interpolated between the skies of "
+                << sky.get_energy_indices().size()
+                << " energies of the input file\n";
+    }
+  }
+  if (has_band_skies) {
+    sky.compute_gamma_band_skies(
+        output_file.read_completed_band_skies(),
+        [&](size_t row, const tensors::tensor_1d &gamma_sky) {
+          output_file.write_band_sky(row, 0, gamma_sky);
+          output_file.mark_band_sky_completed(row);
+        });
+  }
+
+  if (sky.get_number_of_mirrored_values() > 0) {
+    std::cout << "symmetries: " << sky.get_number_of_mirrored_values()
+              << " sky values were mirrored instead of integrated\n";
+  }
+  if (parameters.skipping_tolerance > 0.) {
+    std::cout << "empty space skipping: maximum relative error bound "
+              << sky.get_skipping_error_bound() << '\n';
+  }
+  const auto &load_balance = sky.get_ray_load_balance();
+  if (load_balance.measured_mean > 0.) {
+    // imbalance: load of the most loaded worker relative to the mean load
+    std::cout << "ray scheduling (" << parameters.ray_scheduling << "): ";
+    if (load_balance.predicted_mean > 0.) {
+      std::cout << "predicted imbalance "
+                << load_balance.get_predicted_imbalance() << " ("
+                << load_balance.get_equal_count_imbalance()
+                << " with chunks of equal count), ";
+    }
+    std::cout << "measured imbalance "
+              << load_balance.get_measured_imbalance() << '\n';
+  }
+  if (parameters.volume_compression != "none") {
+    std::cout << "volume compression (" << parameters.volume_compression
+              << "): maximum quantization error "
+              << sky.get_compression_error()
+              << " relative to the maximum of a volume\n";
+  }
+  const auto &decomposition_errors = sky.get_energy_decomposition_errors();
+  if (!decomposition_errors.empty()) {
+    std::cout << "energy decomposition: "
+              << parameters.energy_decomposition_components
+              << " components, maximum relative truncation error "
+              << *std::max_element(decomposition_errors.cbegin(),
+                                   decomposition_errors.cend())
+              << '\n';
+  }
+  runs::save_error_bounds(output_file, parameters, decomposition_errors,
+                          sky.get_skipping_error_bound());
   return 0;
 }
+
+int main(int argc, char *argv[]) {
+  try {
+    return run(argc, argv);
+  } catch (std::exception &exception) {
+    std::cerr << "error: " << exception.what() << '\n';
+    std::exit(1);
+  }
+}
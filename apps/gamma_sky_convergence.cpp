@@ -0,0 +1,598 @@
+// Author: Stefan Lepperdinger
+#include "HDF5File.h"
+#include "ParameterFile.h"
+#include "PixelDirections.h"
+#include "Sky.h"
+#include "grids.h"
+#include "mathematics.h"
+#include "tensors.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const double kpc_to_cm = 3.0856775814913673e21;
+
+/**
+ * Emissivity field whose line of sight integrals from the origin are known.
+ */
+struct AnalyticField {
+  std::string name;
+  // emissivity at {x, y, z} in kpc (arbitrary units)
+  std::function<double(const std::array<double, 3> &)> emissivity;
+  // integral from the origin along the unit vector direction up to the
+  // distance in kpc × (units of the emissivity)
+  std::function<double(const std::array<double, 3> &direction,
+                       double distance)>
+      integral;
+};
+
+/**
+ * Volume whose skies are computed with the different settings.
+ */
+struct TestCase {
+  std::string name;
+  // geometry of the skies (observer, line of sight and HEALPix order)
+  ParameterFile::Parameters parameters;
+  std::vector<double> energies;
+  // emissivities[0][x][y][z]
+  tensors::tensor_4d emissivities;
+  grids::cartesian_grid_3d grid;
+  // exact sky or sky of the finest radial step size
+  tensors::tensor_1d reference_sky;
+};
+
+/**
+ * Accuracy and cost of the sky of a test case for a method and a radial step
+ * size.
+ */
+struct Result {
+  std::string case_name;
+  std::string method;
+  double radial_step_size{};
+  // largest absolute error divided by the largest absolute reference value
+  double maximum_error{};
+  // mean absolute error divided by the mean absolute reference value
+  double mean_error{};
+  // shortest wall time of the repetitions in s
+  double seconds{};
+  // radial cells of the central rays within the grid
+  double samples{};
+};
+
+/**
+ * Integration method, i.e., the parameters that differ from plain ray
+ * marching.
+ */
+struct Method {
+  std::string name;
+  std::function<void(ParameterFile::Parameters &)> configure;
+};
+
+std::vector<Method> make_methods() {
+  return {
+      {"ray_marching", [](ParameterFile::Parameters &) {}},
+      {"skipping_1e-3",
+       [](ParameterFile::Parameters &parameters) {
+         parameters.skipping_tolerance = 1e-3;
+       }},
+      {"cone_tracing",
+       [](ParameterFile::Parameters &parameters) {
+         parameters.cone_tracing = true;
+       }},
+      {"fp16",
+       [](ParameterFile::Parameters &parameters) {
+         parameters.volume_compression = "fp16";
+       }},
+      {"bfloat16",
+       [](ParameterFile::Parameters &parameters) {
+         parameters.volume_compression = "bfloat16";
+       }},
+      {"log16",
+       [](ParameterFile::Parameters &parameters) {
+         parameters.volume_compression = "log16";
+       }},
+  };
+}
+
+std::vector<AnalyticField> make_analytic_fields() {
+  // ∫_0^s exp(-k r) dr
+  auto exponential_integral = [](double k, double distance) {
+    return k * distance < 1e-12 ? distance
+                                : -std::expm1(-k * distance) / k;
+  };
+  std::array<double, 3> clump_center{4., 1., 0.5};
+  double clump_width = 1.;
+  return {
+      // reproduced exactly by the trilinear interpolation
+      {"linear",
+       [](const std::array<double, 3> &point) {
+         return 2. + 0.05 * point[0] + 0.03 * point[1] + 0.2 * point[2];
+       },
+       [](const std::array<double, 3> &direction, double distance) {
+         double slope = 0.05 * direction[0] + 0.03 * direction[1] +
+                        0.2 * direction[2];
+         return 2. * distance + 0.5 * slope * distance * distance;
+       }},
+      // scale lengths of 3 kpc and 0.3 kpc
+      {"exponential_disk",
+       [](const std::array<double, 3> &point) {
+         return std::exp(-std::hypot(point[0], point[1]) / 3. -
+                         std::abs(point[2]) / 0.3);
+       },
+       [exponential_integral](const std::array<double, 3> &direction,
+                              double distance) {
+         double k = std::hypot(direction[0], direction[1]) / 3. +
+                    std::abs(direction[2]) / 0.3;
+         return exponential_integral(k, distance);
+       }},
+      {"gaussian_clump",
+       [=](const std::array<double, 3> &point) {
+         double squared_distance =
+             mathematics::sqr(point[0] - clump_center[0]) +
+             mathematics::sqr(point[1] - clump_center[1]) +
+             mathematics::sqr(point[2] - clump_center[2]);
+         return std::exp(-squared_distance /
+                         (2. * mathematics::sqr(clump_width)));
+       },
+       [=](const std::array<double, 3> &direction, double distance) {
+         // |r direction - center|² = (r - t)² + m²
+         double t = direction[0] * clump_center[0] +
+                    direction[1] * clump_center[1] +
+                    direction[2] * clump_center[2];
+         double m2 = mathematics::sqr(clump_center[0]) +
+                     mathematics::sqr(clump_center[1]) +
+                     mathematics::sqr(clump_center[2]) - t * t;
+         double scale = std::sqrt(2.) * clump_width;
+         return std::exp(-m2 / mathematics::sqr(scale)) * clump_width *
+                std::sqrt(mathematics::half_pi) *
+                (std::erf((distance - t) / scale) - std::erf(-t / scale));
+       }},
+  };
+}
+
+std::vector<double> make_axis(double minimum, double maximum,
+                              size_t number_of_points) {
+  std::vector<double> axis;
+  for (size_t i{}; i != number_of_points; ++i) {
+    axis.push_back(minimum + (maximum - minimum) * static_cast<double>(i) /
+                                 static_cast<double>(number_of_points - 1));
+  }
+  return axis;
+}
+
+ParameterFile::Parameters make_default_parameters() {
+  ParameterFile::Parameters parameters{};
+  parameters.symmetry_tolerance = 1e-6;
+  parameters.volume_compression = "none";
+  parameters.numa_policy = "first_touch";
+  parameters.ray_scheduling = "equal_count";
+  parameters.compute_energy_skies = true;
+  return parameters;
+}
+
+/**
+ * @return direction of a pixel like the sky computes it
+ */
+std::array<double, 3>
+get_direction(const Healpix_Base &healpix_base,
+              const ParameterFile::Parameters &parameters, size_t pixel) {
+  auto angles = healpix_base.pix2ang(static_cast<int>(pixel));
+  return PixelDirections::make_direction(
+      angles.phi + parameters.line_of_sight_longitude,
+      mathematics::half_pi - angles.theta + parameters.line_of_sight_latitude);
+}
+
+/**
+ * @return distance from the observer along the direction to the boundary of
+ *         the grid in kpc
+ */
+double get_exit_distance(const TestCase &test_case,
+                         const std::array<double, 3> &direction) {
+  const auto &grid = test_case.grid;
+  const auto &observer = test_case.parameters.xyz_observer_location;
+  std::array<const std::vector<double> *, 3> axes{
+      &grid.x_centers, &grid.y_centers, &grid.z_centers};
+  double distance = INFINITY;
+  for (size_t axis{}; axis != 3; ++axis) {
+    if (direction[axis] > 0.) {
+      distance = std::min(distance, (axes[axis]->back() - observer[axis]) /
+                                        direction[axis]);
+    } else if (direction[axis] < 0.) {
+      distance = std::min(distance, (axes[axis]->front() - observer[axis]) /
+                                        direction[axis]);
+    }
+  }
+  return distance;
+}
+
+TestCase make_analytic_case(const AnalyticField &field, int healpix_order) {
+  TestCase test_case;
+  test_case.name = field.name;
+  test_case.parameters = make_default_parameters();
+  test_case.parameters.healpix_order = healpix_order;
+  test_case.energies = {1.};
+  test_case.grid.x_centers = make_axis(-10., 10., 81);
+  test_case.grid.y_centers = make_axis(-10., 10., 81);
+  test_case.grid.z_centers = make_axis(-2., 2., 41);
+  const auto &grid = test_case.grid;
+  auto emissivity = tensors::make_3d_tensor(
+      {grid.x_centers.size(), grid.y_centers.size(), grid.z_centers.size()});
+  for (size_t x{}; x != grid.x_centers.size(); ++x) {
+    for (size_t y{}; y != grid.y_centers.size(); ++y) {
+      for (size_t z{}; z != grid.z_centers.size(); ++z) {
+        emissivity[x][y][z] = field.emissivity(
+            {grid.x_centers[x], grid.y_centers[y], grid.z_centers[z]});
+      }
+    }
+  }
+  test_case.emissivities.push_back(std::move(emissivity));
+
+  Healpix_Base healpix_base(healpix_order, RING);
+  for (size_t pixel{}; pixel != static_cast<size_t>(healpix_base.Npix());
+       ++pixel) {
+    auto direction = get_direction(healpix_base, test_case.parameters, pixel);
+    test_case.reference_sky.push_back(
+        kpc_to_cm *
+        field.integral(direction, get_exit_distance(test_case, direction)));
+  }
+  return test_case;
+}
+
+/**
+ * @return number of radial cells of the central rays within the grid
+ */
+double count_samples(const TestCase &test_case, double radial_step_size) {
+  Healpix_Base healpix_base(test_case.parameters.healpix_order, RING);
+  double samples{};
+  for (size_t pixel{}; pixel != static_cast<size_t>(healpix_base.Npix());
+       ++pixel) {
+    auto direction = get_direction(healpix_base, test_case.parameters, pixel);
+    samples += std::floor(get_exit_distance(test_case, direction) /
+                              radial_step_size +
+                          .5);
+  }
+  return samples;
+}
+
+/**
+ * Computes the sky of a test case with a method and a radial step size.
+ * @param seconds shortest wall time of the repetitions in s
+ */
+tensors::tensor_1d compute_sky(TestCase &test_case, const Method &method,
+                               double radial_step_size, size_t repetitions,
+                               double &seconds) {
+  auto parameters = test_case.parameters;
+  parameters.radial_step_size = radial_step_size;
+  method.configure(parameters);
+  Sky sky(test_case.energies, test_case.emissivities, test_case.grid,
+          parameters);
+  sky.store_pixel_directions();
+  tensors::tensor_1d gamma_sky;
+  seconds = INFINITY;
+  bool compresses_volume = parameters.volume_compression != "none";
+  for (size_t repetition{}; repetition != repetitions; ++repetition) {
+    // like gamma_sky, the volume is compressed once when it's read, so only
+    // the integration of the 16 bit values is timed
+    if (compresses_volume) {
+      sky.compress_emissivity(0);
+    }
+    auto start = std::chrono::steady_clock::now();
+    gamma_sky = compresses_volume ? sky.compute_gamma_skies().front()
+                                  : sky.compute_gamma_sky(
+                                        test_case.emissivities.front());
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    seconds = std::min(seconds, duration.count());
+  }
+  return gamma_sky;
+}
+
+Result evaluate(TestCase &test_case, const Method &method,
+                double radial_step_size, size_t repetitions) {
+  Result result{test_case.name, method.name, radial_step_size};
+  auto sky = compute_sky(test_case, method, radial_step_size, repetitions,
+                         result.seconds);
+  const auto &reference = test_case.reference_sky;
+  double maximum_reference{};
+  double reference_sum{};
+  double error_sum{};
+  for (size_t pixel{}; pixel != sky.size(); ++pixel) {
+    double error = std::abs(sky[pixel] - reference[pixel]);
+    result.maximum_error = std::max(result.maximum_error, error);
+    error_sum += error;
+    maximum_reference = std::max(maximum_reference, std::abs(reference[pixel]));
+    reference_sum += std::abs(reference[pixel]);
+  }
+  if (maximum_reference > 0.) {
+    result.maximum_error /= maximum_reference;
+    result.mean_error = error_sum / reference_sum;
+  }
+  result.samples = count_samples(test_case, radial_step_size);
+  return result;
+}
+
+std::string make_key(const Result &result) {
+  std::ostringstream key;
+  key << result.case_name << ' ' << result.method << ' '
+      << result.radial_step_size;
+  return key.str();
+}
+
+const char *results_header = "# case method radial_step_size_in_kpc "
+                             "maximum_error mean_error seconds samples\n";
+
+void write_result(std::ostream &stream, const Result &result) {
+  stream << std::setprecision(6) << result.case_name << ' ' << result.method
+         << ' ' << result.radial_step_size << ' ' << result.maximum_error
+         << ' ' << result.mean_error << ' ' << result.seconds << ' '
+         << result.samples << std::endl;
+}
+
+std::map<std::string, Result> read_baseline(const std::string &file_path) {
+  std::ifstream file(file_path);
+  if (!file) {
+    std::cerr << "error: Couldn't open the baseline '" << file_path << "'.\n";
+    std::exit(1);
+  }
+  std::map<std::string, Result> baseline;
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream stream(line);
+    Result result;
+    if (!(stream >> result.case_name >> result.method >>
+          result.radial_step_size >> result.maximum_error >>
+          result.mean_error >> result.seconds >> result.samples)) {
+      std::cerr << "error: The baseline '" << file_path
+                << "' contains the invalid line '" << line << "'.\n";
+      std::exit(1);
+    }
+    baseline[make_key(result)] = result;
+  }
+  return baseline;
+}
+
+/**
+ * Flags the results that are less accurate or slower than in the baseline.
+ * @return number of regressions
+ */
+size_t compare_with_baseline(const std::vector<Result> &results,
+                             const std::map<std::string, Result> &baseline,
+                             double error_tolerance, double time_tolerance) {
+  size_t number_of_regressions{};
+  for (const auto &result : results) {
+    auto entry = baseline.find(make_key(result));
+    if (entry == baseline.cend()) {
+      std::cout << "not in the baseline: " << make_key(result) << '\n';
+      continue;
+    }
+    const auto &expected = entry->second;
+    // errors at the level of the rounding errors don't count
+    if (result.maximum_error >
+        expected.maximum_error * (1. + error_tolerance) + 1e-12) {
+      std::cout << "accuracy regression: " << make_key(result)
+                << ": maximum error " << result.maximum_error << " instead of "
+                << expected.maximum_error << '\n';
+      ++number_of_regressions;
+    }
+    if (result.seconds > expected.seconds * (1. + time_tolerance)) {
+      std::cout << "performance regression: " << make_key(result) << ": "
+                << result.seconds << " s instead of " << expected.seconds
+                << " s\n";
+      ++number_of_regressions;
+    }
+  }
+  return number_of_regressions;
+}
+
+std::vector<std::string> split(const std::string &list) {
+  std::vector<std::string> items;
+  std::istringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+} // namespace
+
+/**
+ * Runs gamma_sky_convergence.
+ * @throws std::invalid_argument if the arguments or parameters are invalid
+ */
+int run(int argc, char *argv[]) {
+  std::string usage =
+      "usage: gamma_sky_convergence [--input <parameter file> <H5 file>]\n"
+      "                             [--energy <index>] [--order <order>]\n"
+      "                             [--steps <kpc,...>] [--methods <names>]\n"
+      "                             [--repetitions <number>]\n"
+      "                             [--save <baseline file>]\n"
+      "                             [--compare <baseline file>]\n"
+      "                             [--error-tolerance <fraction>]\n"
+      "                             [--time-tolerance <fraction>]\n"
+      "\n"
+      "Computes skies with a sweep of radial step sizes and integration\n"
+      "methods and reports their errors, wall times and radial samples.\n"
+      "\n"
+      "  --input            also sweep the given input file (the reference\n"
+      "                     is ray marching with a quarter of the finest\n"
+      "                     step size)\n"
+      "  --energy           energy index of the input file (default: middle)\n"
+      "  --order            HEALPix order of the analytic fields (default: 4)\n"
+      "  --steps            radial step sizes in kpc\n"
+      "                     (default: 0.2,0.1,0.05,0.02,0.01)\n"
+      "  --methods          ray_marching, skipping_1e-3, cone_tracing, fp16,\n"
+      "                     bfloat16 and log16 (default: all)\n"
+      "  --repetitions      the shortest of the repetitions is reported\n"
+      "                     (default: 3)\n"
+      "  --save             save the results as a baseline\n"
+      "  --compare          flag the results that are less accurate or\n"
+      "                     slower than in the baseline (exit status 2)\n"
+      "  --error-tolerance  allowed relative increase of an error\n"
+      "                     (default: 0.01)\n"
+      "  --time-tolerance   allowed relative increase of a wall time\n"
+      "                     (default: 0.25)\n"
+      "\n"
+      "The analytic fields (linear, exponential disk and gaussian clump) are\n"
+      "sampled on a 81 x 81 x 41 grid of 20 x 20 x 4 kpc around the observer\n"
+      "and compared with their exact line of sight integrals, so their errors\n"
+      "include the error of the trilinear interpolation of the grid.";
+
+  // get arguments
+  std::string parameter_file_path;
+  std::string input_file_path;
+  std::optional<size_t> energy_index;
+  int healpix_order = 4;
+  std::vector<double> radial_step_sizes{0.2, 0.1, 0.05, 0.02, 0.01};
+  auto methods = make_methods();
+  size_t repetitions = 3;
+  std::string save_file_path;
+  std::string compare_file_path;
+  double error_tolerance = 0.01;
+  double time_tolerance = 0.25;
+  for (int i{1}; i < argc; ++i) {
+    std::string option(argv[i]);
+    int number_of_values = option == "--input" ? 2 : 1;
+    if (i + number_of_values >= argc) {
+      std::cerr << "error: missing value of the option '" << option << "'\n"
+                << usage << std::endl;
+      std::exit(1);
+    }
+    std::string value(argv[++i]);
+    if (option == "--input") {
+      parameter_file_path = value;
+      input_file_path = argv[++i];
+    } else if (option == "--energy") {
+      energy_index = std::stoul(value);
+    } else if (option == "--order") {
+      healpix_order = std::stoi(value);
+    } else if (option == "--steps") {
+      radial_step_sizes.clear();
+      for (const auto &step : split(value)) {
+        radial_step_sizes.push_back(std::stod(step));
+      }
+    } else if (option == "--methods") {
+      std::vector<Method> selected_methods;
+      for (const auto &name : split(value)) {
+        auto method = std::find_if(
+            methods.cbegin(), methods.cend(),
+            [&name](const Method &method) { return method.name == name; });
+        if (method == methods.cend()) {
+          throw std::invalid_argument("Unknown method '" + name + "'.");
+        }
+        selected_methods.push_back(*method);
+      }
+      methods = selected_methods;
+    } else if (option == "--repetitions") {
+      repetitions = std::max<size_t>(std::stoul(value), 1);
+    } else if (option == "--save") {
+      save_file_path = value;
+    } else if (option == "--compare") {
+      compare_file_path = value;
+    } else if (option == "--error-tolerance") {
+      error_tolerance = std::stod(value);
+    } else if (option == "--time-tolerance") {
+      time_tolerance = std::stod(value);
+    } else {
+      std::cerr << "error: unknown option '" << option << "'\n"
+                << usage << std::endl;
+      std::exit(1);
+    }
+  }
+  if (radial_step_sizes.empty() ||
+      *std::min_element(radial_step_sizes.cbegin(), radial_step_sizes.cend()) <=
+          0.) {
+    throw std::invalid_argument("The radial step sizes have to be positive.");
+  }
+
+  // set up the test cases
+  std::vector<TestCase> test_cases;
+  for (const auto &field : make_analytic_fields()) {
+    test_cases.push_back(make_analytic_case(field, healpix_order));
+  }
+  if (!input_file_path.empty()) {
+    TestCase test_case;
+    test_case.name =
+        std::filesystem::path(input_file_path).stem().string();
+    ParameterFile parameter_file(parameter_file_path);
+    test_case.parameters = parameter_file.get_parameters();
+    HDF5File input_file(input_file_path, 'r');
+    auto energies = input_file.read_energies();
+    size_t energy = energy_index.value_or(energies.size() / 2);
+    if (energy >= energies.size()) {
+      throw std::invalid_argument("The energy index is out of range.");
+    }
+    test_case.name += "_E" + std::to_string(energy);
+    test_case.energies = {energies[energy]};
+    test_case.emissivities.push_back(input_file.read_emissivity(energy));
+    test_case.grid = input_file.read_emissivity_grid();
+    double seconds{};
+    test_case.reference_sky = compute_sky(
+        test_case, make_methods().front(),
+        0.25 * *std::min_element(radial_step_sizes.cbegin(),
+                                 radial_step_sizes.cend()),
+        1, seconds);
+    test_cases.push_back(std::move(test_case));
+  }
+
+  // sweep
+  std::vector<Result> results;
+  std::cout << results_header;
+  for (auto &test_case : test_cases) {
+    for (const auto &method : methods) {
+      for (double radial_step_size : radial_step_sizes) {
+        results.push_back(
+            evaluate(test_case, method, radial_step_size, repetitions));
+        write_result(std::cout, results.back());
+      }
+    }
+  }
+
+  if (!save_file_path.empty()) {
+    std::ofstream file(save_file_path);
+    file << results_header;
+    for (const auto &result : results) {
+      write_result(file, result);
+    }
+    if (!file) {
+      std::cerr << "error: Couldn't write the baseline '" << save_file_path
+                << "'.\n";
+      std::exit(1);
+    }
+  }
+  if (!compare_file_path.empty()) {
+    auto number_of_regressions =
+        compare_with_baseline(results, read_baseline(compare_file_path),
+                              error_tolerance, time_tolerance);
+    std::cout << number_of_regressions << " regressions compared with the "
+              << "baseline '" << compare_file_path << "'\n";
+    if (number_of_regressions != 0) {
+      return 2;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    return run(argc, argv);
+  } catch (std::exception &exception) {
+    std::cerr << "error: " << exception.what() << '\n';
+    std::exit(1);
+  }
+}
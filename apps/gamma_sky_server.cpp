@@ -0,0 +1,487 @@
+// Author: Stefan Lepperdinger
+#include "HDF5File.h"
+#include "ParameterFile.h"
+#include "Sky.h"
+#include "runs.h"
+#include "shards.h"
+#include "tensors.h"
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <tbb/task_arena.h>
+#include <unistd.h>
+
+/**
+ * Input data that is loaded once and shared by all requests.
+ */
+struct InputData {
+  // energies of the emissivities in MeV
+  std::vector<double> energies;
+  // emissivities[energy][x][y][z] in MeV / (s sr cm³)
+  tensors::tensor_4d emissivities;
+  // cartesian emissivity grid in kpc
+  grids::cartesian_grid_3d emissivity_grid;
+};
+
+// the HDF5 library isn't thread safe, so concurrent requests only compute in
+// parallel but write their output files one after another
+std::mutex hdf5_mutex;
+
+/**
+ * @param request assignments "name = value" separated by ';'
+ * @return values[name]
+ * @throws std::invalid_argument if an assignment is malformed
+ */
+std::map<std::string, std::string> parse_request(const std::string &request) {
+  std::regex regex("^ *([A-Za-z0-9_]+) *= *(.*?) *$");
+  std::map<std::string, std::string> values;
+  std::istringstream stream(request);
+  std::string assignment;
+  while (std::getline(stream, assignment, ';')) {
+    if (assignment.find_first_not_of(' ') == std::string::npos) {
+      continue;
+    }
+    std::smatch match;
+    if (!std::regex_match(assignment, match, regex)) {
+      throw std::invalid_argument("malformed assignment '" + assignment +
+                                  "'. Expected 'name = value'.");
+    }
+    values[match[1]] = match[2];
+  }
+  return values;
+}
+
+/**
+ * Removes a value from the values of a request.
+ * @return the value (unset if the request doesn't contain it)
+ */
+std::optional<std::string>
+take_value(std::map<std::string, std::string> &values,
+           const std::string &name) {
+  auto value = values.find(name);
+  if (value == values.end()) {
+    return std::nullopt;
+  }
+  auto string = value->second;
+  values.erase(value);
+  return string;
+}
+
+/**
+ * Rejects a request before the computation if its output file can't be
+ * created.
+ * @throws std::invalid_argument if the file already exists or its directory
+ *                               doesn't exist
+ */
+void check_output_file(const std::string &output_file_path) {
+  if (std::filesystem::exists(output_file_path)) {
+    throw std::invalid_argument("The output file '" + output_file_path +
+                                "' already exists.");
+  }
+  auto directory = std::filesystem::path(output_file_path).parent_path();
+  if (!directory.empty() && !std::filesystem::is_directory(directory)) {
+    throw std::invalid_argument("The directory of the output file '" +
+                                output_file_path + "' doesn't exist.");
+  }
+}
+
+/**
+ * Computes the skies of a single request and saves them like gamma_sky.
+ * @return response "ok <output file> <compute time in s>" or
+ *         "error <message>"
+ */
+std::string answer_request(const std::string &request,
+                           const std::string &parameter_file_path,
+                           const InputData &input) {
+  auto start = std::chrono::steady_clock::now();
+  try {
+    auto values = parse_request(request);
+    auto output_file_path = take_value(values, "output_file");
+    if (!output_file_path) {
+      throw std::invalid_argument("The request doesn't contain output_file.");
+    }
+    check_output_file(*output_file_path);
+    auto pixel_range = take_value(values, "pixel_range");
+    auto energy_indices = take_value(values, "energy_indices");
+
+    // the remaining values replace the ones of the parameter file
+    ParameterFile parameter_file(parameter_file_path, values);
+    auto parameters = parameter_file.get_parameters();
+    if (pixel_range) {
+      parameters.pixel_range = shards::parse_pixel_range(*pixel_range);
+    }
+    if (energy_indices) {
+      parameters.energy_indices = shards::parse_energy_indices(*energy_indices);
+    }
+    runs::check_parameters(parameters, pixel_range || energy_indices);
+    runs::check_in_memory_outputs(parameters, "gamma_sky_server");
+
+    // compute gamma skies
+    Sky sky(input.energies, input.emissivities, input.emissivity_grid,
+            parameters);
+    if (parameters.use_projection_operator) {
+      sky.use_projection_operator(sky.make_projection_operator());
+    }
+    tensors::tensor_2d skies;
+    tensors::tensor_2d requested_energy_skies;
+    if (parameters.compute_energy_skies) {
+      skies = sky.compute_gamma_skies();
+      if (!sky.get_requested_energies().empty()) {
+        requested_energy_skies = sky.interpolate_requested_skies(skies);
+      }
+    }
+    bool has_band_skies = runs::has_band_skies(parameters);
+    tensors::tensor_2d band_skies;
+    if (has_band_skies) {
+      band_skies = sky.compute_gamma_band_skies();
+    }
+
+    // save gamma skies
+    {
+      std::lock_guard<std::mutex> lock(hdf5_mutex);
+      check_output_file(*output_file_path);
+      try {
+        HDF5File output_file(*output_file_path, 'w');
+        if (parameters.compute_energy_skies) {
+          output_file.save_skies(skies);
+        }
+        if (!requested_energy_skies.empty()) {
+          output_file.save_requested_energy_skies(requested_energy_skies);
+        }
+        if (has_band_skies) {
+          output_file.save_band_skies(band_skies, parameters.energy_bands);
+        }
+        runs::save_metadata(output_file, sky, parameters, input.energies);
+        runs::save_error_bounds(output_file, parameters,
+                                sky.get_energy_decomposition_errors(),
+                                sky.get_skipping_error_bound());
+      } catch (std::exception &) {
+        // a partial output file would block a retry of the request
+        std::error_code error;
+        std::filesystem::remove(*output_file_path, error);
+        throw;
+      }
+    }
+
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    std::ostringstream response;
+    response << "ok " << *output_file_path << ' ' << duration.count();
+    return response.str();
+  } catch (std::exception &exception) {
+    // invalid requests as well as failures of the computation or of the
+    // output file must not terminate the server
+    return std::string("error ") + exception.what();
+  }
+}
+
+/**
+ * Answers the requests of stdin line by line until the end of the input or the
+ * request "quit".
+ */
+void serve(FILE *requests, FILE *responses,
+           const std::string &parameter_file_path, const InputData &input) {
+  char *line = nullptr;
+  size_t capacity{};
+  ssize_t length;
+  while ((length = getline(&line, &capacity, requests)) != -1) {
+    std::string request(line, length);
+    request.erase(request.find_last_not_of("\r\n") + 1);
+    if (request.empty()) {
+      continue;
+    }
+    if (request == "quit") {
+      break;
+    }
+    auto response = answer_request(request, parameter_file_path, input);
+    if (std::fprintf(responses, "%s\n", response.c_str()) < 0 ||
+        std::fflush(responses) != 0) {
+      std::cerr << "gamma_sky_server: couldn't write a response: "
+                << std::strerror(errno) << '\n';
+      break;
+    }
+  }
+  std::free(line);
+}
+
+/**
+ * Sends a response line to a client.
+ * @return false if the client has disconnected
+ */
+bool send_response(int client, const std::string &response) {
+  auto line = response + '\n';
+  size_t sent{};
+  while (sent != line.size()) {
+    // MSG_NOSIGNAL: a disconnected client must not raise SIGPIPE
+    auto count =
+        send(client, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      return false;
+    }
+    sent += static_cast<size_t>(count);
+  }
+  return true;
+}
+
+// write end of the pipe that wakes up the poll loop of serve_socket
+int wake_up_pipe = -1;
+volatile std::sig_atomic_t stop_requested = 0;
+
+void request_stop(int) {
+  stop_requested = 1;
+  // write is async-signal-safe, its result doesn't matter
+  [[maybe_unused]] auto result = write(wake_up_pipe, "s", 1);
+}
+
+/**
+ * Client of the socket, which has at most one request in flight, such that
+ * its responses keep the order of its requests.
+ */
+struct Client {
+  // received characters that don't form a complete request yet
+  std::string buffer;
+  // true while a request of the client is computed
+  bool busy{};
+  // true after the client has closed its side of the connection
+  bool end_of_input{};
+};
+
+/**
+ * Accepts clients on a Unix domain socket until SIGINT or SIGTERM. A single
+ * thread receives the requests of all clients, which are computed as tasks
+ * of a shared TBB arena, such that concurrent requests share (and are bounded
+ * by) its worker threads. At the stop, the server waits for the requests in
+ * flight and removes the socket.
+ */
+void serve_socket(const std::string &socket_path,
+                  const std::string &parameter_file_path,
+                  const InputData &input) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::invalid_argument("The socket path '" + socket_path +
+                                "' is too long.");
+  }
+  std::strncpy(address.sun_path, socket_path.c_str(),
+               sizeof(address.sun_path) - 1);
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0 ||
+      bind(server, reinterpret_cast<sockaddr *>(&address), sizeof(address)) <
+          0 ||
+      listen(server, SOMAXCONN) < 0) {
+    throw std::runtime_error(
+        "Couldn't listen on the socket '" + socket_path +
+        "': " + std::strerror(errno) +
+        ". If a previous server has been killed, please delete the socket "
+        "file.");
+  }
+  int wake_up[2];
+  if (pipe(wake_up) < 0) {
+    throw std::runtime_error(std::string("Couldn't create a pipe: ") +
+                             std::strerror(errno));
+  }
+  wake_up_pipe = wake_up[1];
+  struct sigaction action {};
+  action.sa_handler = request_stop;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  std::cerr << "gamma_sky_server: listening on " << socket_path << '\n';
+
+  tbb::task_arena arena;
+  std::map<int, Client> clients;
+  // clients whose request has been answered (false: client disconnected)
+  std::vector<std::pair<int, bool>> finished_clients;
+  size_t requests_in_flight{};
+  std::mutex finished_mutex;
+  std::condition_variable finished_condition;
+
+  auto close_client = [&](int client) {
+    close(client);
+    clients.erase(client);
+  };
+  // starts the next complete request of a client that isn't busy
+  auto dispatch = [&](int client) {
+    auto &state = clients.at(client);
+    size_t end;
+    while (!state.busy &&
+           (end = state.buffer.find('\n')) != std::string::npos) {
+      auto request = state.buffer.substr(0, end);
+      state.buffer.erase(0, end + 1);
+      request.erase(request.find_last_not_of('\r') + 1);
+      if (request.empty()) {
+        continue;
+      }
+      if (request == "quit") {
+        close_client(client);
+        return;
+      }
+      state.busy = true;
+      {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        ++requests_in_flight;
+      }
+      // enqueued tasks run even if the arena has no worker threads besides
+      // the calling one
+      arena.enqueue([&, client, request]() {
+        auto response = answer_request(request, parameter_file_path, input);
+        bool is_connected = send_response(client, response);
+        {
+          std::lock_guard<std::mutex> lock(finished_mutex);
+          finished_clients.emplace_back(client, is_connected);
+          --requests_in_flight;
+        }
+        finished_condition.notify_all();
+        [[maybe_unused]] auto result = write(wake_up_pipe, "f", 1);
+      });
+    }
+    if (!state.busy && state.end_of_input) {
+      close_client(client);
+    }
+  };
+
+  while (!stop_requested) {
+    std::vector<pollfd> descriptors{{server, POLLIN, 0},
+                                    {wake_up[0], POLLIN, 0}};
+    for (const auto &[client, state] : clients) {
+      if (!state.busy && !state.end_of_input) {
+        descriptors.push_back({client, POLLIN, 0});
+      }
+    }
+    if (poll(descriptors.data(), descriptors.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error(std::string("Couldn't poll the clients: ") +
+                               std::strerror(errno));
+    }
+    if (descriptors[1].revents & POLLIN) {
+      char bytes[64];
+      [[maybe_unused]] auto result = read(wake_up[0], bytes, sizeof(bytes));
+      std::vector<std::pair<int, bool>> finished;
+      {
+        std::lock_guard<std::mutex> lock(finished_mutex);
+        finished.swap(finished_clients);
+      }
+      for (auto [client, is_connected] : finished) {
+        clients.at(client).busy = false;
+        if (is_connected) {
+          dispatch(client);
+        } else {
+          close_client(client);
+        }
+      }
+    }
+    if (descriptors[0].revents & POLLIN) {
+      int client = accept(server, nullptr, nullptr);
+      if (client >= 0) {
+        clients[client];
+      }
+    }
+    for (size_t i{2}; i != descriptors.size(); ++i) {
+      if (!descriptors[i].revents) {
+        continue;
+      }
+      int client = descriptors[i].fd;
+      char bytes[4096];
+      auto count = read(client, bytes, sizeof(bytes));
+      if (count < 0 && errno == EINTR) {
+        continue;
+      }
+      auto &state = clients.at(client);
+      if (count > 0) {
+        state.buffer.append(bytes, static_cast<size_t>(count));
+      } else {
+        // the last request may lack its line break
+        state.end_of_input = true;
+        if (!state.buffer.empty()) {
+          state.buffer += '\n';
+        }
+      }
+      dispatch(client);
+    }
+  }
+
+  std::cerr << "gamma_sky_server: stopping after the requests in flight\n";
+  close(server);
+  std::filesystem::remove(socket_path);
+  {
+    std::unique_lock<std::mutex> lock(finished_mutex);
+    finished_condition.wait(lock, [&] { return requests_in_flight == 0; });
+  }
+  for (const auto &client : clients) {
+    close(client.first);
+  }
+  close(wake_up[0]);
+  close(wake_up[1]);
+}
+
+int run(int argc, char *argv[]) {
+  std::string usage =
+      "usage: gamma_sky_server <parameter file> <input H5 file>\n"
+      "                        [--socket <socket path>]\n"
+      "\n"
+      "Loads the emissivities once and answers sky requests from stdin (or\n"
+      "from the clients of a Unix domain socket). A request is a single line\n"
+      "of assignments separated by ';', e.g.,\n"
+      "\n"
+      "  output_file = sky.h5; healpix_order = 6; x_observer_location_in_kpc "
+      "= 8\n"
+      "\n"
+      "output_file is required, pixel_range and energy_indices select a\n"
+      "shard like --pixels and --energies of gamma_sky and all other values\n"
+      "replace the ones of the parameter file. Each request is answered by\n"
+      "the line 'ok <output file> <seconds>' or 'error <message>'.";
+  if (argc != 3 && !(argc == 5 && std::string(argv[3]) == "--socket")) {
+    std::cerr << usage << std::endl;
+    std::exit(1);
+  }
+
+  // get arguments
+  std::string parameter_file_path(argv[1]);
+  std::string input_file_path(argv[2]);
+
+  // a client that disconnects before its response must not terminate the
+  // server, the failed write is handled instead
+  std::signal(SIGPIPE, SIG_IGN);
+
+  // load the input data once
+  InputData input;
+  {
+    HDF5File input_file(input_file_path, 'r');
+    input.energies = input_file.read_energies();
+    input.emissivities = input_file.read_emissivities();
+    input.emissivity_grid = input_file.read_emissivity_grid();
+  }
+
+  if (argc == 5) {
+    serve_socket(argv[4], parameter_file_path, input);
+  } else {
+    serve(stdin, stdout, parameter_file_path, input);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    return run(argc, argv);
+  } catch (std::exception &exception) {
+    std::cerr << "error: " << exception.what() << '\n';
+    std::exit(1);
+  }
+}
@@ -0,0 +1,199 @@
+// Author: Stefan Lepperdinger
+#include "HDF5File.h"
+#include "ParameterFile.h"
+#include "Sky.h"
+#include "runs.h"
+#include "tensors.h"
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <mutex>
+
+/**
+ * Input data of a single snapshot.
+ */
+struct InputData {
+  // energies of the emissivities in MeV
+  std::vector<double> energies;
+  // emissivities[energy][x][y][z] in MeV / (s sr cm³)
+  tensors::tensor_4d emissivities;
+  // cartesian emissivity grid in kpc
+  grids::cartesian_grid_3d emissivity_grid;
+};
+
+/**
+ * Skies of a single snapshot that wait to be saved.
+ */
+struct OutputData {
+  std::string output_file_path;
+  // skies[selected energy][pixel] in MeV / (s sr cm²)
+  tensors::tensor_2d skies;
+  // skies[requested energy][pixel] in MeV / (s sr cm²)
+  tensors::tensor_2d requested_energy_skies;
+  // skies[band][pixel] in MeV / (s sr cm²)
+  tensors::tensor_2d band_skies;
+  std::vector<double> energy_decomposition_errors;
+  double skipping_error_bound{};
+};
+
+// the HDF5 library isn't thread safe, so the snapshots are read and written
+// one after another (but both overlap with the computation)
+std::mutex hdf5_mutex;
+
+InputData read_snapshot(const std::string &input_file_path) {
+  std::lock_guard<std::mutex> lock(hdf5_mutex);
+  HDF5File input_file(input_file_path, 'r');
+  InputData input;
+  input.energies = input_file.read_energies();
+  input.emissivities = input_file.read_emissivities();
+  input.emissivity_grid = input_file.read_emissivity_grid();
+  return input;
+}
+
+/**
+ * Checks that a snapshot has the grid and energies of the first snapshot,
+ * such that the geometry of the sky can be reused.
+ */
+void check_snapshot(const InputData &snapshot, const InputData &first,
+                    const std::string &input_file_path) {
+  const auto &grid = snapshot.emissivity_grid;
+  const auto &first_grid = first.emissivity_grid;
+  // both grids were stored in single precision, so they compare exactly
+  if (grid.x_centers != first_grid.x_centers ||
+      grid.y_centers != first_grid.y_centers ||
+      grid.z_centers != first_grid.z_centers ||
+      snapshot.energies != first.energies) {
+    std::cerr << "error: The input file '" << input_file_path
+              << "' has a different grid or different energies than the "
+                 "first input file.\n";
+    std::exit(1);
+  }
+}
+
+void save_snapshot(const OutputData &output,
+                   const ParameterFile::Parameters &parameters,
+                   const std::vector<double> &energies, const Sky &sky) {
+  std::lock_guard<std::mutex> lock(hdf5_mutex);
+  HDF5File output_file(output.output_file_path, 'w');
+  if (parameters.compute_energy_skies) {
+    output_file.save_skies(output.skies);
+  }
+  if (!output.requested_energy_skies.empty()) {
+    output_file.save_requested_energy_skies(output.requested_energy_skies);
+  }
+  if (!parameters.energy_bands.empty()) {
+    output_file.save_band_skies(output.band_skies, parameters.energy_bands);
+  }
+  runs::save_metadata(output_file, sky, parameters, energies);
+  runs::save_error_bounds(output_file, parameters,
+                          output.energy_decomposition_errors,
+                          output.skipping_error_bound);
+}
+
+/**
+ * Runs gamma_sky_snapshots.
+ * @throws std::invalid_argument if the parameters are invalid
+ */
+int run(int argc, char *argv[]) {
+  std::string usage =
+      "usage: gamma_sky_snapshots <parameter file> <output directory>\n"
+      "                           <input H5 file> [<input H5 file> ...]\n"
+      "\n"
+      "Computes the skies of several PICARD outputs with identical grids and\n"
+      "energies (e.g., the snapshots of a time series) like gamma_sky. The\n"
+      "skies of an input file are saved in the output directory under the\n"
+      "name of the input file. The next input file is read and the previous\n"
+      "output file is written while the skies of the current input file are\n"
+      "computed.";
+  if (argc < 4) {
+    std::cerr << usage << std::endl;
+    std::exit(1);
+  }
+
+  // get arguments
+  std::string parameter_file_path(argv[1]);
+  std::filesystem::path output_directory(argv[2]);
+  std::vector<std::string> input_file_paths(argv + 3, argv + argc);
+  std::vector<std::string> output_file_paths;
+  for (const auto &input_file_path : input_file_paths) {
+    auto output_file_path =
+        output_directory / std::filesystem::path(input_file_path).filename();
+    if (std::filesystem::exists(output_file_path)) {
+      std::cerr << "error: The output file '" << output_file_path.string()
+                << "' already exists.\n";
+      std::exit(1);
+    }
+    output_file_paths.push_back(output_file_path.string());
+  }
+  std::filesystem::create_directories(output_directory);
+  ParameterFile parameter_file(parameter_file_path);
+  auto parameters = parameter_file.get_parameters();
+  runs::check_parameters(parameters, false);
+  runs::check_in_memory_outputs(parameters, "gamma_sky_snapshots");
+
+  // the sky is set up once with the first snapshot; the emissivities of the
+  // later snapshots are swapped into the same input data
+  InputData input = read_snapshot(input_file_paths.front());
+  Sky sky(input.energies, input.emissivities, input.emissivity_grid,
+          parameters);
+  sky.store_pixel_directions();
+  if (parameters.use_projection_operator) {
+    sky.use_projection_operator(sky.make_projection_operator());
+  }
+
+  std::future<InputData> next_input;
+  std::future<void> previous_output;
+  for (size_t snapshot{}; snapshot != input_file_paths.size(); ++snapshot) {
+    auto start = std::chrono::steady_clock::now();
+    if (snapshot > 0) {
+      auto snapshot_input = next_input.get();
+      check_snapshot(snapshot_input, input, input_file_paths[snapshot]);
+      input.emissivities.swap(snapshot_input.emissivities);
+    }
+    if (snapshot + 1 != input_file_paths.size()) {
+      next_input = std::async(std::launch::async, read_snapshot,
+                              input_file_paths[snapshot + 1]);
+    }
+
+    OutputData output;
+    output.output_file_path = output_file_paths[snapshot];
+    if (parameters.compute_energy_skies) {
+      output.skies = sky.compute_gamma_skies();
+      if (!sky.get_requested_energies().empty()) {
+        output.requested_energy_skies =
+            sky.interpolate_requested_skies(output.skies);
+      }
+    }
+    if (!parameters.energy_bands.empty()) {
+      output.band_skies = sky.compute_gamma_band_skies();
+    }
+    output.energy_decomposition_errors = sky.get_energy_decomposition_errors();
+    // bounds the skies of all snapshots so far
+    output.skipping_error_bound = sky.get_skipping_error_bound();
+
+    if (previous_output.valid()) {
+      previous_output.get();
+    }
+    previous_output =
+        std::async(std::launch::async, [&parameters, &input, &sky,
+                                        output = std::move(output)] {
+          save_snapshot(output, parameters, input.energies, sky);
+        });
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    std::cout << input_file_paths[snapshot] << ": computed in "
+              << duration.count() << " s" << std::endl;
+  }
+  previous_output.get();
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    return run(argc, argv);
+  } catch (std::exception &exception) {
+    std::cerr << "error: " << exception.what() << '\n';
+    std::exit(1);
+  }
+}
@@ -0,0 +1,132 @@
+// Author: Stefan Lepperdinger
+#include "HDF5File.h"
+#include "ParameterFile.h"
+#include "shards.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void exit_with_error(const std::string &message) {
+  std::cerr << "error: " << message << '\n';
+  std::exit(1);
+}
+
+int run(int argc, char *argv[]) {
+  std::string usage = "usage: merge_gamma_sky_shards <output H5 file> "
+                      "<shard H5 file> [<shard H5 file> ...]";
+  if (argc < 3) {
+    std::cerr << usage << std::endl;
+    std::exit(1);
+  }
+
+  // get arguments
+  std::string output_file_path(argv[1]);
+  std::vector<std::string> shard_file_paths(argv + 2, argv + argc);
+
+  // read the metadata of the first shard as reference
+  ParameterFile::Parameters parameters{};
+  std::vector<double> energies;
+  {
+    HDF5File shard_file(shard_file_paths.front(), 'r');
+    parameters = shard_file.read_parameters();
+    energies = shard_file.read_energies_dataset();
+  }
+  size_t number_of_energies = energies.size();
+  size_t number_of_pixels = size_t{12} << (2 * parameters.healpix_order);
+
+  // validate the metadata of all shards
+  std::vector<shards::shard_specification> sky_shards;
+  std::vector<shards::shard_specification> band_sky_shards;
+  std::vector<std::array<double, 2>> bands;
+  for (const auto &shard_file_path : shard_file_paths) {
+    HDF5File shard_file(shard_file_path, 'r');
+    auto shard_parameters = shard_file.read_parameters();
+    if (!shard_parameters.has_same_geometry(parameters) ||
+        !shard_parameters.has_same_approximations(parameters) ||
+        shard_file.read_energies_dataset() != energies) {
+      exit_with_error("The shard '" + shard_file_path +
+                      "' was computed with different parameters or energies "
+                      "than the shard '" + shard_file_paths.front() + "'.");
+    }
+    auto completed_skies = shard_file.read_completed_skies();
+    auto completed_band_skies = shard_file.read_completed_band_skies();
+    if (std::count(completed_skies.cbegin(), completed_skies.cend(), false) ||
+        std::count(completed_band_skies.cbegin(), completed_band_skies.cend(),
+                   false)) {
+      exit_with_error("The shard '" + shard_file_path +
+                      "' is incomplete. Please finish it via gamma_sky "
+                      "--resume.");
+    }
+    auto shard = shard_file.read_shard_specification(number_of_pixels,
+                                                     number_of_energies);
+    if (shard_file.has_dataset("gamma ray skies")) {
+      sky_shards.push_back(shard);
+    }
+    if (shard_file.has_dataset("gamma ray band skies")) {
+      auto shard_bands = shard_file.read_band_edges();
+      if (!band_sky_shards.empty() && shard_bands != bands) {
+        exit_with_error("The shard '" + shard_file_path +
+                        "' contains different energy bands.");
+      }
+      bands = shard_bands;
+      // the band skies only depend on the pixel range
+      band_sky_shards.push_back({shard.pixel_range, {0}});
+    }
+  }
+  std::string problem;
+  if (!sky_shards.empty() && !shards::is_partition(sky_shards,
+                                                   number_of_energies,
+                                                   number_of_pixels, problem)) {
+    exit_with_error("The shards don't cover the skies exactly once: " +
+                    problem + ".");
+  }
+  if (!band_sky_shards.empty() &&
+      !shards::is_partition(band_sky_shards, 1, number_of_pixels, problem)) {
+    exit_with_error("The shards don't cover the energy band skies exactly "
+                    "once: " + problem + ".");
+  }
+  if (sky_shards.empty() && band_sky_shards.empty()) {
+    exit_with_error("The shards don't contain any skies.");
+  }
+
+  // assemble the shards
+  HDF5File output_file(output_file_path, 'w');
+  if (!sky_shards.empty()) {
+    output_file.create_skies(number_of_energies, number_of_pixels);
+  }
+  if (!band_sky_shards.empty()) {
+    output_file.create_band_skies(bands, number_of_pixels);
+  }
+  for (const auto &shard_file_path : shard_file_paths) {
+    HDF5File shard_file(shard_file_path, 'r');
+    auto shard = shard_file.read_shard_specification(number_of_pixels,
+                                                     number_of_energies);
+    if (shard_file.has_dataset("gamma ray skies")) {
+      auto skies = shard_file.read_skies();
+      for (size_t i{}; i != skies.size(); ++i) {
+        output_file.write_sky(shard.energy_indices[i], shard.pixel_range[0],
+                              skies[i]);
+      }
+    }
+    if (shard_file.has_dataset("gamma ray band skies")) {
+      auto band_skies = shard_file.read_band_skies();
+      for (size_t band{}; band != band_skies.size(); ++band) {
+        output_file.write_band_sky(band, shard.pixel_range[0],
+                                   band_skies[band]);
+      }
+    }
+  }
+  output_file.save_energies(energies);
+  output_file.save_parameters(parameters);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  try {
+    return run(argc, argv);
+  } catch (std::exception &exception) {
+    exit_with_error(exception.what());
+  }
+}
@@ -0,0 +1,175 @@
+// Author: Stefan Lepperdinger
+#include "CompressedVolume.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace {
+
+// the log16 magnitudes cover at most the interval [e^-80, 1] of the
+// normalized values, which stays within the normal single precision range
+constexpr double maximum_log_range = 80.;
+constexpr size_t number_of_magnitudes = 0x8000;
+
+} // namespace
+
+CompressedVolume::encoding
+CompressedVolume::parse_encoding(const std::string &name) {
+  if (name == "none") {
+    return encoding::none;
+  }
+  if (name == "fp16") {
+    return encoding::fp16;
+  }
+  if (name == "bfloat16") {
+    return encoding::bfloat16;
+  }
+  if (name == "log16") {
+    return encoding::log16;
+  }
+  throw std::invalid_argument(
+      "Unknown volume compression '" + name +
+      "'. Please set the parameter volume_compression in the parameter file "
+      "to 'none', 'fp16', 'bfloat16' or 'log16'.");
+}
+
+std::string CompressedVolume::get_encoding_name(encoding value_encoding) {
+  switch (value_encoding) {
+  case encoding::fp16:
+    return "fp16";
+  case encoding::bfloat16:
+    return "bfloat16";
+  case encoding::log16:
+    return "log16";
+  default:
+    return "none";
+  }
+}
+
+std::uint16_t CompressedVolume::encode_fp16(float value) {
+#ifdef __F16C__
+  return _cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  auto sign = static_cast<std::uint16_t>((bits >> 16) & 0x8000u);
+  bits &= 0x7fffffffu;
+  if (bits < 0x38800000u) {
+    // below 2^-14: subnormal multiples of 2^-24 (rounded to nearest even)
+    auto magnitude = static_cast<std::uint16_t>(
+        std::nearbyint(std::abs(value) * 16777216.f));
+    return sign | magnitude;
+  }
+  // rebias the exponent and round the mantissa to nearest even (a carry
+  // correctly increments the exponent); the normalized values are at most 1
+  std::uint32_t rounded = bits + 0xfffu + ((bits >> 13) & 1u);
+  return sign | static_cast<std::uint16_t>((rounded - 0x38000000u) >> 13);
+#endif
+}
+
+std::uint16_t CompressedVolume::encode_bfloat16(float value) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  // round to nearest even
+  bits += 0x7fffu + ((bits >> 16) & 1u);
+  return static_cast<std::uint16_t>(bits >> 16);
+}
+
+CompressedVolume::CompressedVolume(const tensors::tensor_3d &values,
+                                   encoding value_encoding)
+    : value_encoding(value_encoding),
+      dimensions{values.size(), values[0].size(), values[0][0].size()} {
+  if (value_encoding == encoding::none) {
+    throw std::invalid_argument("A compressed volume needs an encoding.");
+  }
+  double maximum{};
+  double minimum = std::numeric_limits<double>::infinity();
+  for (const auto &plane : values) {
+    for (const auto &row : plane) {
+      for (double value : row) {
+        double magnitude = std::abs(value);
+        maximum = std::max(maximum, magnitude);
+        if (magnitude > 0.) {
+          minimum = std::min(minimum, magnitude);
+        }
+      }
+    }
+  }
+  if (maximum > 0.) {
+    scale = maximum;
+  }
+  if (value_encoding == encoding::log16) {
+    // magnitudes[m] = e^(-log_range + (m - 1) step) for m ≥ 1
+    double log_range =
+        maximum > 0. ? std::min(std::log(maximum / minimum), maximum_log_range)
+                     : 0.;
+    log_step = log_range / static_cast<double>(number_of_magnitudes - 2);
+    log_minimum = -log_range;
+    magnitudes.resize(number_of_magnitudes);
+    for (size_t m{1}; m != number_of_magnitudes; ++m) {
+      magnitudes[m] = static_cast<float>(
+          std::exp(log_minimum + static_cast<double>(m - 1) * log_step));
+    }
+  }
+
+  codes.resize(dimensions[0] * dimensions[1] * dimensions[2]);
+  std::vector<double> plane_errors(dimensions[0]);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, dimensions[0]),
+      [&](const tbb::blocked_range<size_t> &range) {
+        for (size_t x = range.begin(); x != range.end(); ++x) {
+          size_t index = x * dimensions[1] * dimensions[2];
+          for (size_t y{}; y != dimensions[1]; ++y) {
+            for (size_t z{}; z != dimensions[2]; ++z, ++index) {
+              double normalized_value = values[x][y][z] / scale;
+              auto single = static_cast<float>(normalized_value);
+              switch (value_encoding) {
+              case encoding::fp16:
+                codes[index] = encode_fp16(single);
+                break;
+              case encoding::bfloat16:
+                codes[index] = encode_bfloat16(single);
+                break;
+              default:
+                codes[index] = encode_log16(normalized_value);
+              }
+              plane_errors[x] = std::max(
+                  plane_errors[x],
+                  std::abs((*this)(x, y, z) / scale - normalized_value));
+            }
+          }
+        }
+      });
+  maximum_relative_error =
+      *std::max_element(plane_errors.cbegin(), plane_errors.cend());
+}
+
+std::uint16_t CompressedVolume::encode_log16(double normalized_value) const {
+  double magnitude = std::abs(normalized_value);
+  auto sign = static_cast<std::uint16_t>(normalized_value < 0. ? 0x8000u : 0u);
+  if (magnitude == 0. ||
+      std::log(magnitude) < log_minimum - .5 * log_step) {
+    return 0;
+  }
+  double m = 1.;
+  if (log_step > 0.) {
+    m += std::round((std::log(magnitude) - log_minimum) / log_step);
+  }
+  m = std::clamp(m, 1., static_cast<double>(number_of_magnitudes - 1));
+  return sign | static_cast<std::uint16_t>(m);
+}
+
+double CompressedVolume::operator()(size_t x, size_t y, size_t z) const {
+  auto code = codes[(x * dimensions[1] + y) * dimensions[2] + z];
+  switch (value_encoding) {
+  case encoding::fp16:
+    return scale * decode_fp16(code);
+  case encoding::bfloat16:
+    return scale * decode_bfloat16(code);
+  default:
+    return scale * decode_log16(code);
+  }
+}
@@ -0,0 +1,206 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_COMPRESSEDVOLUME_H
+#define GAMMA_SKY_SRC_COMPRESSEDVOLUME_H
+
+#include "TrilinearInterpolation.h"
+#include "tensors.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+using std::size_t;
+
+/**
+ * Volume stored with 16 bits per value in a flat array, which quarters the
+ * memory traffic of the interpolation compared to double precision.
+ *
+ * The values are divided by the maximum absolute value of the volume and
+ * stored as
+ * - fp16: IEEE half precision (relative error ≤ 2^-11 for normalized values
+ *   above 2^-14, absolute error ≤ 2^-25 below),
+ * - bfloat16: single precision rounded to 8 significant bits (relative
+ *   error ≤ 2^-8),
+ * - log16: sign and 15 bit logarithm of the magnitude between the smallest
+ *   magnitude (at least max / e^80, smaller ones become 0) and the maximum
+ *   (relative error ≤ ln(max / min) / 32766 / 2, i.e., ≤ 0.13 %).
+ * The values are decoded within the interpolation kernel (for fp16, all 8
+ * corners of a cell by a single F16C conversion if the compiler targets
+ * it), so the interpolation reads 2 bytes per value.
+ */
+class CompressedVolume {
+public:
+  enum class encoding { none, fp16, bfloat16, log16 };
+
+  /**
+   * @param name "none", "fp16", "bfloat16" or "log16"
+   * @throws std::invalid_argument for other names
+   */
+  static encoding parse_encoding(const std::string &name);
+  /**
+   * @return name of the encoding as accepted by parse_encoding
+   */
+  static std::string get_encoding_name(encoding value_encoding);
+
+  /**
+   * @param values values[x][y][z] with at least 2 values along every axis
+   * @param value_encoding encoding of the values (not none)
+   */
+  CompressedVolume(const tensors::tensor_3d &values, encoding value_encoding);
+
+  /**
+   * @return largest difference of a decoded and its original value divided by
+   *         the maximum absolute value of the volume
+   */
+  [[nodiscard]] double get_maximum_relative_error() const {
+    return maximum_relative_error;
+  }
+  /**
+   * @return bytes of the codes (plus the magnitude table of log16), which is
+   *         all that the interpolation reads
+   */
+  [[nodiscard]] size_t get_number_of_bytes() const {
+    return codes.size() * sizeof(std::uint16_t) +
+           magnitudes.size() * sizeof(float);
+  }
+  /**
+   * @return decoded value at the grid point
+   */
+  [[nodiscard]] double operator()(size_t x, size_t y, size_t z) const;
+  /**
+   * Interpolates the volume like TrilinearInterpolation::interpolate.
+   * @param cell stencil of an interpolation on the grid of the volume
+   * @return interpolated value
+   */
+  [[nodiscard]] double
+  interpolate(const TrilinearInterpolation::stencil &cell) const {
+    return visit_interpolation(
+        [&cell](const auto &interpolate) { return interpolate(cell); });
+  }
+  /**
+   * Selects the decoder once for many interpolations, e.g., along a line of
+   * sight.
+   * @param body body(interpolate) with interpolate(stencil) returning the
+   *             interpolated value like interpolate
+   * @return value returned by the body
+   */
+  template <typename Body>
+  double visit_interpolation(const Body &body) const {
+    switch (value_encoding) {
+    case encoding::fp16:
+      return body([this](const TrilinearInterpolation::stencil &cell) {
+        return scale * interpolate_fp16(cell);
+      });
+    case encoding::bfloat16:
+      return body([this](const TrilinearInterpolation::stencil &cell) {
+        return scale * interpolate_codes(cell, decode_bfloat16);
+      });
+    default:
+      return body([this](const TrilinearInterpolation::stencil &cell) {
+        return scale * interpolate_codes(cell, [this](std::uint16_t code) {
+                 return decode_log16(code);
+               });
+      });
+    }
+  }
+
+  static std::uint16_t encode_fp16(float value);
+  static float decode_fp16(std::uint16_t code) {
+#ifdef __F16C__
+    return _cvtsh_ss(code);
+#else
+    std::uint32_t sign = static_cast<std::uint32_t>(code & 0x8000u) << 16;
+    std::uint32_t exponent = (code >> 10) & 0x1fu;
+    std::uint32_t mantissa = code & 0x3ffu;
+    if (exponent == 0) {
+      // zero or subnormal: mantissa × 2^-24
+      float magnitude = static_cast<float>(mantissa) * 5.9604645e-8f;
+      return sign ? -magnitude : magnitude;
+    }
+    // the normalized values are at most 1, so there are no infinities
+    std::uint32_t bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+#endif
+  }
+  static std::uint16_t encode_bfloat16(float value);
+  static float decode_bfloat16(std::uint16_t code) {
+    std::uint32_t bits = static_cast<std::uint32_t>(code) << 16;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+private:
+  [[nodiscard]] float decode_log16(std::uint16_t code) const {
+    float magnitude = magnitudes[code & 0x7fffu];
+    return (code & 0x8000u) ? -magnitude : magnitude;
+  }
+  [[nodiscard]] const std::uint16_t *
+  get_first_corner(const TrilinearInterpolation::stencil &cell) const {
+    return codes.data() + (cell.x * dimensions[1] + cell.y) * dimensions[2] +
+           cell.z;
+  }
+  template <typename Decode>
+  [[nodiscard]] double
+  interpolate_codes(const TrilinearInterpolation::stencil &cell,
+                    const Decode &decode) const {
+    const auto &w = cell.weights;
+    const std::uint16_t *corner = get_first_corner(cell);
+    size_t dx = dimensions[1] * dimensions[2];
+    size_t dy = dimensions[2];
+    return decode(corner[0]) * w[0] + decode(corner[dx]) * w[1] +
+           decode(corner[dy]) * w[2] + decode(corner[1]) * w[3] +
+           decode(corner[dx + 1]) * w[4] + decode(corner[dy + 1]) * w[5] +
+           decode(corner[dx + dy]) * w[6] + decode(corner[dx + dy + 1]) * w[7];
+  }
+  [[nodiscard]] double
+  interpolate_fp16(const TrilinearInterpolation::stencil &cell) const {
+#ifdef __F16C__
+    // the 8 corners are decoded by a single conversion instead of one per
+    // corner
+    const std::uint16_t *corner = get_first_corner(cell);
+    size_t dx = dimensions[1] * dimensions[2];
+    size_t dy = dimensions[2];
+    __m128i corner_codes = _mm_setr_epi16(
+        static_cast<short>(corner[0]), static_cast<short>(corner[dx]),
+        static_cast<short>(corner[dy]), static_cast<short>(corner[1]),
+        static_cast<short>(corner[dx + 1]), static_cast<short>(corner[dy + 1]),
+        static_cast<short>(corner[dx + dy]),
+        static_cast<short>(corner[dx + dy + 1]));
+    __m256 values = _mm256_cvtph_ps(corner_codes);
+    __m256d products = _mm256_add_pd(
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(values)),
+                      _mm256_loadu_pd(cell.weights.data())),
+        _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(values, 1)),
+                      _mm256_loadu_pd(cell.weights.data() + 4)));
+    __m128d sums = _mm_add_pd(_mm256_castpd256_pd128(products),
+                              _mm256_extractf128_pd(products, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sums, _mm_unpackhi_pd(sums, sums)));
+#else
+    return interpolate_codes(cell, decode_fp16);
+#endif
+  }
+  [[nodiscard]] std::uint16_t encode_log16(double normalized_value) const;
+
+  encoding value_encoding;
+  std::array<size_t, 3> dimensions{};
+  // maximum absolute value of the volume
+  double scale{1.};
+  // codes[(x * dimensions[1] + y) * dimensions[2] + z]
+  std::vector<std::uint16_t> codes;
+  // log16: magnitudes[code & 0x7fff] of the normalized values
+  std::vector<float> magnitudes;
+  // log16: logarithm of the smallest magnitude and of the magnitude ratio of
+  // consecutive codes
+  double log_minimum{};
+  double log_step{};
+  double maximum_relative_error{};
+};
+
+#endif // GAMMA_SKY_SRC_COMPRESSEDVOLUME_H
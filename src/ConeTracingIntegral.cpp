@@ -0,0 +1,69 @@
+// Author: Stefan Lepperdinger
+#include "ConeTracingIntegral.h"
+#include "mathematics.h"
+#include <algorithm>
+#include <cmath>
+
+ConeTracingIntegral::ConeTracingIntegral(double radial_step_size,
+                                         double pixel_size,
+                                         const grids::cartesian_grid_3d &grid,
+                                         const tensors::tensor_3d &values)
+    : radial_step_size(radial_step_size), pixel_size(pixel_size), grid(grid),
+      pyramid(grid, values) {
+  interpolations.reserve(pyramid.get_number_of_levels());
+  for (size_t level{}; level != pyramid.get_number_of_levels(); ++level) {
+    interpolations.emplace_back(pyramid.get_grid(level),
+                                pyramid.get_values(level));
+  }
+  // same extent as the radial cells of LineOfSightIntegral
+  double x_range = grid.x_centers.back() - grid.x_centers.front();
+  double y_range = grid.y_centers.back() - grid.y_centers.front();
+  double z_range = grid.z_centers.back() - grid.z_centers.front();
+  maximum_distance = mathematics::euclidean_norm({x_range, y_range, z_range});
+}
+
+double ConeTracingIntegral::interpolate(const std::array<double, 3> &location,
+                                        double width) const {
+  size_t last_level = interpolations.size() - 1;
+  if (width <= pyramid.get_cell_size(0)) {
+    return interpolations[0](location);
+  }
+  if (width >= pyramid.get_cell_size(last_level)) {
+    return interpolations[last_level](location);
+  }
+  size_t level{};
+  while (pyramid.get_cell_size(level + 1) < width) {
+    ++level;
+  }
+  double fine_cell_size = pyramid.get_cell_size(level);
+  double coarse_cell_size = pyramid.get_cell_size(level + 1);
+  double weight = std::log(width / fine_cell_size) /
+                  std::log(coarse_cell_size / fine_cell_size);
+  return (1. - weight) * interpolations[level](location) +
+         weight * interpolations[level + 1](location);
+}
+
+double
+ConeTracingIntegral::operator()(const std::array<double, 3> &direction) const {
+  double pc_to_m = 3.0856775814913673e16;
+  double kpc_to_cm = 1e3 * 1e2 * pc_to_m;
+
+  double sum{};
+  double radius{};
+  while (true) {
+    double step = std::max(radial_step_size, 0.5 * radius * pixel_size);
+    double center = radius + 0.5 * step;
+    if (center >= maximum_distance) {
+      break;
+    }
+    std::array<double, 3> location{center * direction[0],
+                                   center * direction[1],
+                                   center * direction[2]};
+    if (!grid.is_within_grid(location)) {
+      break;
+    }
+    sum += step * interpolate(location, center * pixel_size);
+    radius += step;
+  }
+  return kpc_to_cm * sum;
+}
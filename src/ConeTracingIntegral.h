@@ -0,0 +1,66 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_CONETRACINGINTEGRAL_H
+#define GAMMA_SKY_SRC_CONETRACINGINTEGRAL_H
+
+#include "EmissivityPyramid.h"
+#include "TrilinearInterpolation.h"
+#include "grids.h"
+#include "tensors.h"
+#include <array>
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Line of sight integral that averages the values over the cone of a sky
+ * pixel instead of sampling the finest grid along its central ray.
+ *
+ * At the distance r, the cone of a pixel with the angular size θ is about
+ * r θ wide. The values are interpolated on the levels of an EmissivityPyramid
+ * whose cell sizes enclose this width (blended linearly in the logarithm of
+ * the width), and the radial step grows to half the width. Close to the
+ * observer, where the cone is narrower than the grid spacing and the radial
+ * step size, the integral equals the one of LineOfSightIntegral, while far
+ * regions cost a few coarse samples.
+ */
+class ConeTracingIntegral {
+public:
+  /**
+   * @param radial_step_size minimum radial step size in kpc
+   * @param pixel_size angular size of a sky pixel in radian (square root of
+   *                   its solid angle)
+   * @param grid cartesian grid relative to the observer in kpc
+   * @param values values[x][y][z] at the cartesian grid points
+   */
+  ConeTracingIntegral(double radial_step_size, double pixel_size,
+                      const grids::cartesian_grid_3d &grid,
+                      const tensors::tensor_3d &values);
+  /**
+   * Evaluates the integral \int dr r² value / (4 pi r²) within the cone of a
+   * pixel.
+   * @param direction unit vector {x, y, z} of the center of the pixel
+   * @return integral
+   */
+  double operator()(const std::array<double, 3> &direction) const;
+
+private:
+  // minimum radial step size in kpc
+  double radial_step_size;
+  // angular size of a pixel in radian
+  double pixel_size;
+  // cartesian grid in kpc
+  const grids::cartesian_grid_3d &grid;
+  EmissivityPyramid pyramid;
+  // interpolations[level] of the pyramid
+  std::vector<TrilinearInterpolation> interpolations;
+  // the integration stops at this distance in kpc
+  double maximum_distance;
+
+  /**
+   * @return value averaged over the width at the location
+   */
+  [[nodiscard]] double interpolate(const std::array<double, 3> &location,
+                                   double width) const;
+};
+
+#endif // GAMMA_SKY_SRC_CONETRACINGINTEGRAL_H
@@ -0,0 +1,102 @@
+// Author: Stefan Lepperdinger
+#include "EmissivityPyramid.h"
+#include <algorithm>
+
+namespace {
+
+/**
+ * @return fine indices coarse_indices[i] = {first, last} that get averaged
+ *         into the coarse point i
+ */
+std::vector<std::array<size_t, 2>> make_coarse_indices(size_t number_of_points,
+                                                       bool halve) {
+  std::vector<std::array<size_t, 2>> coarse_indices;
+  size_t step = halve ? 2 : 1;
+  for (size_t i{}; i < number_of_points; i += step) {
+    coarse_indices.push_back({i, std::min(i + step, number_of_points) - 1});
+  }
+  return coarse_indices;
+}
+
+std::vector<double>
+make_coarse_centers(const std::vector<double> &centers,
+                    const std::vector<std::array<size_t, 2>> &coarse_indices) {
+  std::vector<double> coarse_centers;
+  coarse_centers.reserve(coarse_indices.size());
+  for (const auto &indices : coarse_indices) {
+    coarse_centers.push_back(0.5 * (centers[indices[0]] + centers[indices[1]]));
+  }
+  return coarse_centers;
+}
+
+} // namespace
+
+EmissivityPyramid::EmissivityPyramid(const grids::cartesian_grid_3d &grid,
+                                     const tensors::tensor_3d &values)
+    : values(values) {
+  grids::cartesian_grid_3d level_grid;
+  level_grid.x_centers = grid.x_centers;
+  level_grid.y_centers = grid.y_centers;
+  level_grid.z_centers = grid.z_centers;
+  grids.push_back(level_grid);
+  cell_sizes.push_back(compute_cell_size(level_grid));
+
+  while (true) {
+    const auto &fine_grid = grids.back();
+    const auto &fine_values = get_values(grids.size() - 1);
+    auto x_indices = make_coarse_indices(fine_grid.x_centers.size(),
+                                         fine_grid.x_centers.size() >= 4);
+    auto y_indices = make_coarse_indices(fine_grid.y_centers.size(),
+                                         fine_grid.y_centers.size() >= 4);
+    auto z_indices = make_coarse_indices(fine_grid.z_centers.size(),
+                                         fine_grid.z_centers.size() >= 4);
+    if (x_indices.size() == fine_grid.x_centers.size() &&
+        y_indices.size() == fine_grid.y_centers.size() &&
+        z_indices.size() == fine_grid.z_centers.size()) {
+      break;
+    }
+
+    grids::cartesian_grid_3d coarse_grid;
+    coarse_grid.x_centers = make_coarse_centers(fine_grid.x_centers, x_indices);
+    coarse_grid.y_centers = make_coarse_centers(fine_grid.y_centers, y_indices);
+    coarse_grid.z_centers = make_coarse_centers(fine_grid.z_centers, z_indices);
+
+    auto coarse = tensors::make_3d_tensor(
+        {x_indices.size(), y_indices.size(), z_indices.size()});
+    for (size_t x{}; x != x_indices.size(); ++x) {
+      for (size_t y{}; y != y_indices.size(); ++y) {
+        for (size_t z{}; z != z_indices.size(); ++z) {
+          double sum{};
+          size_t count{};
+          for (auto i = x_indices[x][0]; i <= x_indices[x][1]; ++i) {
+            for (auto j = y_indices[y][0]; j <= y_indices[y][1]; ++j) {
+              for (auto k = z_indices[z][0]; k <= z_indices[z][1]; ++k) {
+                sum += fine_values[i][j][k];
+                ++count;
+              }
+            }
+          }
+          coarse[x][y][z] = sum / static_cast<double>(count);
+        }
+      }
+    }
+
+    coarse_values.push_back(std::move(coarse));
+    cell_sizes.push_back(compute_cell_size(coarse_grid));
+    grids.push_back(std::move(coarse_grid));
+  }
+}
+
+double
+EmissivityPyramid::compute_cell_size(const grids::cartesian_grid_3d &grid) {
+  double cell_size{};
+  for (const auto *centers : {&grid.x_centers, &grid.y_centers,
+                              &grid.z_centers}) {
+    if (centers->size() > 1) {
+      cell_size = std::max(cell_size, (centers->back() - centers->front()) /
+                                          static_cast<double>(
+                                              centers->size() - 1));
+    }
+  }
+  return cell_size;
+}
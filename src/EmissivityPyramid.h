@@ -0,0 +1,58 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_EMISSIVITYPYRAMID_H
+#define GAMMA_SKY_SRC_EMISSIVITYPYRAMID_H
+
+#include "grids.h"
+#include "tensors.h"
+#include <vector>
+
+using std::size_t;
+
+/**
+ * 3D mip pyramid of a volume on a cartesian grid.
+ *
+ * Level 0 is the volume itself. Every coarser level halves each axis that
+ * still has at least 4 points by averaging pairs of neighbouring grid points
+ * (a box filter of the values and the grid centers), until no axis can be
+ * halved any more.
+ */
+class EmissivityPyramid {
+public:
+  /**
+   * @param grid cartesian grid (only the centers are used)
+   * @param values values[x][y][z] at the grid points (referenced as level 0)
+   */
+  EmissivityPyramid(const grids::cartesian_grid_3d &grid,
+                    const tensors::tensor_3d &values);
+
+  [[nodiscard]] size_t get_number_of_levels() const { return grids.size(); }
+  /**
+   * @return grid of the level (only the centers are set)
+   */
+  [[nodiscard]] const grids::cartesian_grid_3d &get_grid(size_t level) const {
+    return grids[level];
+  }
+  /**
+   * @return values[x][y][z] at the grid points of the level
+   */
+  [[nodiscard]] const tensors::tensor_3d &get_values(size_t level) const {
+    return level == 0 ? values : coarse_values[level - 1];
+  }
+  /**
+   * @return largest mean grid spacing of the axes of the level
+   */
+  [[nodiscard]] double get_cell_size(size_t level) const {
+    return cell_sizes[level];
+  }
+
+private:
+  const tensors::tensor_3d &values;
+  // values of the levels 1, 2, ...
+  std::vector<tensors::tensor_3d> coarse_values;
+  std::vector<grids::cartesian_grid_3d> grids;
+  std::vector<double> cell_sizes;
+
+  static double compute_cell_size(const grids::cartesian_grid_3d &grid);
+};
+
+#endif // GAMMA_SKY_SRC_EMISSIVITYPYRAMID_H
@@ -0,0 +1,123 @@
+// Author: Stefan Lepperdinger
+#include "EnergyDecomposition.h"
+#include "mathematics.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_reduce.h>
+
+EnergyDecomposition::EnergyDecomposition(const tensors::tensor_4d &emissivities,
+                                         size_t number_of_components) {
+  size_t number_of_energies = emissivities.size();
+  if (number_of_components == 0 || number_of_components > number_of_energies) {
+    throw std::invalid_argument(
+        "EnergyDecomposition: the number of components has to be within "
+        "[1, number of energies]");
+  }
+
+  // Gram matrix of the normalized volumes
+  auto gram_matrix = compute_gram_matrix(emissivities);
+  for (size_t energy{}; energy != number_of_energies; ++energy) {
+    norms.push_back(sqrt(gram_matrix[energy][energy]));
+  }
+  for (size_t i{}; i != number_of_energies; ++i) {
+    for (size_t j{}; j != number_of_energies; ++j) {
+      double norm_product = norms[i] * norms[j];
+      gram_matrix[i][j] =
+          norm_product > 0. ? gram_matrix[i][j] / norm_product : 0.;
+    }
+  }
+  auto eigensystem = mathematics::diagonalize_symmetric_matrix(gram_matrix);
+  const auto &eigenvalues = eigensystem.eigenvalues;
+  const auto &eigenvectors = eigensystem.eigenvectors;
+
+  // emissivities[energy] ≈ norms[energy] Σ_k eigenvectors[energy][k] basis[k]
+  // with basis[k] = Σ_energy eigenvectors[energy][k] emissivities[energy] /
+  // norms[energy]
+  coefficients =
+      tensors::make_2d_tensor({number_of_energies, number_of_components});
+  truncation_errors.assign(number_of_energies, 0.);
+  for (size_t energy{}; energy != number_of_energies; ++energy) {
+    if (norms[energy] == 0.) {
+      continue;
+    }
+    double captured_fraction{};
+    for (size_t k{}; k != number_of_components; ++k) {
+      coefficients[energy][k] = norms[energy] * eigenvectors[energy][k];
+      captured_fraction +=
+          eigenvalues[k] * mathematics::sqr(eigenvectors[energy][k]);
+    }
+    truncation_errors[energy] = sqrt(std::max(0., 1. - captured_fraction));
+  }
+
+  for (size_t k{}; k != number_of_components; ++k) {
+    std::vector<double> weights(number_of_energies);
+    for (size_t energy{}; energy != number_of_energies; ++energy) {
+      if (norms[energy] > 0.) {
+        weights[energy] = eigenvectors[energy][k] / norms[energy];
+      }
+    }
+    basis_volumes.push_back(tensors::linear_combination(emissivities, weights));
+  }
+}
+
+tensors::tensor_2d EnergyDecomposition::compute_gram_matrix(
+    const tensors::tensor_4d &emissivities) {
+  size_t number_of_energies = emissivities.size();
+  size_t x_dimension = emissivities.front().size();
+  size_t y_dimension = emissivities.front().front().size();
+  auto zero = tensors::make_2d_tensor({number_of_energies, number_of_energies});
+  auto gram_matrix = tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, x_dimension), zero,
+      [&](const tbb::blocked_range<size_t> &range, tensors::tensor_2d partial) {
+        for (size_t x = range.begin(); x != range.end(); ++x) {
+          for (size_t y{}; y != y_dimension; ++y) {
+            for (size_t i{}; i != number_of_energies; ++i) {
+              const auto &row_i = emissivities[i][x][y];
+              for (size_t j = i; j != number_of_energies; ++j) {
+                const auto &row_j = emissivities[j][x][y];
+                double product{};
+                for (size_t z{}; z != row_i.size(); ++z) {
+                  product += row_i[z] * row_j[z];
+                }
+                partial[i][j] += product;
+              }
+            }
+          }
+        }
+        return partial;
+      },
+      [&](tensors::tensor_2d a, const tensors::tensor_2d &b) {
+        for (size_t i{}; i != number_of_energies; ++i) {
+          for (size_t j{}; j != number_of_energies; ++j) {
+            a[i][j] += b[i][j];
+          }
+        }
+        return a;
+      });
+  for (size_t i{}; i != number_of_energies; ++i) {
+    for (size_t j{}; j != i; ++j) {
+      gram_matrix[i][j] = gram_matrix[j][i];
+    }
+  }
+  return gram_matrix;
+}
+
+tensors::tensor_2d EnergyDecomposition::reconstruct_skies(
+    const tensors::tensor_2d &basis_skies) const {
+  size_t number_of_energies = coefficients.size();
+  size_t number_of_pixels = basis_skies.front().size();
+  auto skies =
+      tensors::make_2d_tensor({number_of_energies, number_of_pixels});
+  for (size_t energy{}; energy != number_of_energies; ++energy) {
+    for (size_t k{}; k != basis_skies.size(); ++k) {
+      double coefficient = coefficients[energy][k];
+      const auto &basis_sky = basis_skies[k];
+      for (size_t pixel{}; pixel != number_of_pixels; ++pixel) {
+        skies[energy][pixel] += coefficient * basis_sky[pixel];
+      }
+    }
+  }
+  return skies;
+}
@@ -0,0 +1,72 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_ENERGYDECOMPOSITION_H
+#define GAMMA_SKY_SRC_ENERGYDECOMPOSITION_H
+
+#include "tensors.h"
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Truncated principal component decomposition of the emissivities along the
+ * energy axis.
+ *
+ * The emissivity volumes of different energies are highly correlated. Each
+ * volume is normalized and approximated by a linear combination of a few
+ * basis volumes (the leading left singular vectors of the matrix whose columns
+ * are the normalized volumes). Since the line of sight integral is linear, the
+ * skies of all energies can then be reconstructed from the skies of the basis
+ * volumes.
+ */
+class EnergyDecomposition {
+public:
+  /**
+   * @param emissivities emissivities[energy][x][y][z]
+   * @param number_of_components number of basis volumes that are kept
+   */
+  EnergyDecomposition(const tensors::tensor_4d &emissivities,
+                      size_t number_of_components);
+
+  /**
+   * @return basis_volumes[component][x][y][z]
+   */
+  [[nodiscard]] const tensors::tensor_4d &get_basis_volumes() const {
+    return basis_volumes;
+  }
+
+  /**
+   * Reconstructs the skies of all energies.
+   * @param basis_skies basis_skies[component][pixel], i.e., the skies of the
+   *                    basis volumes
+   * @return skies[energy][pixel]
+   */
+  [[nodiscard]] tensors::tensor_2d
+  reconstruct_skies(const tensors::tensor_2d &basis_skies) const;
+
+  /**
+   * Relative truncation errors ||emissivity - approximation|| / ||emissivity||
+   * of the emissivity volumes (Frobenius norm over the grid). Since the line
+   * of sight integral is linear, they indicate the accuracy of the
+   * reconstructed skies.
+   * @return errors[energy]
+   */
+  [[nodiscard]] const std::vector<double> &get_truncation_errors() const {
+    return truncation_errors;
+  }
+
+private:
+  // norms[energy] = ||emissivities[energy]||
+  std::vector<double> norms;
+  // coefficients[energy][component]
+  tensors::tensor_2d coefficients;
+  tensors::tensor_4d basis_volumes;
+  std::vector<double> truncation_errors;
+
+  /**
+   * @return gram_matrix[i][j] = <emissivities[i], emissivities[j]>
+   */
+  static tensors::tensor_2d
+  compute_gram_matrix(const tensors::tensor_4d &emissivities);
+};
+
+#endif // GAMMA_SKY_SRC_ENERGYDECOMPOSITION_H
@@ -0,0 +1,265 @@
+// Author: Stefan Lepperdinger
+#include "ExecutionPlan.h"
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// bytes of a std::vector object plus the bookkeeping of its heap allocation
+constexpr double vector_overhead = sizeof(std::vector<double>) + 16.;
+constexpr double bytes_per_GB = 1e9;
+
+double count_grid_points(const std::array<size_t, 3> &grid_dimensions) {
+  return static_cast<double>(grid_dimensions[0]) *
+         static_cast<double>(grid_dimensions[1]) *
+         static_cast<double>(grid_dimensions[2]);
+}
+
+double estimate_operator_entries(const std::array<size_t, 3> &grid_dimensions,
+                                 size_t number_of_pixels) {
+  double grid_points_per_row =
+      2. * static_cast<double>(grid_dimensions[0] + grid_dimensions[1] +
+                               grid_dimensions[2]);
+  return std::min(grid_points_per_row, count_grid_points(grid_dimensions)) *
+         static_cast<double>(number_of_pixels);
+}
+
+} // namespace
+
+ExecutionPlan::ExecutionPlan(const Problem &problem,
+                             const ParameterFile::Parameters &parameters)
+    : problem(problem), max_memory(parameters.max_memory),
+      uses_projection_operator(parameters.use_projection_operator),
+      cone_tracing(parameters.cone_tracing),
+      uses_symmetries(parameters.symmetry_tolerance >= 0.),
+      compresses_volumes(!parameters.volume_compression.empty() &&
+                         parameters.volume_compression != "none"),
+      number_of_distance_rows(parameters.distance_bin_edges.size()),
+      computes_observer_gradients(parameters.observer_gradient),
+      brick_planes(static_cast<size_t>(
+          std::max(parameters.out_of_core_brick_planes, 0))),
+      energy_decomposition_components(static_cast<size_t>(
+          std::max(parameters.energy_decomposition_components, 0))),
+      needs_all_energies(energy_decomposition_components > 0 ||
+                         problem.number_of_band_skies > 0) {
+  stream_skies =
+      !parameters.progressive_preview || problem.number_of_skies == 0;
+  if (brick_planes > 0) {
+    // only bricks of the volumes are resident
+    stream_skies = true;
+    number_of_resident_energies = 0;
+  } else if (needs_all_energies) {
+    number_of_resident_energies = problem.number_of_energies;
+  } else if (!stream_skies) {
+    number_of_resident_energies = problem.number_of_skies;
+  } else {
+    number_of_resident_energies =
+        std::min<size_t>(problem.number_of_skies, 1);
+  }
+
+  // progressive previews are dropped before the run is refused
+  if (!stream_skies &&
+      !fits(estimate_memory(number_of_resident_energies, false, false))) {
+    stream_skies = true;
+    if (!needs_all_energies) {
+      number_of_resident_energies =
+          std::min<size_t>(problem.number_of_skies, 1);
+    }
+  }
+  // the skies of single resident volumes that are integrated along the lines
+  // of sight can use the compressed copies alone (the energy bands and the
+  // energy decomposition combine the double precision volumes)
+  keep_compressed_volumes =
+      compresses_volumes && !needs_all_energies && brick_planes == 0 &&
+      !uses_projection_operator && !cone_tracing &&
+      number_of_distance_rows == 0 && !computes_observer_gradients &&
+      problem.number_of_components == 1;
+  double minimum_memory =
+      estimate_memory(number_of_resident_energies, false, stream_skies);
+  if (!fits(minimum_memory)) {
+    std::ostringstream message;
+    message << "The run needs at least " << minimum_memory / bytes_per_GB
+            << " GB of memory, but max_memory_in_GB is "
+            << max_memory / bytes_per_GB
+            << " GB. Please increase max_memory_in_GB, lower the HEALPix "
+               "order or split the run into shards.";
+    throw std::invalid_argument(message.str());
+  }
+  store_pixel_directions =
+      fits(estimate_memory(number_of_resident_energies, true, stream_skies));
+
+  // the remaining memory is filled with emissivity volumes
+  if (!needs_all_energies && stream_skies && brick_planes == 0) {
+    while (number_of_resident_energies < problem.number_of_skies &&
+           fits(estimate_memory(number_of_resident_energies + 1,
+                                store_pixel_directions, stream_skies))) {
+      ++number_of_resident_energies;
+    }
+  }
+  estimated_memory = estimate_memory(number_of_resident_energies,
+                                     store_pixel_directions, stream_skies);
+}
+
+double ExecutionPlan::estimate_volume_memory(
+    const std::array<size_t, 3> &grid_dimensions) {
+  auto x_dimension = static_cast<double>(grid_dimensions[0]);
+  auto y_dimension = static_cast<double>(grid_dimensions[1]);
+  return count_grid_points(grid_dimensions) * sizeof(double) +
+         (x_dimension * y_dimension + x_dimension + 1.) * vector_overhead;
+}
+
+double ExecutionPlan::estimate_compressed_volume_memory(
+    const std::array<size_t, 3> &grid_dimensions) {
+  // 16 bit codes plus the magnitude table of log16
+  return count_grid_points(grid_dimensions) * sizeof(std::uint16_t) +
+         32768. * sizeof(float) + 2. * vector_overhead;
+}
+
+double
+ExecutionPlan::estimate_pixel_directions_memory(size_t number_of_pixels) {
+  return static_cast<double>(number_of_pixels) * 3. * sizeof(float) +
+         3. * vector_overhead;
+}
+
+double ExecutionPlan::estimate_projection_operator_memory(
+    const std::array<size_t, 3> &grid_dimensions, size_t number_of_pixels) {
+  double entries = estimate_operator_entries(grid_dimensions, number_of_pixels);
+  return entries * (sizeof(std::uint32_t) + sizeof(float)) +
+         static_cast<double>(number_of_pixels + 1) * sizeof(std::uint64_t);
+}
+
+double ExecutionPlan::estimate_memory(size_t resident_energies,
+                                      bool stored_pixel_directions,
+                                      bool streamed_skies) const {
+  const auto &dimensions = problem.grid_dimensions;
+  size_t number_of_pixels = problem.number_of_pixels;
+  auto pixels = static_cast<double>(number_of_pixels);
+  auto components = static_cast<double>(problem.number_of_components);
+  double volume = components * estimate_volume_memory(dimensions);
+  double compressed_volume =
+      components * estimate_compressed_volume_memory(dimensions);
+  double directions = estimate_pixel_directions_memory(number_of_pixels);
+  double sky = components * (pixels * sizeof(double) + vector_overhead);
+
+  double persistent = stored_pixel_directions ? directions : 0.;
+  double assembly{};
+  if (uses_projection_operator) {
+    persistent +=
+        estimate_projection_operator_memory(dimensions, number_of_pixels);
+    // the rows are collected as (32 bit index, double) pairs first and the
+    // assembly always needs the pixel directions
+    assembly = estimate_operator_entries(dimensions, number_of_pixels) * 16. +
+               pixels * vector_overhead +
+               (stored_pixel_directions ? 0. : directions);
+  }
+
+  // resident volumes, the single precision buffer of a volume that is read,
+  // the sky that gets written and its single precision buffer
+  double computation =
+      static_cast<double>(resident_energies) *
+          (keep_compressed_volumes ? compressed_volume : volume) +
+      count_grid_points(dimensions) * sizeof(float) + sky +
+      pixels * sizeof(float);
+  if (keep_compressed_volumes && resident_energies > 0) {
+    // the double precision volume that is read and compressed
+    computation += volume;
+  }
+  // volume whose replicas are placed on the NUMA nodes
+  double integrated_volume = volume;
+  if (brick_planes > 0) {
+    // the integrated brick, the brick that is read ahead and the sum of the
+    // partial skies (the single precision buffer only holds a brick)
+    std::array<size_t, 3> brick_dimensions{
+        dimensions[0], dimensions[1],
+        std::min(brick_planes + 1, dimensions[2])};
+    integrated_volume = estimate_volume_memory(brick_dimensions);
+    computation += 2. * integrated_volume + sky +
+                   (count_grid_points(brick_dimensions) -
+                    count_grid_points(dimensions)) *
+                       sizeof(float);
+  }
+  if (uses_projection_operator) {
+    // flat copy of the volume that is multiplied
+    computation += count_grid_points(dimensions) * sizeof(double);
+  }
+  if (energy_decomposition_components > 0) {
+    auto basis_volumes = static_cast<double>(energy_decomposition_components);
+    computation += basis_volumes * volume +
+                   (basis_volumes +
+                    static_cast<double>(problem.number_of_energies)) *
+                       sky;
+  }
+  if (cone_tracing) {
+    // coarse levels of the emissivity pyramid
+    computation += volume / 7.;
+  } else if (uses_symmetries && brick_planes == 0) {
+    // representatives, independent pixels and their sky
+    computation += pixels * (2. * sizeof(size_t) + sizeof(double));
+  }
+  // replicas of the integrated volume on the NUMA nodes (compressed volumes
+  // are shared by the nodes); progressive previews keep the replicas of all
+  // of their volumes for all levels
+  if (!compresses_volumes) {
+    double replicated_volumes = 1.;
+    if (!streamed_skies) {
+      replicated_volumes = static_cast<double>(
+          energy_decomposition_components > 0 ? energy_decomposition_components
+                                              : problem.number_of_skies);
+    }
+    computation += static_cast<double>(problem.number_of_volume_replicas) *
+                   replicated_volumes * integrated_volume;
+  }
+  // mean distances and distance histograms of a sky
+  computation += static_cast<double>(number_of_distance_rows) * sky;
+  if (computes_observer_gradients) {
+    // the three derivatives of a sky
+    computation += 3. * sky;
+  }
+  if (compresses_volumes && !keep_compressed_volumes) {
+    // 16 bit copy of the integrated volume next to the resident volumes
+    computation += compressed_volume;
+  }
+  if (problem.number_of_band_skies > 0) {
+    // combined volume of a band
+    computation += volume;
+  }
+  if (!streamed_skies) {
+    // all skies plus the skies of a level and the preview
+    computation += 2. * static_cast<double>(problem.number_of_skies) * sky;
+  }
+  return base_memory + persistent + std::max(assembly, computation);
+}
+
+std::string ExecutionPlan::describe() const {
+  std::ostringstream description;
+  description << "execution plan for " << max_memory / bytes_per_GB
+              << " GB of memory:\n";
+  const auto &dimensions = problem.grid_dimensions;
+  description << "  resident emissivity volumes: "
+              << number_of_resident_energies << " of "
+              << (needs_all_energies ? problem.number_of_energies
+                                     : problem.number_of_skies)
+              << " ("
+              << (keep_compressed_volumes
+                      ? estimate_compressed_volume_memory(dimensions)
+                      : estimate_volume_memory(dimensions)) /
+                     bytes_per_GB
+              << " GB each" << (keep_compressed_volumes ? ", compressed" : "")
+              << ")\n";
+  if (brick_planes > 0) {
+    description << "  out-of-core bricks: " << brick_planes
+                << " cells along z (2 resident)\n";
+  }
+  description << "  pixel directions: "
+              << (store_pixel_directions ? "stored" : "computed on the fly")
+              << '\n';
+  description << "  skies: "
+              << (stream_skies ? "streamed into the output file"
+                               : "kept in memory for progressive previews")
+              << '\n';
+  description << "  estimated peak memory: "
+              << estimated_memory / bytes_per_GB << " GB\n";
+  return description.str();
+}
@@ -0,0 +1,157 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_EXECUTIONPLAN_H
+#define GAMMA_SKY_SRC_EXECUTIONPLAN_H
+
+#include "ParameterFile.h"
+#include <array>
+#include <string>
+
+using std::size_t;
+
+/**
+ * Chooses how a gamma_sky run uses the memory granted by the parameter
+ * max_memory_in_GB.
+ *
+ * The footprint of every stage is estimated from the metadata of the input
+ * file (grid dimensions and number of energies) and the number of sky pixels
+ * before anything large gets allocated. The plan decides how many emissivity
+ * volumes are resident at once, whether the directions of the sky pixels are
+ * stored or recomputed for every sky, and whether the skies are streamed into
+ * the output file or kept in memory for progressive previews.
+ */
+class ExecutionPlan {
+public:
+  /**
+   * Sizes of a run that determine its memory footprint.
+   */
+  struct Problem {
+    // {x, y, z} dimensions of the emissivity grid
+    std::array<size_t, 3> grid_dimensions;
+    // number of energies of the input file
+    size_t number_of_energies;
+    // number of energy skies computed by the run
+    size_t number_of_skies;
+    // number of energy band skies computed by the run
+    size_t number_of_band_skies;
+    // number of HEALPix pixels computed by the run
+    size_t number_of_pixels;
+    // number of emissivity components whose volumes and skies are resident
+    // per energy
+    size_t number_of_components = 1;
+    // number of NUMA replicas of the emissivity volume that gets integrated
+    size_t number_of_volume_replicas = 0;
+  };
+
+  // bytes used independently of the problem (code of the libraries, HDF5
+  // caches and thread stacks)
+  static constexpr double base_memory = 32e6;
+
+  /**
+   * @throws std::invalid_argument if the run can't be executed within
+   *         max_memory_in_GB
+   */
+  ExecutionPlan(const Problem &problem,
+                const ParameterFile::Parameters &parameters);
+
+  /**
+   * @return number of emissivity volumes that are kept in memory at once
+   */
+  [[nodiscard]] size_t get_number_of_resident_energies() const {
+    return number_of_resident_energies;
+  }
+  /**
+   * @return true if the emissivity volumes are read and integrated in bricks
+   *         of z planes instead of as a whole
+   */
+  [[nodiscard]] bool integrates_bricks() const { return brick_planes > 0; }
+  /**
+   * @return true if all emissivity volumes of the input file have to be
+   *         resident (energy decomposition and energy bands)
+   */
+  [[nodiscard]] bool loads_all_energies() const { return needs_all_energies; }
+  /**
+   * @return true if the resident emissivity volumes are kept compressed (see
+   *         Sky::compress_emissivity) and their double precision volumes are
+   *         freed right after reading
+   */
+  [[nodiscard]] bool keeps_compressed_volumes() const {
+    return keep_compressed_volumes;
+  }
+  /**
+   * @return true if the directions of the sky pixels are stored instead of
+   *         being recomputed for every sky
+   */
+  [[nodiscard]] bool stores_pixel_directions() const {
+    return store_pixel_directions;
+  }
+  /**
+   * @return false if all skies are kept in memory for progressive previews
+   */
+  [[nodiscard]] bool streams_skies() const { return stream_skies; }
+  /**
+   * @return estimated peak memory of the run in bytes
+   */
+  [[nodiscard]] double get_estimated_memory() const {
+    return estimated_memory;
+  }
+  /**
+   * @return human readable summary of the plan (multiple lines)
+   */
+  [[nodiscard]] std::string describe() const;
+
+  /**
+   * @return bytes of an emissivity volume stored as tensors::tensor_3d
+   */
+  static double
+  estimate_volume_memory(const std::array<size_t, 3> &grid_dimensions);
+  /**
+   * @return bytes of an emissivity volume stored as CompressedVolume
+   */
+  static double estimate_compressed_volume_memory(
+      const std::array<size_t, 3> &grid_dimensions);
+  /**
+   * @return bytes of the table of the pixel directions
+   */
+  static double estimate_pixel_directions_memory(size_t number_of_pixels);
+  /**
+   * @return bytes of an assembled projection operator (a line of sight
+   *         touches roughly twice as many grid points as the grid has
+   *         points along its axes)
+   */
+  static double estimate_projection_operator_memory(
+      const std::array<size_t, 3> &grid_dimensions, size_t number_of_pixels);
+
+private:
+  Problem problem;
+  // maximum memory in bytes (0: unlimited)
+  double max_memory;
+  bool uses_projection_operator;
+  bool cone_tracing;
+  bool uses_symmetries;
+  bool compresses_volumes;
+  // number of rows of a distance-resolved sky besides the sky itself
+  size_t number_of_distance_rows;
+  // derivatives of a sky with respect to the observer location
+  bool computes_observer_gradients;
+  // number of cells along z of the out-of-core bricks (0: whole volumes)
+  size_t brick_planes;
+  size_t energy_decomposition_components;
+  bool needs_all_energies;
+  bool keep_compressed_volumes{};
+  size_t number_of_resident_energies{};
+  bool store_pixel_directions{};
+  bool stream_skies{};
+  double estimated_memory{};
+
+  /**
+   * @return estimated peak memory in bytes for the given choices
+   */
+  [[nodiscard]] double estimate_memory(size_t resident_energies,
+                                       bool stored_pixel_directions,
+                                       bool streamed_skies) const;
+  [[nodiscard]] bool fits(double memory) const {
+    return max_memory <= 0. || memory <= max_memory;
+  }
+};
+
+#endif // GAMMA_SKY_SRC_EXECUTIONPLAN_H
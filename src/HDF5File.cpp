@@ -1,33 +1,46 @@
 // Author: Stefan Lepperdinger
 #include "HDF5File.h"
+#include "CompressedVolume.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace {
+
+const std::array<std::string, 3> axis_names{"x", "y", "z"};
+
+} // namespace
 
 HDF5File::HDF5File(const std::string &h5_file_path, char access_mode)
     : h5_file_path(h5_file_path) {
   if (access_mode == 'r') {
-    open_file();
+    open_file(H5F_ACC_RDONLY);
   } else if (access_mode == 'w') {
     create_file();
+  } else if (access_mode == 'a') {
+    open_file(H5F_ACC_RDWR);
   } else {
     std::ostringstream message;
     message << "HDF5File: invalid access mode '" << access_mode
-            << "'. valid modes: 'r', 'w'";
+            << "'. valid modes: 'r', 'w', 'a'";
     throw std::invalid_argument(message.str());
   }
 }
 
 HDF5File::~HDF5File() { close_file(); }
 
-void HDF5File::open_file() {
-  file = H5Fopen(h5_file_path.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+void HDF5File::open_file(unsigned access_flags) {
+  file = H5Fopen(h5_file_path.c_str(), access_flags, H5P_DEFAULT);
   if (file < 0) {
-    std::cerr << "error: Couldn't open the file '" << h5_file_path << "'.\n";
-    std::exit(1);
+    throw std::runtime_error("Couldn't open the file '" + h5_file_path +
+                             "'.");
   }
 }
 
@@ -39,22 +52,40 @@ void HDF5File::close_file() {
   }
 }
 
-tensors::tensor_3d HDF5File::read_emissivity(size_t energy_index,
-                                             size_t number_of_energies) {
+tensors::tensor_3d HDF5File::read_emissivity(
+    size_t energy_index, size_t number_of_energies, const std::string &pattern,
+    const std::optional<std::array<size_t, 2>> &z_planes) {
   int number_of_digits = static_cast<int>(log10(number_of_energies)) + 1;
+  auto wildcard = pattern.find('*');
   std::ostringstream dataset_name;
-  dataset_name << "/Data/total_emission_E" << std::setfill('0')
-               << std::setw(number_of_digits) << energy_index;
+  dataset_name << "/Data/" << pattern.substr(0, wildcard) << std::setfill('0')
+               << std::setw(number_of_digits) << energy_index
+               << pattern.substr(wildcard + 1);
+  if (!has_dataset(dataset_name.str())) {
+    throw std::runtime_error("The file '" + h5_file_path +
+                             "' doesn't contain the dataset '" +
+                             dataset_name.str() + "'.");
+  }
   hid_t dataset = H5Dopen2(file, dataset_name.str().c_str(), H5P_DEFAULT);
   hid_t file_space = H5Dget_space(dataset);
   int number_of_dimensions = H5Sget_simple_extent_ndims(file_space);
   if (number_of_dimensions != 3) {
-    std::cerr << "error: wrong number of dimensions of the dataset '"
-              << dataset_name.str() << "'.\n";
-    std::exit(1);
+    throw std::runtime_error("wrong number of dimensions of the dataset '" +
+                             dataset_name.str() + "'.");
   }
   auto dimensions = std::make_unique<hsize_t[]>(number_of_dimensions);
   H5Sget_simple_extent_dims(file_space, dimensions.get(), nullptr);
+  if (z_planes) {
+    // the z planes are the slowest dimension of the dataset
+    if ((*z_planes)[0] + (*z_planes)[1] > dimensions[0]) {
+      throw std::runtime_error("The dataset '" + dataset_name.str() +
+                               "' has fewer z planes than requested.");
+    }
+    std::array<hsize_t, 3> offset{(*z_planes)[0], 0, 0};
+    dimensions[0] = (*z_planes)[1];
+    H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset.data(), nullptr,
+                        dimensions.get(), nullptr);
+  }
 
   size_t number_of_values = dimensions[0] * dimensions[1] * dimensions[2];
   auto buffer = std::make_unique<float[]>(number_of_values);
@@ -68,18 +99,24 @@ tensors::tensor_3d HDF5File::read_emissivity(size_t energy_index,
   size_t x_dimension = dimensions[2];
   size_t y_dimension = dimensions[1];
   size_t z_dimension = dimensions[0];
-  auto emissivity =
-      tensors::make_3d_tensor({x_dimension, y_dimension, z_dimension});
-  for (size_t x{}; x != x_dimension; ++x) {
-    for (size_t y{}; y != y_dimension; ++y) {
-      for (size_t z{}; z != z_dimension; ++z) {
-        size_t data_index = z * y_dimension * x_dimension;
-        data_index += y * x_dimension;
-        data_index += x;
-        emissivity[x][y][z] = buffer[data_index];
-      }
-    }
-  }
+  // the planes are allocated and first touched by the TBB workers, which
+  // spreads them over the NUMA nodes of the workers
+  tensors::tensor_3d emissivity(x_dimension);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, x_dimension),
+      [&](const tbb::blocked_range<size_t> &range) {
+        for (size_t x = range.begin(); x != range.end(); ++x) {
+          emissivity[x] = tensors::make_2d_tensor({y_dimension, z_dimension});
+          for (size_t y{}; y != y_dimension; ++y) {
+            for (size_t z{}; z != z_dimension; ++z) {
+              size_t data_index = z * y_dimension * x_dimension;
+              data_index += y * x_dimension;
+              data_index += x;
+              emissivity[x][y][z] = buffer[data_index];
+            }
+          }
+        }
+      });
 
   H5Sclose(memory_space);
   H5Sclose(file_space);
@@ -91,12 +128,41 @@ tensors::tensor_4d HDF5File::read_emissivities() {
   hssize_t number_of_energies = get_number_of_energies();
   tensors::tensor_4d emissivities;
   for (hssize_t energy{}; energy != number_of_energies; ++energy) {
-    auto emissivity = read_emissivity(energy, number_of_energies);
+    auto emissivity =
+        read_emissivity(energy, number_of_energies, total_emission_pattern);
     emissivities.push_back(emissivity);
   }
   return emissivities;
 }
 
+tensors::tensor_3d HDF5File::read_emissivity(size_t energy_index) {
+  return read_emissivity(energy_index, total_emission_pattern);
+}
+
+tensors::tensor_3d HDF5File::read_emissivity_planes(size_t energy_index,
+                                                    size_t first_plane,
+                                                    size_t number_of_planes) {
+  return read_emissivity(energy_index,
+                         static_cast<size_t>(get_number_of_energies()),
+                         total_emission_pattern,
+                         std::array<size_t, 2>{first_plane, number_of_planes});
+}
+
+tensors::tensor_3d HDF5File::read_emissivity(size_t energy_index,
+                                             const std::string &pattern) {
+  return read_emissivity(energy_index,
+                         static_cast<size_t>(get_number_of_energies()),
+                         pattern);
+}
+
+std::string HDF5File::get_component_name(const std::string &pattern) {
+  auto name = pattern.substr(0, pattern.find('*'));
+  if (name.size() > 2 && name.compare(name.size() - 2, 2, "_E") == 0) {
+    name.erase(name.size() - 2);
+  }
+  return name;
+}
+
 hssize_t HDF5File::get_number_of_energies() {
   std::string group_name = "/Data";
   hid_t group = H5Gopen2(file, group_name.c_str(), H5P_DEFAULT);
@@ -144,6 +210,10 @@ std::vector<double> HDF5File::read_energies() {
   return read_vector_attribute("RadiationEnergies");
 }
 
+std::vector<double> HDF5File::read_energies_dataset() {
+  return read_array<double>("energies", H5T_NATIVE_DOUBLE);
+}
+
 grids::cartesian_grid_3d HDF5File::read_emissivity_grid() {
   grids::cartesian_grid_3d emissivity_grid;
   emissivity_grid.x_centers = read_vector_attribute("xGridCentred");
@@ -159,31 +229,62 @@ void HDF5File::create_file() {
   file =
       H5Fcreate(h5_file_path.c_str(), H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
   if (file < 0) {
-    std::cerr << "error: Couldn't create the file '" << h5_file_path
-              << "'. Does it already exist?\n";
-    std::exit(1);
+    throw std::runtime_error("Couldn't create the file '" + h5_file_path +
+                             "'. Does it already exist?");
   }
 }
 
 void HDF5File::save_skies(const tensors::tensor_2d &skies) {
+  save_matrix(skies, "gamma ray skies", "MeV / (cm^2 sr s)",
+              "Gamma sky fluxes at the position of the observer. Data "
+              "dimensions: (energy, HEALPix pixel)");
+}
+
+void HDF5File::save_preview_skies(int order,
+                                  const tensors::tensor_2d &skies) {
+  save_matrix(skies, "gamma ray skies preview order " + std::to_string(order),
+              "MeV / (cm^2 sr s)",
+              "Preview of the gamma sky fluxes at a lower HEALPix order (RING "
+              "scheme). Every pixel shows the flux of its first NESTED "
+              "descendant at the target order. Data dimensions: (energy, "
+              "HEALPix pixel)");
+  H5Fflush(file, H5F_SCOPE_LOCAL);
+}
+
+bool HDF5File::has_preview_skies(int order) {
+  return has_dataset("gamma ray skies preview order " + std::to_string(order));
+}
+
+void HDF5File::save_band_skies(
+    const tensors::tensor_2d &skies,
+    const std::vector<std::array<double, 2>> &bands) {
+  size_t number_of_pixels = skies.empty() ? 0 : skies.back().size();
+  create_band_skies(bands, number_of_pixels);
+  for (size_t band{}; band != skies.size(); ++band) {
+    write_band_sky(band, 0, skies[band]);
+  }
+}
+
+void HDF5File::save_matrix(const tensors::tensor_2d &matrix,
+                           const std::string &name, const std::string &unit,
+                           const std::string &description) {
   int number_of_dimensions = 2;
   auto dimensions = std::make_unique<hsize_t[]>(number_of_dimensions);
-  dimensions[0] = skies.size();
-  dimensions[1] = skies.back().size();
+  dimensions[0] = matrix.size();
+  dimensions[1] = matrix.empty() ? 0 : matrix.back().size();
   hid_t data_space =
       H5Screate_simple(number_of_dimensions, dimensions.get(), nullptr);
 
-  std::string dataset_name = "gamma ray skies";
-  hid_t dataset = H5Dcreate(file, dataset_name.c_str(), H5T_NATIVE_FLOAT,
-                            data_space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  hid_t dataset = H5Dcreate(file, name.c_str(), H5T_NATIVE_FLOAT, data_space,
+                            H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
 
   size_t buffer_size = dimensions[0] * dimensions[1];
   auto buffer = std::make_unique<float[]>(buffer_size);
 
-  for (size_t energy{}; energy != dimensions[0]; ++energy) {
-    for (size_t pixel{}; pixel != dimensions[1]; ++pixel) {
-      size_t index = energy * dimensions[1] + pixel;
-      buffer[index] = static_cast<float>(skies[energy][pixel]);
+  for (size_t row{}; row != dimensions[0]; ++row) {
+    for (size_t column{}; column != dimensions[1]; ++column) {
+      size_t index = row * dimensions[1] + column;
+      buffer[index] = static_cast<float>(matrix[row][column]);
     }
   }
 
@@ -191,15 +292,318 @@ void HDF5File::save_skies(const tensors::tensor_2d &skies) {
                           H5P_DEFAULT, buffer.get());
   assert(error >= 0);
 
-  add_unit_to_dataset(dataset, "MeV / (cm^2 sr s)");
-  add_description_to_dataset(
-      dataset, "Gamma sky fluxes at the position of the observer. Data "
-               "dimensions: (energy, HEALPix pixel)");
+  add_unit_to_dataset(dataset, unit);
+  add_description_to_dataset(dataset, description);
+
+  H5Dclose(dataset);
+  H5Sclose(data_space);
+}
+
+template <typename T>
+void HDF5File::save_array(const std::vector<T> &array, hid_t type,
+                          const std::string &name, const std::string &unit,
+                          const std::string &description) {
+  int number_of_dimensions = 1;
+  auto dimensions = std::make_unique<hsize_t[]>(number_of_dimensions);
+  dimensions[0] = array.size();
+  hid_t data_space =
+      H5Screate_simple(number_of_dimensions, dimensions.get(), nullptr);
+  hid_t dataset = H5Dcreate(file, name.c_str(), type, data_space, H5P_DEFAULT,
+                            H5P_DEFAULT, H5P_DEFAULT);
+  herr_t error =
+      H5Dwrite(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, array.data());
+  assert(error >= 0);
+  add_unit_to_dataset(dataset, unit);
+  add_description_to_dataset(dataset, description);
+  H5Dclose(dataset);
+  H5Sclose(data_space);
+}
+
+template <typename T>
+std::vector<T> HDF5File::read_array(const std::string &name, hid_t type) {
+  hid_t dataset = H5Dopen2(file, name.c_str(), H5P_DEFAULT);
+  if (dataset < 0) {
+    throw std::runtime_error("Couldn't find the dataset '" + name +
+                             "' in the file '" + h5_file_path + "'.");
+  }
+  hid_t file_space = H5Dget_space(dataset);
+  hssize_t number_of_elements = H5Sget_simple_extent_npoints(file_space);
+  std::vector<T> array(number_of_elements);
+  herr_t error =
+      H5Dread(dataset, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, array.data());
+  assert(error >= 0);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+  return array;
+}
 
+tensors::tensor_2d HDF5File::read_matrix(const std::string &name) {
+  hid_t dataset = H5Dopen2(file, name.c_str(), H5P_DEFAULT);
+  if (dataset < 0) {
+    throw std::runtime_error("Couldn't find the dataset '" + name +
+                             "' in the file '" + h5_file_path + "'.");
+  }
+  hid_t file_space = H5Dget_space(dataset);
+  if (H5Sget_simple_extent_ndims(file_space) != 2) {
+    throw std::runtime_error("wrong number of dimensions of the dataset '" +
+                             name + "'.");
+  }
+  std::array<hsize_t, 2> dimensions{};
+  H5Sget_simple_extent_dims(file_space, dimensions.data(), nullptr);
+  auto buffer = std::make_unique<float[]>(dimensions[0] * dimensions[1]);
+  herr_t error = H5Dread(dataset, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL,
+                         H5P_DEFAULT, buffer.get());
+  assert(error >= 0);
+  auto matrix = tensors::make_2d_tensor({dimensions[0], dimensions[1]});
+  for (size_t row{}; row != dimensions[0]; ++row) {
+    for (size_t column{}; column != dimensions[1]; ++column) {
+      matrix[row][column] = buffer[row * dimensions[1] + column];
+    }
+  }
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+  return matrix;
+}
+
+void HDF5File::create_matrix(size_t number_of_rows, size_t number_of_columns,
+                             const std::string &name, const std::string &unit,
+                             const std::string &description) {
+  std::array<hsize_t, 2> dimensions{number_of_rows, number_of_columns};
+  hid_t data_space = H5Screate_simple(2, dimensions.data(), nullptr);
+  hid_t dataset = H5Dcreate(file, name.c_str(), H5T_NATIVE_FLOAT, data_space,
+                            H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  add_unit_to_dataset(dataset, unit);
+  add_description_to_dataset(dataset, description);
   H5Dclose(dataset);
   H5Sclose(data_space);
 }
 
+void HDF5File::write_matrix_row(const std::string &name, size_t row,
+                                size_t first_column,
+                                const std::vector<double> &values) {
+  hid_t dataset = H5Dopen2(file, name.c_str(), H5P_DEFAULT);
+  hid_t file_space = H5Dget_space(dataset);
+  std::array<hsize_t, 2> offset{row, first_column};
+  std::array<hsize_t, 2> count{1, values.size()};
+  H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset.data(), nullptr,
+                      count.data(), nullptr);
+  hid_t memory_space = H5Screate_simple(2, count.data(), nullptr);
+  std::vector<float> buffer(values.cbegin(), values.cend());
+  herr_t error = H5Dwrite(dataset, H5T_NATIVE_FLOAT, memory_space, file_space,
+                          H5P_DEFAULT, buffer.data());
+  assert(error >= 0);
+  H5Sclose(memory_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+}
+
+std::vector<bool> HDF5File::read_flags(const std::string &name) {
+  if (!has_dataset(name)) {
+    return {};
+  }
+  auto flags = read_array<std::uint8_t>(name, H5T_NATIVE_UINT8);
+  return {flags.cbegin(), flags.cend()};
+}
+
+void HDF5File::set_flag(const std::string &name, size_t index) {
+  hid_t dataset = H5Dopen2(file, name.c_str(), H5P_DEFAULT);
+  hid_t file_space = H5Dget_space(dataset);
+  std::array<hsize_t, 1> offset{index};
+  std::array<hsize_t, 1> count{1};
+  H5Sselect_hyperslab(file_space, H5S_SELECT_SET, offset.data(), nullptr,
+                      count.data(), nullptr);
+  hid_t memory_space = H5Screate_simple(1, count.data(), nullptr);
+  std::uint8_t flag = 1;
+  herr_t error = H5Dwrite(dataset, H5T_NATIVE_UINT8, memory_space, file_space,
+                          H5P_DEFAULT, &flag);
+  assert(error >= 0);
+  H5Sclose(memory_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset);
+  H5Fflush(file, H5F_SCOPE_LOCAL);
+}
+
+void HDF5File::create_progress_record(size_t number_of_skies,
+                                      size_t number_of_band_skies) {
+  save_array(std::vector<std::uint8_t>(number_of_skies), H5T_NATIVE_UINT8,
+             "completed gamma ray skies", "unitless",
+             "1 if the row of the gamma ray skies has been computed");
+  save_array(std::vector<std::uint8_t>(number_of_band_skies), H5T_NATIVE_UINT8,
+             "completed gamma ray band skies", "unitless",
+             "1 if the row of the gamma ray band skies has been computed");
+  H5Fflush(file, H5F_SCOPE_LOCAL);
+}
+
+std::vector<bool> HDF5File::read_completed_skies() {
+  return read_flags("completed gamma ray skies");
+}
+
+std::vector<bool> HDF5File::read_completed_band_skies() {
+  return read_flags("completed gamma ray band skies");
+}
+
+void HDF5File::mark_sky_completed(size_t row) {
+  set_flag("completed gamma ray skies", row);
+}
+
+void HDF5File::mark_band_sky_completed(size_t row) {
+  set_flag("completed gamma ray band skies", row);
+}
+
+bool HDF5File::has_dataset(const std::string &name) {
+  return H5Lexists(file, name.c_str(), H5P_DEFAULT) > 0;
+}
+
+tensors::tensor_2d HDF5File::read_skies() {
+  return read_matrix("gamma ray skies");
+}
+
+tensors::tensor_2d HDF5File::read_band_skies() {
+  return read_matrix("gamma ray band skies");
+}
+
+std::vector<std::array<double, 2>> HDF5File::read_band_edges() {
+  std::vector<std::array<double, 2>> bands;
+  for (const auto &edges : read_matrix("energy band edges")) {
+    bands.push_back({edges[0], edges[1]});
+  }
+  return bands;
+}
+
+void HDF5File::create_skies(size_t number_of_energies,
+                            size_t number_of_pixels,
+                            const std::string &component) {
+  std::string description =
+      component.empty() ? "Gamma sky fluxes at the position of the observer."
+                        : "Gamma sky fluxes of the emissivity component '" +
+                              component +
+                              "' at the position of the observer.";
+  create_matrix(number_of_energies, number_of_pixels,
+                get_skies_name(component), "MeV / (cm^2 sr s)",
+                description + " Data dimensions: (energy, HEALPix pixel)");
+}
+
+void HDF5File::write_sky(size_t energy_index, size_t first_pixel,
+                         const tensors::tensor_1d &sky,
+                         const std::string &component) {
+  write_matrix_row(get_skies_name(component), energy_index, first_pixel, sky);
+}
+
+void HDF5File::create_distance_histograms(size_t number_of_energies,
+                                          const std::vector<double> &bin_edges,
+                                          size_t number_of_pixels) {
+  size_t number_of_bins = bin_edges.size() - 1;
+  create_matrix(number_of_energies * number_of_bins, number_of_pixels,
+                "gamma ray sky distance histograms", "MeV / (cm^2 sr s)",
+                "Parts of the gamma sky fluxes whose emission originates "
+                "within the distance bins from the observer. Data dimensions: "
+                "(energy * number of distance bins + distance bin, HEALPix "
+                "pixel)");
+  create_matrix(number_of_energies, number_of_pixels,
+                "gamma ray sky mean distances", "kpc",
+                "Flux-weighted mean distances of the emission of the gamma "
+                "sky fluxes. Data dimensions: (energy, HEALPix pixel)");
+  save_vector(bin_edges, "distance bin edges", "kpc",
+              "ascending edges of the distance bins");
+}
+
+void HDF5File::write_distance_histograms(size_t energy_index,
+                                         size_t first_pixel,
+                                         const tensors::tensor_2d &rows) {
+  write_matrix_row("gamma ray sky mean distances", energy_index, first_pixel,
+                   rows[1]);
+  size_t number_of_bins = rows.size() - 2;
+  for (size_t bin{}; bin != number_of_bins; ++bin) {
+    write_matrix_row("gamma ray sky distance histograms",
+                     energy_index * number_of_bins + bin, first_pixel,
+                     rows[2 + bin]);
+  }
+}
+
+void HDF5File::create_observer_gradients(size_t number_of_energies,
+                                         size_t number_of_pixels) {
+  create_matrix(number_of_energies * 3, number_of_pixels,
+                "gamma ray sky observer gradients", "MeV / (cm^2 sr s kpc)",
+                "Derivatives of the gamma sky fluxes with respect to the x, y "
+                "and z location of the observer. Data dimensions: (energy * 3 "
+                "+ axis, HEALPix pixel)");
+}
+
+void HDF5File::write_observer_gradients(size_t energy_index,
+                                        size_t first_pixel,
+                                        const tensors::tensor_2d &rows) {
+  for (size_t axis{}; axis != 3; ++axis) {
+    write_matrix_row("gamma ray sky observer gradients",
+                     energy_index * 3 + axis, first_pixel, rows[1 + axis]);
+  }
+}
+
+void HDF5File::create_band_skies(
+    const std::vector<std::array<double, 2>> &bands, size_t number_of_pixels) {
+  create_matrix(bands.size(), number_of_pixels, "gamma ray band skies",
+                "MeV / (cm^2 sr s)",
+                "Gamma sky fluxes integrated over ln(energy) within the energy "
+                "bands. Data dimensions: (energy band, HEALPix pixel)");
+  tensors::tensor_2d band_edges;
+  for (const auto &band : bands) {
+    band_edges.push_back({band[0], band[1]});
+  }
+  save_matrix(band_edges, "energy band edges", "MeV",
+              "(lower, upper) edges of the energy bands. Data dimensions: "
+              "(energy band, edge)");
+}
+
+void HDF5File::write_band_sky(size_t band_index, size_t first_pixel,
+                              const tensors::tensor_1d &sky) {
+  write_matrix_row("gamma ray band skies", band_index, first_pixel, sky);
+}
+
+void HDF5File::save_pixel_range(const std::array<size_t, 2> &pixel_range) {
+  save_array<std::uint64_t>({pixel_range[0], pixel_range[1]},
+                            H5T_NATIVE_UINT64, "pixel range", "unitless",
+                            "HEALPix pixels [first, last) covered by this "
+                            "file");
+}
+
+void HDF5File::save_energy_indices(const std::vector<size_t> &energy_indices) {
+  save_array<std::uint64_t>({energy_indices.cbegin(), energy_indices.cend()},
+                            H5T_NATIVE_UINT64, "energy indices", "unitless",
+                            "indices of the energies (rows of the skies) "
+                            "covered by this file");
+}
+
+std::optional<std::array<size_t, 2>> HDF5File::read_pixel_range() {
+  if (!has_dataset("pixel range")) {
+    return std::nullopt;
+  }
+  auto pixel_range =
+      read_array<std::uint64_t>("pixel range", H5T_NATIVE_UINT64);
+  if (pixel_range.size() != 2) {
+    throw std::runtime_error("The pixel range stored in the file '" +
+                             h5_file_path + "' is malformed.");
+  }
+  return std::array<size_t, 2>{pixel_range[0], pixel_range[1]};
+}
+
+shards::shard_specification
+HDF5File::read_shard_specification(size_t number_of_pixels,
+                                   size_t number_of_energies) {
+  shards::shard_specification shard;
+  shard.pixel_range = read_pixel_range().value_or(
+      std::array<size_t, 2>{0, number_of_pixels});
+  if (has_dataset("energy indices")) {
+    auto energy_indices =
+        read_array<std::uint64_t>("energy indices", H5T_NATIVE_UINT64);
+    shard.energy_indices.assign(energy_indices.cbegin(),
+                                energy_indices.cend());
+  } else {
+    for (size_t energy{}; energy != number_of_energies; ++energy) {
+      shard.energy_indices.push_back(energy);
+    }
+  }
+  return shard;
+}
+
 void HDF5File::save_vector(const std::vector<double> &vector,
                            const std::string &name, const std::string &unit,
                            const std::string &description) {
@@ -258,6 +662,24 @@ void HDF5File::save_energies(const std::vector<double> &energies) {
   save_vector(energies, "energies", "MeV", "energies of the gamma ray skies");
 }
 
+void HDF5File::save_requested_energies(const std::vector<double> &energies) {
+  save_vector(energies, "requested energies", "MeV",
+              "energies of the gamma ray skies at requested energies");
+}
+
+std::vector<double> HDF5File::read_requested_energies() {
+  return read_array<double>("requested energies", H5T_NATIVE_DOUBLE);
+}
+
+void HDF5File::save_requested_energy_skies(const tensors::tensor_2d &skies) {
+  save_matrix(skies, "gamma ray skies at requested energies",
+              "MeV / (cm^2 sr s)",
+              "Gamma sky fluxes at the requested energies, interpolated in "
+              "log-log space between the skies of the bracketing energies "
+              "(rows of the gamma ray skies given by the energy indices). "
+              "Data dimensions: (requested energy, HEALPix pixel)");
+}
+
 void HDF5File::save_parameters(ParameterFile::Parameters parameters) {
   const auto &observer = parameters.xyz_observer_location;
   const auto &longitude = parameters.line_of_sight_longitude;
@@ -274,4 +696,236 @@ void HDF5File::save_parameters(ParameterFile::Parameters parameters) {
               "the radial step size used for the line of sight integration");
   save_scalar(order, "HEALPix order", "unitless",
               "determines the number of HEALPix pixels");
+  save_scalar(parameters.energy_decomposition_components,
+              "energy decomposition components", "unitless",
+              "number of basis volumes of the energy decomposition (0: the "
+              "skies of all energies were integrated)");
+  save_scalar(parameters.skipping_tolerance, "empty space skipping tolerance",
+              "unitless",
+              "relative tolerance up to which blocks of low emissivity were "
+              "skipped (0: disabled)");
+  save_scalar(parameters.symmetry_tolerance, "symmetry tolerance", "unitless",
+              "largest relative difference of mirrored emissivities for "
+              "which mirror symmetries were used (negative: disabled)");
+  save_scalar(static_cast<double>(CompressedVolume::parse_encoding(
+                  parameters.volume_compression)),
+              "volume compression", "unitless",
+              "encoding of the resident emissivity volumes (0: none, 1: "
+              "fp16, 2: bfloat16, 3: log16)");
+  save_scalar(parameters.cone_tracing ? 1. : 0., "cone tracing", "unitless",
+              "1 if the emissivities were averaged over the cones of the "
+              "pixels, 0 if they were sampled along the central rays");
+}
+
+void HDF5File::save_energy_decomposition_errors(
+    const std::vector<double> &errors) {
+  save_vector(errors, "energy decomposition truncation errors", "unitless",
+              "relative truncation errors ||emissivity - approximation|| / "
+              "||emissivity|| of the energy decomposition per energy");
+}
+
+void HDF5File::save_skipping_error_bound(double bound) {
+  const std::string name = "empty space skipping error bound";
+  if (!has_dataset(name)) {
+    save_scalar(bound, name, "unitless",
+                "largest relative error bound of the skies caused by skipping "
+                "blocks of low emissivity (the skipped contributions are "
+                "non-negative for non-negative emissivities)");
+    return;
+  }
+  // a resumed run only bounds the skies of its own session
+  bound = std::max(bound, read_skipping_error_bound());
+  hid_t dataset = H5Dopen2(file, name.c_str(), H5P_DEFAULT);
+  herr_t error = H5Dwrite(dataset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL,
+                          H5P_DEFAULT, &bound);
+  assert(error >= 0);
+  H5Dclose(dataset);
+}
+
+double HDF5File::read_skipping_error_bound() {
+  auto bound =
+      read_array<double>("empty space skipping error bound", H5T_NATIVE_DOUBLE);
+  if (bound.size() != 1) {
+    throw std::runtime_error("The empty space skipping error bound stored in "
+                             "the file '" +
+                             h5_file_path + "' is malformed.");
+  }
+  return bound[0];
+}
+
+void HDF5File::save_input_grid(const grids::cartesian_grid_3d &grid) {
+  const std::array<const std::vector<double> *, 3> centers{
+      &grid.x_centers, &grid.y_centers, &grid.z_centers};
+  const std::array<const std::vector<double> *, 3> boundaries{
+      &grid.x_boundaries, &grid.y_boundaries, &grid.z_boundaries};
+  for (size_t axis{}; axis != 3; ++axis) {
+    save_array(*centers[axis], H5T_NATIVE_DOUBLE,
+               "input grid " + axis_names[axis] + " centers", "kpc",
+               axis_names[axis] + " centers of the emissivity grid");
+    save_array(*boundaries[axis], H5T_NATIVE_DOUBLE,
+               "input grid " + axis_names[axis] + " boundaries", "kpc",
+               axis_names[axis] + " boundaries of the emissivity grid");
+  }
+}
+
+grids::cartesian_grid_3d HDF5File::read_input_grid() {
+  grids::cartesian_grid_3d grid;
+  const std::array<std::vector<double> *, 3> centers{
+      &grid.x_centers, &grid.y_centers, &grid.z_centers};
+  const std::array<std::vector<double> *, 3> boundaries{
+      &grid.x_boundaries, &grid.y_boundaries, &grid.z_boundaries};
+  for (size_t axis{}; axis != 3; ++axis) {
+    *centers[axis] = read_array<double>(
+        "input grid " + axis_names[axis] + " centers", H5T_NATIVE_DOUBLE);
+    *boundaries[axis] = read_array<double>(
+        "input grid " + axis_names[axis] + " boundaries", H5T_NATIVE_DOUBLE);
+  }
+  return grid;
+}
+
+void HDF5File::save_input_fingerprint(
+    const std::array<std::int64_t, 2> &fingerprint) {
+  save_array(std::vector<std::int64_t>{fingerprint[0], fingerprint[1]},
+             H5T_NATIVE_INT64, "input file fingerprint", "unitless",
+             "(size in bytes, last modification time in ticks of the file "
+             "clock) of the input file");
+}
+
+std::array<std::int64_t, 2> HDF5File::read_input_fingerprint() {
+  auto fingerprint =
+      read_array<std::int64_t>("input file fingerprint", H5T_NATIVE_INT64);
+  if (fingerprint.size() != 2) {
+    throw std::runtime_error("The input file fingerprint stored in the file '" +
+                             h5_file_path + "' is malformed.");
+  }
+  return {fingerprint[0], fingerprint[1]};
+}
+
+ParameterFile::Parameters HDF5File::read_parameters() {
+  ParameterFile::Parameters parameters{};
+  auto observer =
+      read_array<double>("xyz observer location", H5T_NATIVE_DOUBLE);
+  auto direction = read_array<double>("line of sight longitude, latitude",
+                                      H5T_NATIVE_DOUBLE);
+  auto step_size = read_array<double>("radial step size", H5T_NATIVE_DOUBLE);
+  auto order = read_array<double>("HEALPix order", H5T_NATIVE_DOUBLE);
+  if (observer.size() != 3 || direction.size() != 2 || step_size.size() != 1 ||
+      order.size() != 1) {
+    throw std::runtime_error("The parameters stored in the file '" +
+                             h5_file_path + "' are malformed.");
+  }
+  parameters.xyz_observer_location = {observer[0], observer[1], observer[2]};
+  parameters.line_of_sight_longitude = direction[0];
+  parameters.line_of_sight_latitude = direction[1];
+  parameters.radial_step_size = step_size[0];
+  parameters.healpix_order = static_cast<int>(order[0]);
+  // not stored by older versions
+  if (has_dataset("energy decomposition components")) {
+    parameters.energy_decomposition_components = static_cast<int>(
+        read_array<double>("energy decomposition components",
+                           H5T_NATIVE_DOUBLE)
+            .front());
+  }
+  if (has_dataset("cone tracing")) {
+    parameters.cone_tracing =
+        read_array<double>("cone tracing", H5T_NATIVE_DOUBLE).front() != 0.;
+  }
+  if (has_dataset("empty space skipping tolerance")) {
+    parameters.skipping_tolerance =
+        read_array<double>("empty space skipping tolerance", H5T_NATIVE_DOUBLE)
+            .front();
+  }
+  // older versions didn't use mirror symmetries
+  parameters.symmetry_tolerance = -1.;
+  if (has_dataset("symmetry tolerance")) {
+    parameters.symmetry_tolerance =
+        read_array<double>("symmetry tolerance", H5T_NATIVE_DOUBLE).front();
+  }
+  parameters.volume_compression = "none";
+  if (has_dataset("volume compression")) {
+    parameters.volume_compression = CompressedVolume::get_encoding_name(
+        static_cast<CompressedVolume::encoding>(
+            read_array<double>("volume compression", H5T_NATIVE_DOUBLE)
+                .front()));
+  }
+  return parameters;
+}
+
+void HDF5File::save_projection_operator(
+    const ProjectionOperator &projection_operator) {
+  const auto &grid_dimensions = projection_operator.get_grid_dimensions();
+  save_array<std::uint64_t>(
+      {grid_dimensions.cbegin(), grid_dimensions.cend()}, H5T_NATIVE_UINT64,
+      "projection operator grid dimensions", "unitless",
+      "(x, y, z) dimensions of the emissivity grid");
+  // the grid centers relative to the observer identify the grid and the
+  // observer location the operator was assembled for
+  const auto &grid_centers = projection_operator.get_grid_centers();
+  for (size_t axis{}; axis != 3; ++axis) {
+    save_array(grid_centers[axis], H5T_NATIVE_DOUBLE,
+               "projection operator grid " + axis_names[axis] + " centers",
+               "kpc",
+               axis_names[axis] + " centers of the emissivity grid relative "
+                                  "to the observer");
+  }
+  // the lines of sight besides the grid
+  const auto &geometry = projection_operator.get_geometry();
+  save_array(std::vector<double>{geometry.radial_step_size}, H5T_NATIVE_DOUBLE,
+             "projection operator radial step size", "kpc",
+             "radial step size of the lines of sight");
+  save_array(std::vector<double>{geometry.longitude, geometry.latitude},
+             H5T_NATIVE_DOUBLE, "projection operator line of sight", "radian",
+             "(longitude, latitude) of the line of sight");
+  save_array(std::vector<std::uint64_t>{geometry.first_pixel},
+             H5T_NATIVE_UINT64, "projection operator first pixel", "unitless",
+             "HEALPix pixel of the first row");
+  save_array(projection_operator.get_row_offsets(), H5T_NATIVE_UINT64,
+             "projection operator row offsets", "unitless",
+             "CSR row offsets. The weights of HEALPix pixel i are located "
+             "within [offsets[i], offsets[i + 1])");
+  save_array(projection_operator.get_column_indices(), H5T_NATIVE_UINT32,
+             "projection operator column indices", "unitless",
+             "CSR column indices, i.e., flat emissivity grid indices "
+             "(x * n_y + y) * n_z + z");
+  save_array(projection_operator.get_weights(), H5T_NATIVE_FLOAT,
+             "projection operator weights", "cm",
+             "CSR weights that map emissivities onto sky fluxes");
+}
+
+ProjectionOperator HDF5File::read_projection_operator() {
+  auto grid_dimensions = read_array<std::uint64_t>(
+      "projection operator grid dimensions", H5T_NATIVE_UINT64);
+  std::array<std::vector<double>, 3> grid_centers;
+  for (size_t axis{}; axis != 3; ++axis) {
+    grid_centers[axis] = read_array<double>(
+        "projection operator grid " + axis_names[axis] + " centers",
+        H5T_NATIVE_DOUBLE);
+  }
+  if (grid_dimensions.size() != 3 ||
+      grid_dimensions[0] != grid_centers[0].size() ||
+      grid_dimensions[1] != grid_centers[1].size() ||
+      grid_dimensions[2] != grid_centers[2].size()) {
+    throw std::runtime_error("The projection operator stored in the file '" +
+                             h5_file_path + "' is malformed.");
+  }
+  auto radial_step_size = read_array<double>(
+      "projection operator radial step size", H5T_NATIVE_DOUBLE);
+  auto line_of_sight = read_array<double>("projection operator line of sight",
+                                          H5T_NATIVE_DOUBLE);
+  auto first_pixel = read_array<std::uint64_t>(
+      "projection operator first pixel", H5T_NATIVE_UINT64);
+  if (radial_step_size.size() != 1 || line_of_sight.size() != 2 ||
+      first_pixel.size() != 1) {
+    throw std::runtime_error("The projection operator stored in the file '" +
+                             h5_file_path + "' is malformed.");
+  }
+  ProjectionOperator::line_of_sight_geometry geometry{
+      radial_step_size[0], line_of_sight[0], line_of_sight[1],
+      static_cast<size_t>(first_pixel[0])};
+  return {geometry, std::move(grid_centers),
+          read_array<std::uint64_t>("projection operator row offsets",
+                                    H5T_NATIVE_UINT64),
+          read_array<std::uint32_t>("projection operator column indices",
+                                    H5T_NATIVE_UINT32),
+          read_array<float>("projection operator weights", H5T_NATIVE_FLOAT)};
 }
@@ -3,22 +3,33 @@
 #define GAMMA_SKY_SRC_HDF5FILE_H
 
 #include "ParameterFile.h"
+#include "ProjectionOperator.h"
 #include "grids.h"
+#include "shards.h"
 #include "tensors.h"
+#include <array>
+#include <cstdint>
 #include <hdf5.h>
+#include <optional>
 #include <string>
 
 using std::size_t;
 
 /**
  * Class for reading and writing to HDF5 files.
+ *
+ * Files that can't be opened or created and missing or malformed datasets
+ * throw a std::runtime_error.
  */
 class HDF5File {
 public:
   /**
    * @param h5_file_path file path of the HDF5 file
-   * @param access_mode either 'r' or 'w'. Use 'r' if you want to read data from
-   *                    a file and 'w' if you want to write data to a file.
+   * @param access_mode either 'r', 'w' or 'a'. Use 'r' if you want to read
+   *                    data from a file, 'w' if you want to write data to a
+   *                    new file and 'a' if you want to read and write data of
+   *                    an existing file.
+   * @throws std::runtime_error if the file can't be opened or created
    */
   HDF5File(const std::string &h5_file_path, char access_mode);
   ~HDF5File();
@@ -26,11 +37,50 @@ public:
    * @return emissivities[energy][x][y][z] in MeV / (s sr cm³)
    */
   tensors::tensor_4d read_emissivities();
+  /**
+   * Reads the emissivity volume of a single energy, such that only a part of
+   * the energies has to be kept in memory.
+   * @param energy_index index of the energy
+   * @return emissivity[x][y][z] in MeV / (s sr cm³)
+   */
+  tensors::tensor_3d read_emissivity(size_t energy_index);
+  /**
+   * Reads consecutive z planes of the emissivity volume of a single energy
+   * (a contiguous part of the dataset), such that volumes that exceed the
+   * memory can be processed brick by brick.
+   * @param energy_index index of the energy
+   * @param first_plane index of the first z plane
+   * @param number_of_planes number of z planes
+   * @return emissivity[x][y][z - first_plane] in MeV / (s sr cm³)
+   */
+  tensors::tensor_3d read_emissivity_planes(size_t energy_index,
+                                            size_t first_plane,
+                                            size_t number_of_planes);
+  /**
+   * Reads the volume of an emissivity component of a single energy.
+   * @param energy_index index of the energy
+   * @param pattern dataset name within the group "/Data", in which '*' stands
+   *                for the zero-padded energy index, e.g.,
+   *                "pion_decay_emission_E*"
+   * @return emissivity[x][y][z] in MeV / (s sr cm³)
+   */
+  tensors::tensor_3d read_emissivity(size_t energy_index,
+                                     const std::string &pattern);
+  /**
+   * @param pattern dataset pattern of an emissivity component
+   * @return name of the component (the pattern without the energy suffix)
+   */
+  static std::string get_component_name(const std::string &pattern);
   /**
    * Reads the energies of the emissivities.
    * @return energies in MeV
    */
   std::vector<double> read_energies();
+  /**
+   * Reads the energies that were saved via save_energies.
+   * @return energies in MeV
+   */
+  std::vector<double> read_energies_dataset();
   /**
    * @return cartesian grid in kpc
    */
@@ -41,31 +91,293 @@ public:
    */
   void save_skies(const tensors::tensor_2d &skies);
 
+  /**
+   * Saves the preview skies of a progressive computation and flushes the
+   * file.
+   * @param order HEALPix order of the preview
+   * @param skies skies[energy][pixel] in MeV / (s sr cm²)
+   */
+  void save_preview_skies(int order, const tensors::tensor_2d &skies);
+
+  /**
+   * @return true if the file contains the preview skies of the order
+   */
+  bool has_preview_skies(int order);
+
+  /**
+   * @param skies skies[band][pixel] in MeV / (s sr cm²)
+   * @param bands {lower, upper} edges of the energy bands in MeV
+   */
+  void save_band_skies(const tensors::tensor_2d &skies,
+                       const std::vector<std::array<double, 2>> &bands);
+
   /**
    * Saves the energies of the gamma skies.
    * @param energies energies in MeV
    */
   void save_energies(const std::vector<double> &energies);
 
+  /**
+   * Saves the energies at which the skies are interpolated.
+   * @param energies requested energies in MeV
+   */
+  void save_requested_energies(const std::vector<double> &energies);
+
+  /**
+   * @return energies saved via save_requested_energies in MeV
+   */
+  std::vector<double> read_requested_energies();
+
+  /**
+   * Saves the skies interpolated at the requested energies.
+   * @param skies skies[requested energy][pixel] in MeV / (s sr cm²)
+   */
+  void save_requested_energy_skies(const tensors::tensor_2d &skies);
+
   /**
    * Saves the parameters of the parameter file.
    * @param parameters parameters of the parameter file
    */
   void save_parameters(ParameterFile::Parameters parameters);
 
+  /**
+   * Saves the pixel range of a sharded run.
+   * @param pixel_range HEALPix pixels [first, last)
+   */
+  void save_pixel_range(const std::array<size_t, 2> &pixel_range);
+
+  /**
+   * Saves the energy indices of a sharded run or of the bracketing energies
+   * of requested energies.
+   * @param energy_indices ascending energy indices
+   */
+  void save_energy_indices(const std::vector<size_t> &energy_indices);
+
+  /**
+   * @return pixel range saved via save_pixel_range (unset if the file covers
+   *         all pixels)
+   */
+  std::optional<std::array<size_t, 2>> read_pixel_range();
+
+  /**
+   * Reads the shard specification of a file written by a sharded run.
+   * @param number_of_pixels used if the file contains all pixels
+   * @param number_of_energies used if the file contains all energies
+   */
+  shards::shard_specification
+  read_shard_specification(size_t number_of_pixels, size_t number_of_energies);
+
+  /**
+   * @return skies[energy][pixel] saved via save_skies
+   */
+  tensors::tensor_2d read_skies();
+
+  /**
+   * @return skies[band][pixel] saved via save_band_skies
+   */
+  tensors::tensor_2d read_band_skies();
+
+  /**
+   * @return {lower, upper} energy band edges saved via save_band_skies
+   */
+  std::vector<std::array<double, 2>> read_band_edges();
+
+  /**
+   * Creates the (zero-filled) dataset of the skies, which can then be filled
+   * piecewise via write_sky.
+   * @param component name of the emissivity component (empty: total
+   *                  emission)
+   */
+  void create_skies(size_t number_of_energies, size_t number_of_pixels,
+                    const std::string &component = "");
+
+  /**
+   * Writes (a part of) a single sky into the dataset created by create_skies.
+   * @param energy_index row of the sky
+   * @param first_pixel HEALPix pixel of sky[0]
+   * @param sky sky fluxes in MeV / (s sr cm²)
+   * @param component name of the emissivity component (empty: total
+   *                  emission)
+   */
+  void write_sky(size_t energy_index, size_t first_pixel,
+                 const tensors::tensor_1d &sky,
+                 const std::string &component = "");
+
+  /**
+   * Creates the (zero-filled) datasets of the energy band skies, which can
+   * then be filled piecewise via write_band_sky.
+   */
+  void create_band_skies(const std::vector<std::array<double, 2>> &bands,
+                         size_t number_of_pixels);
+
+  /**
+   * Writes (a part of) a single band sky into the dataset created by
+   * create_band_skies.
+   */
+  void write_band_sky(size_t band_index, size_t first_pixel,
+                      const tensors::tensor_1d &sky);
+
+  /**
+   * Creates the (zero-filled) datasets of the distance histograms and the
+   * mean distances of the skies and saves the distance bin edges.
+   * @param bin_edges ascending edges of the distance bins in kpc
+   */
+  void create_distance_histograms(size_t number_of_energies,
+                                  const std::vector<double> &bin_edges,
+                                  size_t number_of_pixels);
+
+  /**
+   * Writes (a part of) the distance resolution of a single sky into the
+   * datasets created by create_distance_histograms.
+   * @param energy_index row of the sky
+   * @param first_pixel HEALPix pixel of rows[i][0]
+   * @param rows rows returned by Sky::compute_distance_resolved_sky (the sky
+   *             itself is written via write_sky)
+   */
+  void write_distance_histograms(size_t energy_index, size_t first_pixel,
+                                 const tensors::tensor_2d &rows);
+
+  /**
+   * Creates the (zero-filled) dataset of the derivatives of the skies with
+   * respect to the observer location.
+   */
+  void create_observer_gradients(size_t number_of_energies,
+                                 size_t number_of_pixels);
+
+  /**
+   * Writes (a part of) the observer gradient of a single sky into the
+   * dataset created by create_observer_gradients.
+   * @param energy_index row of the sky
+   * @param first_pixel HEALPix pixel of rows[i][0]
+   * @param rows rows returned by Sky::compute_observer_gradient_sky (the sky
+   *             itself is written via write_sky)
+   */
+  void write_observer_gradients(size_t energy_index, size_t first_pixel,
+                                const tensors::tensor_2d &rows);
+
+  /**
+   * @param name name of the dataset
+   * @return true if the file contains the dataset
+   */
+  bool has_dataset(const std::string &name);
+
+  /**
+   * Creates the progress record of a checkpointed run, i.e., one flag per
+   * row of the skies and the band skies that marks the row as completed.
+   */
+  void create_progress_record(size_t number_of_skies,
+                              size_t number_of_band_skies);
+
+  /**
+   * @return completed[row] of the skies (empty if the file has no progress
+   *         record)
+   */
+  std::vector<bool> read_completed_skies();
+
+  /**
+   * @return completed[row] of the band skies (empty if the file has no
+   *         progress record)
+   */
+  std::vector<bool> read_completed_band_skies();
+
+  /**
+   * Marks a row of the skies as completed and flushes the file, such that
+   * the row survives if the process gets killed afterwards.
+   */
+  void mark_sky_completed(size_t row);
+
+  /**
+   * Marks a row of the band skies as completed and flushes the file.
+   */
+  void mark_band_sky_completed(size_t row);
+
+  /**
+   * Saves the relative truncation errors of the energy decomposition.
+   * @param errors errors[energy]
+   */
+  void save_energy_decomposition_errors(const std::vector<double> &errors);
+
+  /**
+   * Saves the largest relative error bound of the empty space skipping. If the
+   * file already contains a bound (e.g., of a resumed run), the larger one is
+   * kept, such that the bound covers the skies of every session.
+   * @param bound bound of the skipped parts divided by the skies
+   */
+  void save_skipping_error_bound(double bound);
+
+  /**
+   * Reads the bound that was saved via save_skipping_error_bound.
+   */
+  double read_skipping_error_bound();
+
+  /**
+   * Saves the centers and boundaries of the emissivity grid of the input file.
+   */
+  void save_input_grid(const grids::cartesian_grid_3d &grid);
+
+  /**
+   * Reads a grid that was saved via save_input_grid.
+   * @throws std::runtime_error if the file doesn't contain the grid (e.g.,
+   *                            files of older versions)
+   */
+  grids::cartesian_grid_3d read_input_grid();
+
+  /**
+   * Saves the {size, last modification time} of the input file, which
+   * identifies it together with its grid and energies.
+   */
+  void save_input_fingerprint(const std::array<std::int64_t, 2> &fingerprint);
+
+  /**
+   * Reads a fingerprint that was saved via save_input_fingerprint.
+   */
+  std::array<std::int64_t, 2> read_input_fingerprint();
+
+  /**
+   * Reads the parameters that were saved via save_parameters.
+   * @return parameters (only the ones stored by save_parameters are set)
+   */
+  ParameterFile::Parameters read_parameters();
+
+  /**
+   * Saves the sparse line of sight projection operator.
+   * @param projection_operator projection operator
+   */
+  void save_projection_operator(const ProjectionOperator &projection_operator);
+
+  /**
+   * Reads a projection operator that was saved via save_projection_operator.
+   * @return projection operator
+   * @throws std::runtime_error if the file doesn't contain the grid centers
+   *                            or the lines of sight of the operator (e.g.,
+   *                            files of older versions)
+   */
+  ProjectionOperator read_projection_operator();
+
 private:
   const std::string &h5_file_path;
   hid_t file{};
 
-  void open_file();
+  void open_file(unsigned access_flags);
   void create_file();
   void close_file();
+  static constexpr const char *total_emission_pattern = "total_emission_E*";
+
   /**
    * @param energy_index determines the energy of the emissivity
-   * @return emissivity[x][y][z] in MeV / (s sr cm³)
+   * @param pattern dataset pattern of the emissivity component
+   * @param z_planes {first, number} of the z planes that are read as a
+   *                 hyperslab (all planes if unset)
+   * @return emissivity[x][y][z - first z plane] in MeV / (s sr cm³)
    */
-  tensors::tensor_3d read_emissivity(size_t energy_index,
-                                     size_t number_of_energies);
+  tensors::tensor_3d read_emissivity(
+      size_t energy_index, size_t number_of_energies,
+      const std::string &pattern,
+      const std::optional<std::array<size_t, 2>> &z_planes = std::nullopt);
+  static std::string get_skies_name(const std::string &component) {
+    return component.empty() ? "gamma ray skies"
+                             : "gamma ray skies " + component;
+  }
   /**
    * Reads an attribute vector from the group "/Data" of the HDF5 file.
    * @param attribute_name name of the attribute
@@ -82,10 +394,34 @@ private:
                                   const std::string &description) {
     add_string_attribute(dataset, "description", description);
   }
+  void save_matrix(const tensors::tensor_2d &matrix, const std::string &name,
+                   const std::string &unit, const std::string &description);
+  tensors::tensor_2d read_matrix(const std::string &name);
+  void create_matrix(size_t number_of_rows, size_t number_of_columns,
+                     const std::string &name, const std::string &unit,
+                     const std::string &description);
+  std::vector<bool> read_flags(const std::string &name);
+  void set_flag(const std::string &name, size_t index);
+  void write_matrix_row(const std::string &name, size_t row,
+                        size_t first_column, const std::vector<double> &values);
   void save_vector(const std::vector<double> &vector, const std::string &name,
                    const std::string &unit, const std::string &description);
   void save_scalar(double scalar, const std::string &name,
                    const std::string &unit, const std::string &description);
+  /**
+   * Saves a 1D dataset without converting the data type.
+   * @param type HDF5 memory and file type corresponding to T
+   */
+  template <typename T>
+  void save_array(const std::vector<T> &array, hid_t type,
+                  const std::string &name, const std::string &unit,
+                  const std::string &description);
+  /**
+   * Reads all elements of a dataset.
+   * @param type HDF5 memory type corresponding to T
+   */
+  template <typename T>
+  std::vector<T> read_array(const std::string &name, hid_t type);
 };
 
 #endif // GAMMA_SKY_SRC_HDF5FILE_H
@@ -1,16 +1,47 @@
 // Author: Stefan Lepperdinger
 #include "LineOfSightIntegral.h"
+#include "PixelDirections.h"
 #include "mathematics.h"
+#include <algorithm>
 #include <cmath>
-#include <numeric>
+#include <limits>
+
+namespace {
+
+// values of the integrals that don't have values of their own
+const tensors::tensor_3d no_values;
+
+} // namespace
 
 LineOfSightIntegral::LineOfSightIntegral(double radial_step_size,
                                          const grids::cartesian_grid_3d &grid,
-                                         const tensors::tensor_3d &values)
+                                         const tensors::tensor_3d &values,
+                                         double skipping_tolerance)
     : radial_step_size(radial_step_size), grid(grid),
-      interpolation(grid, values) {
+      interpolation(grid, values), skipping_tolerance(skipping_tolerance) {
   initialize_radial_cells();
   initialize_integration_factor();
+  if (skipping_tolerance > 0.) {
+    macrocells.emplace(grid, values);
+  }
+}
+
+LineOfSightIntegral::LineOfSightIntegral(double radial_step_size,
+                                         const grids::cartesian_grid_3d &grid)
+    : LineOfSightIntegral(radial_step_size, grid, no_values) {}
+
+LineOfSightIntegral::LineOfSightIntegral(const LineOfSightIntegral &integral,
+                                         const tensors::tensor_3d &values,
+                                         double skipping_tolerance)
+    : radial_step_size(integral.radial_step_size), grid(integral.grid),
+      number_of_radial_cells(integral.number_of_radial_cells),
+      half_step_size(integral.half_step_size),
+      interpolation(integral.interpolation, values),
+      integration_factor(integral.integration_factor),
+      skipping_tolerance(skipping_tolerance) {
+  if (skipping_tolerance > 0.) {
+    macrocells.emplace(grid, values);
+  }
 }
 
 void LineOfSightIntegral::initialize_integration_factor() {
@@ -26,33 +57,272 @@ void LineOfSightIntegral::initialize_radial_cells() {
   double z_range = grid.z_centers.back() - grid.z_centers.front();
   double maximum_possible_distance =
       mathematics::euclidean_norm({x_range, y_range, z_range});
-  auto maximum_number_of_radial_bins =
+  number_of_radial_cells =
       static_cast<size_t>(maximum_possible_distance / radial_step_size);
-  radial_cell_centers.reserve(maximum_number_of_radial_bins);
-  double half_step_size = radial_step_size * .5;
-  for (size_t i{}; i != maximum_number_of_radial_bins; ++i) {
-    double radial_cell_center =
-        half_step_size + static_cast<double>(i) * radial_step_size;
-    radial_cell_centers.push_back(radial_cell_center);
-  }
+  half_step_size = radial_step_size * .5;
 }
 
-double LineOfSightIntegral::operator()(double longitude, double latitude) {
-  std::vector<double> radial_cell_values;
+double LineOfSightIntegral::operator()(double longitude,
+                                       double latitude) const {
+  return (*this)(PixelDirections::make_direction(longitude, latitude));
+}
 
-  for (const auto &radius : radial_cell_centers) {
-    auto cell_location =
-        mathematics::spherical_to_cartesian(radius, longitude, latitude);
+double
+LineOfSightIntegral::operator()(const std::array<double, 3> &direction) const {
+  double sum{};
+  // bound of the sum of the skipped radial cells
+  double skipped_sum_bound{};
+  // the block of the last decision is left at this distance
+  double block_exit_distance = -std::numeric_limits<double>::infinity();
+  size_t number_of_cells = number_of_radial_cells;
+  for (size_t i{}; i < number_of_cells; ++i) {
+    double radius = get_radial_cell_center(i);
+    std::array<double, 3> cell_location{
+        radius * direction[0], radius * direction[1], radius * direction[2]};
     if (!grid.is_within_grid(cell_location)) {
       break;
     }
-    auto cell_value = interpolation(cell_location);
-    radial_cell_values.push_back(cell_value);
+    if (macrocells && radius >= block_exit_distance) {
+      // decide once per block whether all of its radial cells get skipped
+      auto block = macrocells->locate(cell_location);
+      block_exit_distance = macrocells->get_exit_distance(block, direction);
+      auto cells_in_block = static_cast<size_t>(std::max(
+          std::ceil((block_exit_distance - radius) / radial_step_size), 1.));
+      cells_in_block = std::min(cells_in_block, number_of_cells - i);
+      double block_bound = static_cast<double>(cells_in_block) *
+                           macrocells->get_maximum(block);
+      if (skipped_sum_bound + block_bound <=
+          skipping_tolerance * std::abs(sum)) {
+        skipped_sum_bound += block_bound;
+        i += cells_in_block - 1;
+        continue;
+      }
+    }
+    sum += interpolation(cell_location);
   }
 
-  double sum = std::accumulate(radial_cell_values.cbegin(),
-                               radial_cell_values.cend(), 0.);
-
+  if (skipped_sum_bound > 0.) {
+    double bound = skipped_sum_bound / std::abs(sum);
+    double maximum = maximum_relative_error_bound.load();
+    while (bound > maximum && !maximum_relative_error_bound
+                                   .compare_exchange_weak(maximum, bound)) {
+    }
+  }
   double integral = integration_factor * sum;
   return integral;
 }
+
+std::vector<double>
+LineOfSightIntegral::operator()(const std::array<double, 3> &direction,
+                                const tensors::tensor_4d &volumes) const {
+  std::vector<double> integrals;
+  (*this)(direction, volumes, integrals);
+  return integrals;
+}
+
+void LineOfSightIntegral::operator()(const std::array<double, 3> &direction,
+                                     const tensors::tensor_4d &volumes,
+                                     std::vector<double> &integrals) const {
+  integrals.assign(volumes.size(), 0.);
+  for (size_t cell_index{}; cell_index != number_of_radial_cells;
+       ++cell_index) {
+    double radius = get_radial_cell_center(cell_index);
+    std::array<double, 3> cell_location{
+        radius * direction[0], radius * direction[1], radius * direction[2]};
+    if (!grid.is_within_grid(cell_location)) {
+      break;
+    }
+    auto cell = interpolation.locate(cell_location);
+    for (size_t i{}; i != volumes.size(); ++i) {
+      integrals[i] += TrilinearInterpolation::interpolate(cell, volumes[i]);
+    }
+  }
+  for (auto &integral : integrals) {
+    integral *= integration_factor;
+  }
+}
+
+double
+LineOfSightIntegral::operator()(const std::array<double, 3> &direction,
+                                const CompressedVolume &volume) const {
+  // the decoder is selected once per line of sight
+  double sum = volume.visit_interpolation([&](const auto &interpolate) {
+    double sum{};
+    for (size_t i{}; i != number_of_radial_cells; ++i) {
+      double radius = get_radial_cell_center(i);
+      std::array<double, 3> cell_location{
+          radius * direction[0], radius * direction[1], radius * direction[2]};
+      if (!grid.is_within_grid(cell_location)) {
+        break;
+      }
+      sum += interpolate(interpolation.locate(cell_location));
+    }
+    return sum;
+  });
+  return integration_factor * sum;
+}
+
+LineOfSightIntegral::distance_profile
+LineOfSightIntegral::resolve_distances(
+    const std::array<double, 3> &direction,
+    const std::vector<double> &bin_edges) const {
+  distance_profile profile{};
+  resolve_distances(direction, bin_edges, profile);
+  return profile;
+}
+
+void LineOfSightIntegral::resolve_distances(
+    const std::array<double, 3> &direction,
+    const std::vector<double> &bin_edges, distance_profile &profile) const {
+  size_t number_of_bins = bin_edges.empty() ? 0 : bin_edges.size() - 1;
+  profile.integral = 0.;
+  profile.histogram.assign(number_of_bins, 0.);
+  profile.mean_distance = 0.;
+  double weighted_distance_sum{};
+  // the radii increase, so the bin only moves forward
+  size_t bin{};
+  for (size_t i{}; i != number_of_radial_cells; ++i) {
+    double radius = get_radial_cell_center(i);
+    std::array<double, 3> cell_location{
+        radius * direction[0], radius * direction[1], radius * direction[2]};
+    if (!grid.is_within_grid(cell_location)) {
+      break;
+    }
+    double value = interpolation(cell_location);
+    profile.integral += value;
+    weighted_distance_sum += radius * value;
+    while (bin != number_of_bins && radius >= bin_edges[bin + 1]) {
+      ++bin;
+    }
+    if (bin != number_of_bins && radius >= bin_edges[bin]) {
+      profile.histogram[bin] += value;
+    }
+  }
+  if (profile.integral != 0.) {
+    profile.mean_distance = weighted_distance_sum / profile.integral;
+  }
+  profile.integral *= integration_factor;
+  for (auto &value : profile.histogram) {
+    value *= integration_factor;
+  }
+}
+
+LineOfSightIntegral::observer_gradient
+LineOfSightIntegral::differentiate_observer(
+    const std::array<double, 3> &direction) const {
+  observer_gradient result{};
+  double sum{};
+  std::array<double, 3> gradient_sum{};
+  size_t number_of_samples{};
+  for (; number_of_samples != number_of_radial_cells; ++number_of_samples) {
+    double radius = get_radial_cell_center(number_of_samples);
+    std::array<double, 3> cell_location{
+        radius * direction[0], radius * direction[1], radius * direction[2]};
+    if (!grid.is_within_grid(cell_location)) {
+      break;
+    }
+    auto value_and_gradient =
+        interpolation.interpolate_with_gradient(cell_location);
+    sum += value_and_gradient[0];
+    for (size_t axis{}; axis != 3; ++axis) {
+      gradient_sum[axis] += value_and_gradient[axis + 1];
+    }
+  }
+  result.integral = integration_factor * sum;
+  for (size_t axis{}; axis != 3; ++axis) {
+    result.gradient[axis] = integration_factor * gradient_sum[axis];
+  }
+  if (number_of_samples == 0) {
+    return result;
+  }
+
+  // the line of sight leaves the grid through the face of the exit axis at
+  // the distance (face - observer) / direction[exit axis]
+  std::array<const std::vector<double> *, 3> axes{
+      &grid.x_centers, &grid.y_centers, &grid.z_centers};
+  double exit_distance = std::numeric_limits<double>::infinity();
+  size_t exit_axis{};
+  for (size_t axis{}; axis != 3; ++axis) {
+    if (direction[axis] == 0.) {
+      continue;
+    }
+    double face =
+        direction[axis] > 0. ? axes[axis]->back() : axes[axis]->front();
+    double distance = face / direction[axis];
+    if (distance < exit_distance) {
+      exit_distance = distance;
+      exit_axis = axis;
+    }
+  }
+  double kpc_to_cm = integration_factor / radial_step_size;
+  std::array<double, 3> exit_location{exit_distance * direction[0],
+                                      exit_distance * direction[1],
+                                      exit_distance * direction[2]};
+  result.gradient[exit_axis] -=
+      kpc_to_cm * interpolation(exit_location) / direction[exit_axis];
+  return result;
+}
+
+double
+LineOfSightIntegral::integrate_planes(const std::array<double, 3> &direction,
+                                      const tensors::tensor_3d &planes,
+                                      size_t first_plane) const {
+  // cells [first_plane, end_cell) have both of their planes in the brick
+  size_t end_cell = first_plane + planes[0][0].size() - 1;
+  // the radial cells within the z range of the brick form an interval, which
+  // is estimated from the z coordinates (with a margin of one radial cell)
+  // and refined by the cell lookups
+  double first_cell = 0.;
+  auto last_cell = static_cast<double>(number_of_radial_cells);
+  if (direction[2] != 0.) {
+    double lower = grid.z_centers[first_plane] / direction[2];
+    double upper = grid.z_centers[end_cell] / direction[2];
+    if (lower > upper) {
+      std::swap(lower, upper);
+    }
+    first_cell = std::max(first_cell,
+                          std::floor(lower / radial_step_size - .5) - 1.);
+    last_cell =
+        std::min(last_cell, std::ceil(upper / radial_step_size - .5) + 2.);
+  } else {
+    // the line of sight stays within the z cell of the observer, so the
+    // other bricks are skipped without walking along it
+    auto observer_cell = interpolation.locate({0., 0., 0.});
+    if (observer_cell.z < first_plane || observer_cell.z >= end_cell) {
+      return 0.;
+    }
+  }
+  // like the full integral, the sum ends where the line of sight leaves the
+  // grid for the first time
+  if (number_of_radial_cells == 0) {
+    return 0.;
+  }
+  std::array<double, 3> first_location{half_step_size * direction[0],
+                                       half_step_size * direction[1],
+                                       half_step_size * direction[2]};
+  if (!grid.is_within_grid(first_location)) {
+    return 0.;
+  }
+  double sum{};
+  for (auto i = static_cast<size_t>(first_cell);
+       i < static_cast<size_t>(std::max(last_cell, first_cell)); ++i) {
+    double radius = get_radial_cell_center(i);
+    std::array<double, 3> cell_location{
+        radius * direction[0], radius * direction[1], radius * direction[2]};
+    if (!grid.is_within_grid(cell_location)) {
+      break;
+    }
+    // the lookup decides at the boundary planes
+    if (cell_location[2] < grid.z_centers[first_plane] ||
+        cell_location[2] > grid.z_centers[end_cell]) {
+      continue;
+    }
+    auto cell = interpolation.locate(cell_location);
+    if (cell.z < first_plane || cell.z >= end_cell) {
+      continue;
+    }
+    cell.z -= first_plane;
+    sum += TrilinearInterpolation::interpolate(cell, planes);
+  }
+  return integration_factor * sum;
+}
@@ -2,23 +2,80 @@
 #ifndef GAMMA_SKY_SRC_LINEOFSIGHTINTEGRAL_H
 #define GAMMA_SKY_SRC_LINEOFSIGHTINTEGRAL_H
 
+#include "CompressedVolume.h"
+#include "MacrocellGrid.h"
 #include "TrilinearInterpolation.h"
 #include "grids.h"
 #include "tensors.h"
 #include <array>
+#include <atomic>
+#include <optional>
 
 using std::size_t;
 
 class LineOfSightIntegral {
 public:
+  /**
+   * Integral resolved by the distance from the observer.
+   */
+  struct distance_profile {
+    double integral;
+    // histogram[bin] part of the integral whose radial cells lie within the
+    // distance bin
+    std::vector<double> histogram;
+    // integral-weighted mean distance in kpc (0 if the integral is 0)
+    double mean_distance;
+  };
+
+  /**
+   * Integral and its derivatives with respect to the location of the
+   * observer.
+   */
+  struct observer_gradient {
+    double integral;
+    // {d/dx, d/dy, d/dz} of the integral with respect to the observer
+    // location in (units of the integral) / kpc
+    std::array<double, 3> gradient;
+  };
+
   /**
    * @param radial_step_size radial step size
    * @param grid linear cartesian grid
    * @param values values[x][y][z] at the cartesian grid points
+   * @param skipping_tolerance blocks of cells get skipped as long as the
+   *                           bound of the skipped part of an integral stays
+   *                           below skipping_tolerance times its integrated
+   *                           part (0: no skipping)
+   *
+   * The integral is immutable after the construction (apart from the
+   * atomic error bound), so a single instance can be evaluated by all
+   * threads. The evaluations into buffers of the caller allocate no heap
+   * memory per line of sight.
    */
   LineOfSightIntegral(double radial_step_size,
                       const grids::cartesian_grid_3d &grid,
-                      const tensors::tensor_3d &values);
+                      const tensors::tensor_3d &values,
+                      double skipping_tolerance = 0.);
+  /**
+   * Integral without values of its own, which only evaluates volumes that
+   * are passed per evaluation (CompressedVolume).
+   * @param radial_step_size radial step size
+   * @param grid linear cartesian grid
+   */
+  LineOfSightIntegral(double radial_step_size,
+                      const grids::cartesian_grid_3d &grid);
+  /**
+   * Integral of other values, which shares the radial cells and the axis
+   * lookups of an integral on the same grid instead of rebuilding them, so
+   * an integral per volume is cheap to construct.
+   * @param integral integral whose setup is shared (it has to outlive this
+   *                 integral, since its grid is referenced)
+   * @param values values[x][y][z] at the cartesian grid points
+   * @param skipping_tolerance see above
+   */
+  LineOfSightIntegral(const LineOfSightIntegral &integral,
+                      const tensors::tensor_3d &values,
+                      double skipping_tolerance = 0.);
   /**
    * Evaluates the integral \int dr r² emissivity / (4 pi r²) at the specified
    * longitude and latitude.
@@ -26,19 +83,124 @@ public:
    * @param latitude latitude at which the integral should be evaluated
    * @return integral
    */
-  double operator()(double longitude, double latitude);
+  double operator()(double longitude, double latitude) const;
+  /**
+   * Evaluates the integral along a direction that was computed once per line
+   * of sight, e.g., by PixelDirections.
+   * @param direction unit vector {x, y, z}
+   * @return integral
+   */
+  double operator()(const std::array<double, 3> &direction) const;
+  /**
+   * Evaluates the integrals of several volumes on the grid of the integral
+   * along a single traversal of the line of sight, i.e., the cell and the
+   * interpolation weights of every radial cell are shared by all volumes
+   * (no blocks are skipped).
+   * @param direction unit vector {x, y, z}
+   * @param volumes volumes[i][x][y][z] at the cartesian grid points
+   * @return integrals[i]
+   */
+  std::vector<double> operator()(const std::array<double, 3> &direction,
+                                 const tensors::tensor_4d &volumes) const;
+  /**
+   * Evaluates the integrals of several volumes like the overload above, but
+   * into a buffer of the caller, which is reused for many lines of sight
+   * without heap allocations.
+   * @param integrals integrals[i] (resized to the number of volumes)
+   */
+  void operator()(const std::array<double, 3> &direction,
+                  const tensors::tensor_4d &volumes,
+                  std::vector<double> &integrals) const;
+  /**
+   * Evaluates the integral along a direction like operator() and resolves it
+   * by distance in the same traversal (no blocks are skipped).
+   * @param direction unit vector {x, y, z}
+   * @param bin_edges ascending edges of the distance bins [bin_edges[i],
+   *                  bin_edges[i + 1]) in kpc (radial cells outside of the
+   *                  bins only contribute to the integral and the mean
+   *                  distance)
+   * @return integral, histogram and mean distance
+   */
+  [[nodiscard]] distance_profile
+  resolve_distances(const std::array<double, 3> &direction,
+                    const std::vector<double> &bin_edges) const;
+  /**
+   * Resolves the integral by distance like the overload above, but into a
+   * profile of the caller, whose histogram is reused for many lines of
+   * sight without heap allocations.
+   */
+  void resolve_distances(const std::array<double, 3> &direction,
+                         const std::vector<double> &bin_edges,
+                         distance_profile &profile) const;
+  /**
+   * Evaluates the integral along a direction like operator() together with
+   * its derivatives with respect to the observer location in the same
+   * traversal (no blocks are skipped). The grid of the integral is relative
+   * to the observer, so moving the observer shifts every sample. The
+   * derivatives are the integrals of the analytic gradient of the trilinear
+   * interpolation plus the emissivity at the exit point times the
+   * derivative of the distance to the boundary of the grid.
+   * @param direction unit vector {x, y, z}
+   * @return integral and gradient
+   */
+  [[nodiscard]] observer_gradient
+  differentiate_observer(const std::array<double, 3> &direction) const;
+  /**
+   * Evaluates the part of the integral along a direction whose radial cells
+   * lie within the z cells covered by a brick of consecutive z planes of the
+   * volume (no blocks are skipped). Bricks that overlap by one plane split
+   * the integral exactly, so the bricks of a volume that doesn't fit into
+   * the memory can be integrated one after another. Only the grid of the
+   * integral is used, not its values. The line of sight is only walked
+   * within the z range of the brick (bricks that a horizontal line of sight
+   * doesn't reach return 0 right away).
+   * @param direction unit vector {x, y, z}
+   * @param planes planes[x][y][z - first_plane] of the brick (at least 2
+   *               planes)
+   * @param first_plane index of the first z plane of the brick
+   * @return partial integral
+   */
+  [[nodiscard]] double integrate_planes(const std::array<double, 3> &direction,
+                                        const tensors::tensor_3d &planes,
+                                        size_t first_plane) const;
+  /**
+   * Evaluates the integral of a compressed copy of a volume on the grid of
+   * the integral (no blocks are skipped).
+   * @param direction unit vector {x, y, z}
+   * @param volume compressed volume
+   * @return integral
+   */
+  double operator()(const std::array<double, 3> &direction,
+                    const CompressedVolume &volume) const;
+  /**
+   * @return largest relative error bound (bound of the skipped part divided
+   *         by the integral) of all integrals evaluated so far
+   */
+  [[nodiscard]] double get_maximum_relative_error_bound() const {
+    return maximum_relative_error_bound;
+  }
 
 private:
   // radial step sice in kpc
   double radial_step_size;
   // cartesian grid in kpc
   const grids::cartesian_grid_3d &grid;
-  // radial centers of the cells in kpc
-  std::vector<double> radial_cell_centers;
+  // number of radial cells that fit into the grid; the center of the radial
+  // cell i lies at (i + 1/2) radial_step_size, which is computed per sample
+  // instead of being tabulated
+  size_t number_of_radial_cells{};
+  double half_step_size{};
   TrilinearInterpolation interpolation;
   // integral = (integration factor) x (sum of radial cells)
   double integration_factor{};
+  double skipping_tolerance;
+  // maxima of blocks of cells (set if skipping_tolerance > 0)
+  std::optional<MacrocellGrid> macrocells;
+  mutable std::atomic<double> maximum_relative_error_bound{};
 
+  [[nodiscard]] double get_radial_cell_center(size_t i) const {
+    return half_step_size + static_cast<double>(i) * radial_step_size;
+  }
   void initialize_radial_cells();
   void initialize_integration_factor();
 };
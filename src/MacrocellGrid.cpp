@@ -0,0 +1,76 @@
+// Author: Stefan Lepperdinger
+#include "MacrocellGrid.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+MacrocellGrid::MacrocellGrid(const grids::cartesian_grid_3d &grid,
+                             const tensors::tensor_3d &values,
+                             size_t block_size)
+    : block_size(block_size), axes{grids::axis_lookup(grid.x_centers),
+                                   grids::axis_lookup(grid.y_centers),
+                                   grids::axis_lookup(grid.z_centers)} {
+  std::array<const std::vector<double> *, 3> centers{
+      &grid.x_centers, &grid.y_centers, &grid.z_centers};
+  for (size_t axis{}; axis != 3; ++axis) {
+    size_t number_of_cells = centers[axis]->size() - 1;
+    dimensions[axis] = (number_of_cells + block_size - 1) / block_size;
+    for (size_t block{}; block != dimensions[axis]; ++block) {
+      size_t first_point = block * block_size;
+      size_t last_point = std::min(first_point + block_size, number_of_cells);
+      bounds[axis].push_back(
+          {(*centers[axis])[first_point], (*centers[axis])[last_point]});
+    }
+  }
+
+  maxima.resize(dimensions[0] * dimensions[1] * dimensions[2]);
+  for (size_t x{}; x != values.size(); ++x) {
+    for (size_t y{}; y != values[x].size(); ++y) {
+      for (size_t z{}; z != values[x][y].size(); ++z) {
+        double magnitude = std::abs(values[x][y][z]);
+        // a grid point on the boundary of blocks belongs to all of them
+        for (size_t bx = x == 0 ? 0 : (x - 1) / block_size;
+             bx <= std::min(x / block_size, dimensions[0] - 1); ++bx) {
+          for (size_t by = y == 0 ? 0 : (y - 1) / block_size;
+               by <= std::min(y / block_size, dimensions[1] - 1); ++by) {
+            for (size_t bz = z == 0 ? 0 : (z - 1) / block_size;
+                 bz <= std::min(z / block_size, dimensions[2] - 1); ++bz) {
+              auto &maximum =
+                  maxima[(bx * dimensions[1] + by) * dimensions[2] + bz];
+              maximum = std::max(maximum, magnitude);
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+size_t MacrocellGrid::locate(const std::array<double, 3> &location) const {
+  std::array<size_t, 3> block{};
+  for (size_t axis{}; axis != 3; ++axis) {
+    size_t cell;
+    double fraction;
+    axes[axis].locate(location[axis], cell, fraction);
+    block[axis] = std::min(cell / block_size, dimensions[axis] - 1);
+  }
+  return (block[0] * dimensions[1] + block[1]) * dimensions[2] + block[2];
+}
+
+double
+MacrocellGrid::get_exit_distance(size_t block,
+                                 const std::array<double, 3> &direction) const {
+  std::array<size_t, 3> indices{block / (dimensions[1] * dimensions[2]),
+                                block / dimensions[2] % dimensions[1],
+                                block % dimensions[2]};
+  double distance = std::numeric_limits<double>::infinity();
+  for (size_t axis{}; axis != 3; ++axis) {
+    const auto &bound = bounds[axis][indices[axis]];
+    if (direction[axis] > 0.) {
+      distance = std::min(distance, bound[1] / direction[axis]);
+    } else if (direction[axis] < 0.) {
+      distance = std::min(distance, bound[0] / direction[axis]);
+    }
+  }
+  return distance;
+}
@@ -0,0 +1,62 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_MACROCELLGRID_H
+#define GAMMA_SKY_SRC_MACROCELLGRID_H
+
+#include "grids.h"
+#include "tensors.h"
+#include <array>
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Coarse grid of blocks of grid cells that stores the maximum absolute value
+ * of every block.
+ *
+ * A trilinear interpolation within a cell of a block only uses the grid
+ * points at the corners of the cells of the block, so the magnitude of every
+ * value interpolated within the block is bounded by the maximum of the block.
+ */
+class MacrocellGrid {
+public:
+  /**
+   * @param grid cartesian grid (only the centers are used)
+   * @param values values[x][y][z] at the grid points
+   * @param block_size number of cells per block along every axis
+   */
+  MacrocellGrid(const grids::cartesian_grid_3d &grid,
+                const tensors::tensor_3d &values, size_t block_size = 8);
+
+  /**
+   * @param location location within the grid (locations outside of the grid
+   *                 are clamped to the outermost blocks)
+   * @return index of the block that contains the location
+   */
+  [[nodiscard]] size_t locate(const std::array<double, 3> &location) const;
+  /**
+   * @return maximum absolute value of the block
+   */
+  [[nodiscard]] double get_maximum(size_t block) const {
+    return maxima[block];
+  }
+  /**
+   * @param block block that contains the ray
+   * @param direction unit vector of a ray that starts at the origin
+   * @return distance from the origin at which the ray leaves the block
+   */
+  [[nodiscard]] double
+  get_exit_distance(size_t block,
+                    const std::array<double, 3> &direction) const;
+
+private:
+  size_t block_size;
+  std::array<grids::axis_lookup, 3> axes;
+  // number of blocks along the axes
+  std::array<size_t, 3> dimensions{};
+  // bounds[axis][i] = {lower, upper} coordinate of the i-th block on the axis
+  std::array<std::vector<std::array<double, 2>>, 3> bounds;
+  // maxima[(x * dimensions[1] + y) * dimensions[2] + z]
+  std::vector<double> maxima;
+};
+
+#endif // GAMMA_SKY_SRC_MACROCELLGRID_H
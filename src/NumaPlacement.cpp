@@ -0,0 +1,147 @@
+// Author: Stefan Lepperdinger
+#include "NumaPlacement.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+NumaPlacement::policy NumaPlacement::parse_policy(const std::string &name) {
+  if (name == "first_touch") {
+    return policy::first_touch;
+  }
+  if (name == "replicate") {
+    return policy::replicate;
+  }
+  throw std::invalid_argument("Unknown NUMA policy '" + name +
+                              "'. Please set the parameter numa_policy in "
+                              "the parameter file to either 'first_touch' or "
+                              "'replicate'.");
+}
+
+NumaPlacement::NumaPlacement(policy placement_policy, bool huge_pages)
+    : huge_pages(huge_pages) {
+  // a single entry -1 if TBB can't detect the topology
+  nodes = tbb::info::numa_nodes();
+  if (placement_policy == policy::replicate && nodes.size() > 1) {
+    for (auto node : nodes) {
+      arenas.push_back(std::make_unique<tbb::task_arena>(
+          tbb::task_arena::constraints(node)));
+    }
+  }
+}
+
+std::string NumaPlacement::describe() const {
+  std::ostringstream description;
+  description << "NUMA placement: " << nodes.size() << " node(s), ";
+  if (arenas.empty()) {
+    description << "volumes first touched by all workers";
+  } else {
+    description << "one volume replica per node with pinned workers";
+  }
+  description << ", transparent huge pages "
+              << (huge_pages ? "advised" : "not advised") << '\n';
+  return description.str();
+}
+
+NumaPlacement::replicas
+NumaPlacement::replicate(const tensors::tensor_3d &volume) const {
+  replicas volume_replicas;
+  volume_replicas.volume = &volume;
+  if (arenas.size() < 2) {
+    if (huge_pages) {
+      advise_huge_pages(volume);
+    }
+    return volume_replicas;
+  }
+
+  size_t number_of_nodes = arenas.size();
+  volume_replicas.copies.resize(number_of_nodes);
+  std::vector<tbb::task_group> task_groups(number_of_nodes);
+  for (size_t node{}; node != number_of_nodes; ++node) {
+    arenas[node]->execute([&, node] {
+      task_groups[node].run([&, node] {
+        auto &copy = volume_replicas.copies[node];
+        copy = copy_locally(volume);
+        if (huge_pages) {
+          advise_huge_pages(copy);
+        }
+      });
+    });
+  }
+  for (size_t node{}; node != number_of_nodes; ++node) {
+    arenas[node]->execute([&, node] { task_groups[node].wait(); });
+  }
+  return volume_replicas;
+}
+
+tensors::tensor_3d
+NumaPlacement::copy_locally(const tensors::tensor_3d &volume) {
+  tensors::tensor_3d replica(volume.size());
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, volume.size()),
+                    [&](const tbb::blocked_range<size_t> &range) {
+                      for (size_t x = range.begin(); x != range.end(); ++x) {
+                        replica[x] = volume[x];
+                      }
+                    });
+  return replica;
+}
+
+void NumaPlacement::advise_huge_pages(const tensors::tensor_3d &volume) {
+#ifdef MADV_HUGEPAGE
+  for (const auto &range : find_huge_page_ranges(volume)) {
+    // fails harmlessly without transparent huge pages
+    madvise(reinterpret_cast<void *>(range[0]), range[1] - range[0],
+            MADV_HUGEPAGE);
+  }
+#else
+  static_cast<void>(volume);
+#endif
+}
+
+std::vector<std::array<std::uintptr_t, 2>>
+NumaPlacement::find_huge_page_ranges(const tensors::tensor_3d &volume) {
+  // the row array and the rows of a plane are allocated one after another,
+  // so every plane covers a compact address range; the ranges of the planes
+  // are merged across the allocation headers between them and shrunk to
+  // whole huge pages, such that the advice never covers memory outside of
+  // the volume
+  constexpr std::uintptr_t huge_page_size = std::uintptr_t{1} << 21;
+  constexpr std::uintptr_t allocation_header_size = 64;
+  std::vector<std::array<std::uintptr_t, 2>> plane_ranges;
+  for (const auto &plane : volume) {
+    auto rows = reinterpret_cast<std::uintptr_t>(plane.data());
+    std::uintptr_t lowest = rows;
+    std::uintptr_t highest = rows + plane.size() * sizeof(plane.front());
+    for (const auto &row : plane) {
+      auto begin = reinterpret_cast<std::uintptr_t>(row.data());
+      lowest = std::min(lowest, begin);
+      highest = std::max(highest, begin + row.size() * sizeof(double));
+    }
+    if (lowest < highest) {
+      plane_ranges.push_back({lowest, highest});
+    }
+  }
+  std::sort(plane_ranges.begin(), plane_ranges.end());
+  std::vector<std::array<std::uintptr_t, 2>> ranges;
+  std::uintptr_t mask = ~(huge_page_size - 1);
+  for (size_t i{}; i < plane_ranges.size();) {
+    auto range = plane_ranges[i];
+    for (++i; i < plane_ranges.size() &&
+              plane_ranges[i][0] <= range[1] + allocation_header_size;
+         ++i) {
+      range[1] = std::max(range[1], plane_ranges[i][1]);
+    }
+    std::uintptr_t begin = (range[0] + huge_page_size - 1) & mask;
+    std::uintptr_t end = range[1] & mask;
+    if (begin < end) {
+      ranges.push_back({begin, end});
+    }
+  }
+  return ranges;
+}
@@ -0,0 +1,164 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_NUMAPLACEMENT_H
+#define GAMMA_SKY_SRC_NUMAPLACEMENT_H
+
+#include "tensors.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tbb/info.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Places the emissivity volumes on the NUMA nodes of the machine.
+ *
+ * With the policy "first_touch", a volume stays where it was first touched:
+ * the input file reader fills the planes of a volume in parallel, which
+ * spreads them over the nodes of the TBB workers. With the policy
+ * "replicate", every node gets its own copy of the volume, which is allocated
+ * and first touched by workers pinned to that node, and the pixels are split
+ * among the nodes, such that every worker only reads its local copy. The
+ * copies are made once per volume (see replicate) and reused by all runs over
+ * the volume. Without several NUMA nodes (or without the hwloc based NUMA
+ * support of TBB), both policies use the volume as it is.
+ *
+ * Optionally, the memory of the volumes is advised to be backed by
+ * transparent huge pages, which reduces the TLB misses of the random 8-corner
+ * gathers of the trilinear interpolation.
+ */
+class NumaPlacement {
+public:
+  enum class policy { first_touch, replicate };
+
+  /**
+   * Copies of a volume on the NUMA nodes, which live as long as the object
+   * (without replication, the volume itself is used by all nodes).
+   */
+  class replicas {
+  public:
+    /**
+     * @return copy of the volume on the node (the volume itself without
+     *         replication)
+     */
+    [[nodiscard]] const tensors::tensor_3d &get_volume(size_t node) const {
+      return copies.empty() ? *volume : copies[node];
+    }
+
+  private:
+    friend class NumaPlacement;
+
+    const tensors::tensor_3d *volume{};
+    // copies[node] allocated on the node (empty without replication)
+    std::vector<tensors::tensor_3d> copies;
+  };
+
+  /**
+   * @param name either "first_touch" or "replicate"
+   * @throws std::invalid_argument for other names
+   */
+  static policy parse_policy(const std::string &name);
+
+  /**
+   * @param placement_policy placement of the volumes
+   * @param huge_pages advise transparent huge pages for the volumes
+   */
+  NumaPlacement(policy placement_policy, bool huge_pages);
+
+  /**
+   * @return number of NUMA nodes that get a replica (0 if the volumes aren't
+   *         replicated)
+   */
+  [[nodiscard]] size_t get_number_of_replicas() const {
+    return arenas.size() > 1 ? arenas.size() : 0;
+  }
+  /**
+   * @return description of the placement for the log
+   */
+  [[nodiscard]] std::string describe() const;
+
+  /**
+   * Copies the volume to every NUMA node (in parallel by the workers of the
+   * nodes) and advises huge pages for the copies if requested. Volumes that
+   * are integrated several times (e.g., by the levels of progressive
+   * previews) are replicated once and passed to every run.
+   * @param volume volume[x][y][z], which has to outlive the replicas
+   * @return replicas of the volume
+   */
+  [[nodiscard]] replicas replicate(const tensors::tensor_3d &volume) const;
+  /**
+   * Splits the values [0, number_of_values) among the NUMA nodes and calls
+   * body(local volume, first, last) within a task arena pinned to each node.
+   * Without replication, body(volume, 0, number_of_values) is called by the
+   * calling thread.
+   * @param volume_replicas replicas of the volume returned by replicate
+   */
+  template <typename Body>
+  void run(const replicas &volume_replicas, size_t number_of_values,
+           const Body &body) const;
+  /**
+   * Replicates a volume that is only run over once and runs over it like the
+   * overload above.
+   * @param volume volume[x][y][z] that gets replicated
+   */
+  template <typename Body>
+  void run(const tensors::tensor_3d &volume, size_t number_of_values,
+           const Body &body) const {
+    run(replicate(volume), number_of_values, body);
+  }
+
+  /**
+   * Advises the kernel to back the memory of the volume by transparent huge
+   * pages (no effect on systems without them).
+   */
+  static void advise_huge_pages(const tensors::tensor_3d &volume);
+  /**
+   * @return ascending address ranges [begin, end) of the whole huge pages
+   *         that lie within the memory of the planes of the volume (the
+   *         ranges of the advice of advise_huge_pages)
+   */
+  static std::vector<std::array<std::uintptr_t, 2>>
+  find_huge_page_ranges(const tensors::tensor_3d &volume);
+
+private:
+  /**
+   * @return copy of the volume whose planes are allocated and first touched
+   *         by the workers of the current task arena
+   */
+  static tensors::tensor_3d copy_locally(const tensors::tensor_3d &volume);
+
+  bool huge_pages;
+  std::vector<tbb::numa_node_id> nodes;
+  // arenas[node] pinned to the node (only if the volumes are replicated)
+  std::vector<std::unique_ptr<tbb::task_arena>> arenas;
+};
+
+template <typename Body>
+void NumaPlacement::run(const replicas &volume_replicas,
+                        size_t number_of_values, const Body &body) const {
+  if (arenas.size() < 2) {
+    body(volume_replicas.get_volume(0), size_t{0}, number_of_values);
+    return;
+  }
+
+  size_t number_of_nodes = arenas.size();
+  std::vector<tbb::task_group> task_groups(number_of_nodes);
+  for (size_t node{}; node != number_of_nodes; ++node) {
+    size_t first = number_of_values * node / number_of_nodes;
+    size_t last = number_of_values * (node + 1) / number_of_nodes;
+    arenas[node]->execute([&, node, first, last] {
+      task_groups[node].run([&, node, first, last] {
+        body(volume_replicas.get_volume(node), first, last);
+      });
+    });
+  }
+  for (size_t node{}; node != number_of_nodes; ++node) {
+    arenas[node]->execute([&, node] { task_groups[node].wait(); });
+  }
+}
+
+#endif // GAMMA_SKY_SRC_NUMAPLACEMENT_H
@@ -1,14 +1,27 @@
 // Author: Stefan Lepperdinger
 #include "ParameterFile.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <regex>
+#include <stdexcept>
 
 #define DEGREES_TO_RADIAN 0.017453292519943295
 
 ParameterFile::ParameterFile(const std::string &file_path)
     : file_path(file_path) {}
 
-std::string ParameterFile::get_string(const std::string &parameter_name) {
+ParameterFile::ParameterFile(const std::string &file_path,
+                             std::map<std::string, std::string> overrides)
+    : file_path(file_path), overrides(std::move(overrides)) {}
+
+bool ParameterFile::find_string(const std::string &parameter_name,
+                                std::string &parameter_string) {
+  auto override = overrides.find(parameter_name);
+  if (override != overrides.end()) {
+    parameter_string = override->second;
+    return true;
+  }
   std::string line;
   std::ifstream file(file_path);
   std::ostringstream regular_expression;
@@ -18,12 +31,52 @@ std::string ParameterFile::get_string(const std::string &parameter_name) {
   while (std::getline(file, line)) {
     bool found_line = std::regex_match(line.c_str(), match, regex);
     if (found_line) {
-      return match[1];
+      parameter_string = match[1];
+      return true;
     }
   }
-  std::cerr << "error: Couldn't find the parameter '" << parameter_name
-            << "' of the parameter file '" << file_path << "'.\n";
-  std::exit(1);
+  return false;
+}
+
+std::string ParameterFile::get_string(const std::string &parameter_name) {
+  std::string parameter_string;
+  if (find_string(parameter_name, parameter_string)) {
+    return parameter_string;
+  }
+  throw std::invalid_argument("Couldn't find the parameter '" +
+                              parameter_name + "' of the parameter file '" +
+                              file_path + "'.");
+}
+
+bool ParameterFile::has_parameter(const std::string &parameter_name) {
+  std::string parameter_string;
+  return find_string(parameter_name, parameter_string);
+}
+
+std::string
+ParameterFile::get_optional_string(const std::string &parameter_name,
+                                   const std::string &default_value) {
+  std::string parameter_string;
+  if (find_string(parameter_name, parameter_string)) {
+    return parameter_string;
+  }
+  return default_value;
+}
+
+int ParameterFile::get_optional_int(const std::string &parameter_name,
+                                    int default_value) {
+  if (!has_parameter(parameter_name)) {
+    return default_value;
+  }
+  return get_int(parameter_name);
+}
+
+double ParameterFile::get_optional_double(const std::string &parameter_name,
+                                          double default_value) {
+  if (!has_parameter(parameter_name)) {
+    return default_value;
+  }
+  return get_double(parameter_name);
 }
 
 int ParameterFile::get_int(const std::string &parameter_name) {
@@ -31,10 +84,11 @@ int ParameterFile::get_int(const std::string &parameter_name) {
   int parameter;
   try {
     parameter = std::stoi(parameter_string);
-  } catch (std::invalid_argument &invalid_argument) {
-    std::cerr << "error: Parsing of the parameter '" << parameter_name
-              << "' of the parameter file '" << file_path << "' failed.\n";
-    std::exit(1);
+  } catch (std::logic_error &) {
+    // std::invalid_argument or std::out_of_range
+    throw std::invalid_argument("Parsing of the parameter '" + parameter_name +
+                                "' of the parameter file '" + file_path +
+                                "' failed.");
   }
   return parameter;
 }
@@ -44,14 +98,80 @@ double ParameterFile::get_double(const std::string &parameter_name) {
   double parameter;
   try {
     parameter = std::stod(parameter_string);
-  } catch (std::invalid_argument &invalid_argument) {
-    std::cerr << "error: Parsing of the parameter '" << parameter_name
-              << "' of the parameter file '" << file_path << "' failed.\n";
-    std::exit(1);
+  } catch (std::logic_error &) {
+    // std::invalid_argument or std::out_of_range
+    throw std::invalid_argument("Parsing of the parameter '" + parameter_name +
+                                "' of the parameter file '" + file_path +
+                                "' failed.");
   }
   return parameter;
 }
 
+std::vector<std::array<double, 2>>
+ParameterFile::get_optional_intervals(const std::string &parameter_name) {
+  std::vector<std::array<double, 2>> intervals;
+  std::string parameter_string;
+  if (!find_string(parameter_name, parameter_string)) {
+    return intervals;
+  }
+  std::regex interval_regex(" *([^:, ]+) *: *([^:, ]+) *(,|$)");
+  auto begin = std::sregex_iterator(parameter_string.cbegin(),
+                                    parameter_string.cend(), interval_regex);
+  size_t parsed_length{};
+  for (auto match = begin; match != std::sregex_iterator(); ++match) {
+    try {
+      intervals.push_back({std::stod((*match)[1]), std::stod((*match)[2])});
+    } catch (std::logic_error &) {
+      parsed_length = 0;
+      break;
+    }
+    parsed_length += match->length();
+  }
+  if (parsed_length != parameter_string.size()) {
+    throw std::invalid_argument(
+        "Parsing of the parameter '" + parameter_name +
+        "' of the parameter file '" + file_path +
+        "' failed. Expected intervals like '1e3:1e4, 1e4:1e5'.");
+  }
+  return intervals;
+}
+
+std::vector<std::string>
+ParameterFile::get_optional_list(const std::string &parameter_name) {
+  std::vector<std::string> words;
+  std::string parameter_string;
+  if (!find_string(parameter_name, parameter_string)) {
+    return words;
+  }
+  std::regex word_regex("[^, ]+");
+  for (auto match = std::sregex_iterator(parameter_string.cbegin(),
+                                         parameter_string.cend(), word_regex);
+       match != std::sregex_iterator(); ++match) {
+    words.push_back(match->str());
+  }
+  return words;
+}
+
+std::vector<double>
+ParameterFile::get_optional_numbers(const std::string &parameter_name) {
+  std::vector<double> numbers;
+  for (const auto &word : get_optional_list(parameter_name)) {
+    size_t parsed_length{};
+    try {
+      numbers.push_back(std::stod(word, &parsed_length));
+    } catch (std::logic_error &) {
+      parsed_length = 0;
+    }
+    if (parsed_length != word.size()) {
+      throw std::invalid_argument(
+          "Parsing of the parameter '" + parameter_name +
+          "' of the parameter file '" + file_path +
+          "' failed. Expected numbers like '0, 0.5, 1, 2'.");
+    }
+  }
+  return numbers;
+}
+
 ParameterFile::Parameters ParameterFile::get_parameters() {
   Parameters parameters{};
   parameters.xyz_observer_location = {
@@ -65,5 +185,80 @@ ParameterFile::Parameters ParameterFile::get_parameters() {
   parameters.line_of_sight_latitude =
       get_double("line_of_sight_latitude_in_degrees") * DEGREES_TO_RADIAN;
   parameters.healpix_order = get_int("healpix_order");
+  parameters.use_projection_operator =
+      get_optional_int("use_projection_operator", 0) != 0;
+  parameters.projection_operator_file =
+      get_optional_string("projection_operator_file", "");
+  parameters.energy_decomposition_components =
+      get_optional_int("energy_decomposition_components", 0);
+  parameters.energy_bands = get_optional_intervals("energy_bands_in_MeV");
+  parameters.requested_energies =
+      get_optional_numbers("requested_energies_in_MeV");
+  parameters.compute_energy_skies =
+      get_optional_int("compute_energy_skies", 1) != 0;
+  parameters.progressive_preview =
+      get_optional_int("progressive_preview", 0) != 0;
+  parameters.cone_tracing = get_optional_int("cone_tracing", 0) != 0;
+  parameters.skipping_tolerance =
+      get_optional_double("empty_space_skipping_tolerance", 0.);
+  parameters.symmetry_tolerance =
+      get_optional_double("symmetry_tolerance", 1e-6);
+  parameters.emissivity_components =
+      get_optional_list("emissivity_components");
+  for (const auto &pattern : parameters.emissivity_components) {
+    if (std::count(pattern.cbegin(), pattern.cend(), '*') != 1) {
+      throw std::invalid_argument(
+          "The emissivity component '" + pattern +
+          "' of the parameter file '" + file_path +
+          "' has to contain exactly one '*' for the energy index, e.g., "
+          "'pion_decay_emission_E*'.");
+    }
+  }
+  parameters.distance_bin_edges = get_optional_numbers("distance_bins_in_kpc");
+  parameters.observer_gradient =
+      get_optional_int("observer_gradient", 0) != 0;
+  parameters.volume_compression =
+      get_optional_string("volume_compression", "none");
+  parameters.numa_policy = get_optional_string("numa_policy", "first_touch");
+  parameters.huge_pages = get_optional_int("huge_pages", 0) != 0;
+  parameters.ray_scheduling =
+      get_optional_string("ray_scheduling", "equal_count");
+  parameters.out_of_core_brick_planes =
+      get_optional_int("out_of_core_brick_planes", 0);
+  parameters.max_memory = get_optional_double("max_memory_in_GB", 0.) * 1e9;
   return parameters;
 }
+
+namespace {
+
+bool nearly_equal(double a, double b) {
+  double tolerance = 1e-6 * std::max({1., std::abs(a), std::abs(b)});
+  return std::abs(a - b) <= tolerance;
+}
+
+} // namespace
+
+bool ParameterFile::Parameters::has_same_geometry(
+    const Parameters &other) const {
+  bool same_observer_location =
+      std::equal(xyz_observer_location.cbegin(), xyz_observer_location.cend(),
+                 other.xyz_observer_location.cbegin(), nearly_equal);
+  return same_observer_location &&
+         nearly_equal(radial_step_size, other.radial_step_size) &&
+         nearly_equal(line_of_sight_longitude, other.line_of_sight_longitude) &&
+         nearly_equal(line_of_sight_latitude, other.line_of_sight_latitude) &&
+         healpix_order == other.healpix_order &&
+         cone_tracing == other.cone_tracing &&
+         nearly_equal(skipping_tolerance, other.skipping_tolerance);
+}
+
+bool ParameterFile::Parameters::has_same_approximations(
+    const Parameters &other) const {
+  // all negative symmetry tolerances disable the mirror symmetries
+  bool same_symmetries =
+      (symmetry_tolerance < 0. && other.symmetry_tolerance < 0.) ||
+      nearly_equal(symmetry_tolerance, other.symmetry_tolerance);
+  return energy_decomposition_components ==
+             other.energy_decomposition_components &&
+         same_symmetries && volume_compression == other.volume_compression;
+}
@@ -4,7 +4,12 @@
 
 #include <array>
 #include <fstream>
+#include <map>
+#include <optional>
 #include <string>
+#include <vector>
+
+using std::size_t;
 
 class ParameterFile {
 public:
@@ -19,15 +24,127 @@ public:
     double line_of_sight_latitude;
     // determines the number of pixels of the gamma sky
     int healpix_order;
+    // evaluate the skies via a precomputed sparse projection operator instead
+    // of ray marching every energy separately
+    bool use_projection_operator;
+    // file in which the projection operator gets cached (empty: no caching)
+    std::string projection_operator_file;
+    // number of basis volumes of the truncated energy decomposition that get
+    // integrated instead of every energy (0: disabled)
+    int energy_decomposition_components;
+    // {lower, upper} edges of the energy bands in MeV for which integrated
+    // skies are computed
+    std::vector<std::array<double, 2>> energy_bands;
+    // energies in MeV at which skies are interpolated (log-log) between the
+    // skies of the bracketing energies of the input file, which are the only
+    // energies that get loaded and integrated (empty: disabled)
+    std::vector<double> requested_energies;
+    // compute the skies of the individual energies (can be disabled if only
+    // the energy band skies are needed)
+    bool compute_energy_skies;
+    // compute the skies level by level with increasing HEALPix order and save
+    // a preview sky after every level
+    bool progressive_preview;
+    // integrate the emissivities averaged over the cones of the pixels (mip
+    // pyramid) instead of sampling the finest grid along the central rays
+    bool cone_tracing;
+    // relative tolerance up to which blocks of low emissivity get skipped by
+    // the line of sight integration (0: disabled)
+    double skipping_tolerance;
+    // largest relative difference of mirrored emissivities for which a mirror
+    // symmetry of the volume is used to compute only a part of the sky
+    // (negative: disabled)
+    double symmetry_tolerance;
+    // dataset patterns of the emissivity components within the group "/Data"
+    // of the input file ('*' stands for the energy index) whose skies are
+    // computed separately (empty: the total emission only)
+    std::vector<std::string> emissivity_components;
+    // ascending edges of the distance bins in kpc over which the skies are
+    // resolved (empty: disabled)
+    std::vector<double> distance_bin_edges;
+    // compute the derivatives of the skies with respect to the observer
+    // location along the same traversal
+    bool observer_gradient;
+    // 16 bit encoding of the integrated emissivity volumes ("none", "fp16",
+    // "bfloat16" or "log16")
+    std::string volume_compression;
+    // placement of the emissivity volumes on the NUMA nodes ("first_touch" or
+    // "replicate")
+    std::string numa_policy;
+    // advise transparent huge pages for the emissivity volumes
+    bool huge_pages;
+    // split of the lines of sight among the workers ("equal_count" or
+    // "cost_balanced")
+    std::string ray_scheduling;
+    // number of z plane cells of the bricks in which the emissivity volumes
+    // are read and integrated if they don't fit into the memory (0: disabled)
+    int out_of_core_brick_planes;
+    // memory that the run may use in bytes (0: unlimited)
+    double max_memory;
+    // HEALPix pixels [first, last) computed by this process (set via the
+    // command line for sharded runs; all pixels if unset)
+    std::optional<std::array<size_t, 2>> pixel_range;
+    // ascending indices of the energies computed by this process (set via the
+    // command line for sharded runs; all energies if unset)
+    std::optional<std::vector<size_t>> energy_indices;
+
+    /**
+     * Compares the parameters that determine the sky pixels and the lines of
+     * sight. Parameters read back from an H5 file were stored in single
+     * precision, so the comparison is done with a relative tolerance.
+     */
+    [[nodiscard]] bool has_same_geometry(const Parameters &other) const;
+    /**
+     * Compares the parameters that select the approximations of the sky
+     * values besides the geometry: the energy decomposition, the mirror
+     * symmetries and the volume compression.
+     */
+    [[nodiscard]] bool
+    has_same_approximations(const Parameters &other) const;
   };
+  /**
+   * @throws std::invalid_argument by get_parameters if a parameter is missing
+   *         or malformed
+   */
   explicit ParameterFile(const std::string &file_path);
+  /**
+   * @param overrides parameter values that replace the ones of the file, e.g.,
+   *                  {{"healpix_order", "6"}}
+   */
+  ParameterFile(const std::string &file_path,
+                std::map<std::string, std::string> overrides);
   Parameters get_parameters();
 
 private:
+  bool find_string(const std::string &parameter_name,
+                   std::string &parameter_string);
   std::string get_string(const std::string &parameter_name);
   int get_int(const std::string &parameter_name);
   double get_double(const std::string &parameter_name);
+  bool has_parameter(const std::string &parameter_name);
+  std::string get_optional_string(const std::string &parameter_name,
+                                  const std::string &default_value);
+  int get_optional_int(const std::string &parameter_name, int default_value);
+  double get_optional_double(const std::string &parameter_name,
+                             double default_value);
+  /**
+   * Parses a list of intervals of the form "a:b, c:d, ...".
+   * @return intervals (empty if the parameter is absent)
+   */
+  std::vector<std::array<double, 2>>
+  get_optional_intervals(const std::string &parameter_name);
+  /**
+   * Parses a comma separated list of words.
+   * @return words (empty if the parameter is absent)
+   */
+  std::vector<std::string> get_optional_list(const std::string &parameter_name);
+  /**
+   * Parses a comma separated list of numbers.
+   * @return numbers (empty if the parameter is absent)
+   */
+  std::vector<double> get_optional_numbers(const std::string &parameter_name);
   const std::string &file_path;
+  std::map<std::string, std::string> overrides;
 };
 
 #endif // GAMMA_SKY_SRC_PARAMETERFILE_H
@@ -0,0 +1,21 @@
+// Author: Stefan Lepperdinger
+#include "PixelDirections.h"
+#include "mathematics.h"
+
+PixelDirections::PixelDirections(size_t number_of_pixels)
+    : x(number_of_pixels), y(number_of_pixels), z(number_of_pixels) {}
+
+PixelDirections::PixelDirections(const tensors::tensor_2d &sky_coordinates)
+    : PixelDirections(sky_coordinates.size()) {
+  for (size_t pixel{}; pixel != sky_coordinates.size(); ++pixel) {
+    set(pixel, make_direction(sky_coordinates[pixel][0],
+                              sky_coordinates[pixel][1]));
+  }
+}
+
+std::array<double, 3> PixelDirections::make_direction(double longitude,
+                                                      double latitude) {
+  auto direction = mathematics::spherical_to_cartesian(1., longitude, latitude);
+  return {static_cast<float>(direction[0]), static_cast<float>(direction[1]),
+          static_cast<float>(direction[2])};
+}
@@ -0,0 +1,58 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_PIXELDIRECTIONS_H
+#define GAMMA_SKY_SRC_PIXELDIRECTIONS_H
+
+#include "tensors.h"
+#include <array>
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Unit vectors of the lines of sight of sky pixels, stored as single precision
+ * structure of arrays (12 bytes per pixel).
+ *
+ * The rays only need the unit vector of their direction, which is computed
+ * once per pixel instead of evaluating sines and cosines for every radial
+ * sample. make_direction rounds to single precision as well, such that
+ * directions computed on the fly equal stored ones.
+ */
+class PixelDirections {
+public:
+  PixelDirections() = default;
+  /**
+   * @param number_of_pixels number of pixels (the directions are set via set)
+   */
+  explicit PixelDirections(size_t number_of_pixels);
+  /**
+   * @param sky_coordinates sky_coordinates[pixel] = {longitude, latitude} in
+   *                        radian
+   */
+  explicit PixelDirections(const tensors::tensor_2d &sky_coordinates);
+
+  /**
+   * @param longitude longitude in radian
+   * @param latitude latitude in radian
+   * @return unit vector {x, y, z} rounded to single precision
+   */
+  static std::array<double, 3> make_direction(double longitude,
+                                              double latitude);
+
+  [[nodiscard]] size_t size() const { return x.size(); }
+  [[nodiscard]] bool empty() const { return x.empty(); }
+  [[nodiscard]] std::array<double, 3> operator[](size_t pixel) const {
+    return {x[pixel], y[pixel], z[pixel]};
+  }
+  void set(size_t pixel, const std::array<double, 3> &direction) {
+    x[pixel] = static_cast<float>(direction[0]);
+    y[pixel] = static_cast<float>(direction[1]);
+    z[pixel] = static_cast<float>(direction[2]);
+  }
+
+private:
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+};
+
+#endif // GAMMA_SKY_SRC_PIXELDIRECTIONS_H
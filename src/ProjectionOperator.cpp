@@ -0,0 +1,231 @@
+// Author: Stefan Lepperdinger
+#include "ProjectionOperator.h"
+#include "mathematics.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+ProjectionOperator::ProjectionOperator(const line_of_sight_geometry &geometry,
+                                       const grids::cartesian_grid_3d &grid,
+                                       const PixelDirections &directions)
+    : geometry(geometry),
+      grid_dimensions({grid.x_centers.size(), grid.y_centers.size(),
+                       grid.z_centers.size()}),
+      grid_centers({grid.x_centers, grid.y_centers, grid.z_centers}) {
+  size_t number_of_grid_points =
+      grid_dimensions[0] * grid_dimensions[1] * grid_dimensions[2];
+  if (number_of_grid_points > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::invalid_argument(
+        "ProjectionOperator: the grid has too many points for 32 bit column "
+        "indices");
+  }
+
+  std::array<grids::axis_lookup, 3> axes{grids::axis_lookup(grid.x_centers),
+                                         grids::axis_lookup(grid.y_centers),
+                                         grids::axis_lookup(grid.z_centers)};
+  size_t number_of_pixels = directions.size();
+  std::vector<std::vector<Entry>> rows(number_of_pixels);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, number_of_pixels),
+                    [&](const tbb::blocked_range<size_t> &range) {
+                      for (size_t pixel = range.begin(); pixel != range.end();
+                           ++pixel) {
+                        rows[pixel] =
+                            assemble_row(geometry.radial_step_size, grid, axes,
+                                         directions[pixel]);
+                      }
+                    });
+
+  row_offsets.reserve(number_of_pixels + 1);
+  row_offsets.push_back(0);
+  for (const auto &row : rows) {
+    row_offsets.push_back(row_offsets.back() + row.size());
+  }
+  column_indices.resize(row_offsets.back());
+  weights.resize(row_offsets.back());
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, number_of_pixels),
+                    [&](const tbb::blocked_range<size_t> &range) {
+                      for (size_t pixel = range.begin(); pixel != range.end();
+                           ++pixel) {
+                        size_t offset = row_offsets[pixel];
+                        for (const auto &entry : rows[pixel]) {
+                          column_indices[offset] = entry.column_index;
+                          weights[offset] = static_cast<float>(entry.weight);
+                          ++offset;
+                        }
+                      }
+                    });
+}
+
+ProjectionOperator::ProjectionOperator(
+    const line_of_sight_geometry &geometry,
+    std::array<std::vector<double>, 3> grid_centers,
+    std::vector<std::uint64_t> row_offsets,
+    std::vector<std::uint32_t> column_indices, std::vector<float> weights)
+    : geometry(geometry),
+      grid_dimensions({grid_centers[0].size(), grid_centers[1].size(),
+                       grid_centers[2].size()}),
+      grid_centers(std::move(grid_centers)),
+      row_offsets(std::move(row_offsets)),
+      column_indices(std::move(column_indices)), weights(std::move(weights)) {
+  check_consistency();
+}
+
+void ProjectionOperator::check_consistency() const {
+  size_t number_of_grid_points =
+      grid_dimensions[0] * grid_dimensions[1] * grid_dimensions[2];
+  bool consistent = !row_offsets.empty() && row_offsets.front() == 0 &&
+                    row_offsets.back() == column_indices.size() &&
+                    column_indices.size() == weights.size() &&
+                    std::is_sorted(row_offsets.cbegin(), row_offsets.cend());
+  consistent = consistent &&
+               std::all_of(column_indices.cbegin(), column_indices.cend(),
+                           [&](std::uint32_t column_index) {
+                             return column_index < number_of_grid_points;
+                           });
+  if (!consistent) {
+    throw std::invalid_argument(
+        "ProjectionOperator: inconsistent sparse matrix data");
+  }
+}
+
+std::vector<ProjectionOperator::Entry>
+ProjectionOperator::assemble_row(double radial_step_size,
+                                 const grids::cartesian_grid_3d &grid,
+                                 const std::array<grids::axis_lookup, 3> &axes,
+                                 const std::array<double, 3> &direction) const {
+  // same radial cells, cell lookup and integration factor as
+  // LineOfSightIntegral and TrilinearInterpolation
+  double x_range = grid.x_centers.back() - grid.x_centers.front();
+  double y_range = grid.y_centers.back() - grid.y_centers.front();
+  double z_range = grid.z_centers.back() - grid.z_centers.front();
+  double maximum_possible_distance =
+      mathematics::euclidean_norm({x_range, y_range, z_range});
+  auto maximum_number_of_radial_bins =
+      static_cast<size_t>(maximum_possible_distance / radial_step_size);
+  double half_step_size = radial_step_size * .5;
+
+  double pc_to_m = 3.0856775814913673e16;
+  double kpc_to_cm = 1e3 * 1e2 * pc_to_m;
+  double integration_factor = radial_step_size * kpc_to_cm;
+
+  size_t y_dimension = grid_dimensions[1];
+  size_t z_dimension = grid_dimensions[2];
+
+  std::vector<Entry> entries;
+  // weights of the 8 corners of the current cell, accumulated as long as
+  // consecutive samples stay within the same cell
+  std::array<double, 8> corner_weights{};
+  size_t current_cell = std::numeric_limits<size_t>::max();
+  auto flush_cell = [&]() {
+    if (current_cell == std::numeric_limits<size_t>::max()) {
+      return;
+    }
+    for (size_t corner{}; corner != 8; ++corner) {
+      size_t dx = (corner >> 2) & 1;
+      size_t dy = (corner >> 1) & 1;
+      size_t dz = corner & 1;
+      size_t column_index =
+          current_cell + (dx * y_dimension + dy) * z_dimension + dz;
+      entries.push_back({static_cast<std::uint32_t>(column_index),
+                         corner_weights[corner] * integration_factor});
+    }
+    corner_weights.fill(0.);
+  };
+
+  for (size_t i{}; i != maximum_number_of_radial_bins; ++i) {
+    double radius = half_step_size + static_cast<double>(i) * radial_step_size;
+    std::array<double, 3> cell_location{
+        radius * direction[0], radius * direction[1], radius * direction[2]};
+    if (!grid.is_within_grid(cell_location)) {
+      break;
+    }
+    size_t x_i, y_i, z_i;
+    double x_p, y_p, z_p;
+    axes[0].locate(cell_location[0], x_i, x_p);
+    axes[1].locate(cell_location[1], y_i, y_p);
+    axes[2].locate(cell_location[2], z_i, z_p);
+
+    size_t cell = (x_i * y_dimension + y_i) * z_dimension + z_i;
+    if (cell != current_cell) {
+      flush_cell();
+      current_cell = cell;
+    }
+    // corner index = dx << 2 | dy << 1 | dz
+    corner_weights[0b000] += (1 - x_p) * (1 - y_p) * (1 - z_p);
+    corner_weights[0b001] += (1 - x_p) * (1 - y_p) * z_p;
+    corner_weights[0b010] += (1 - x_p) * y_p * (1 - z_p);
+    corner_weights[0b011] += (1 - x_p) * y_p * z_p;
+    corner_weights[0b100] += x_p * (1 - y_p) * (1 - z_p);
+    corner_weights[0b101] += x_p * (1 - y_p) * z_p;
+    corner_weights[0b110] += x_p * y_p * (1 - z_p);
+    corner_weights[0b111] += x_p * y_p * z_p;
+  }
+  flush_cell();
+
+  // merge the entries of grid points that are shared by several cells
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              return a.column_index < b.column_index;
+            });
+  std::vector<Entry> merged_entries;
+  for (const auto &entry : entries) {
+    if (!merged_entries.empty() &&
+        merged_entries.back().column_index == entry.column_index) {
+      merged_entries.back().weight += entry.weight;
+    } else {
+      merged_entries.push_back(entry);
+    }
+  }
+  return merged_entries;
+}
+
+std::vector<double>
+ProjectionOperator::flatten(const tensors::tensor_3d &values) const {
+  if (values.size() != grid_dimensions[0] ||
+      values.front().size() != grid_dimensions[1] ||
+      values.front().front().size() != grid_dimensions[2]) {
+    throw std::invalid_argument(
+        "ProjectionOperator: the values don't match the grid dimensions");
+  }
+  size_t y_dimension = grid_dimensions[1];
+  size_t z_dimension = grid_dimensions[2];
+  std::vector<double> flat_values(grid_dimensions[0] * y_dimension *
+                                  z_dimension);
+  tbb::parallel_for(size_t{}, grid_dimensions[0], [&](size_t x) {
+    for (size_t y{}; y != y_dimension; ++y) {
+      std::copy(values[x][y].cbegin(), values[x][y].cend(),
+                flat_values.begin() + (x * y_dimension + y) * z_dimension);
+    }
+  });
+  return flat_values;
+}
+
+tensors::tensor_1d
+ProjectionOperator::operator()(const tensors::tensor_3d &values) const {
+  auto flat_values = flatten(values);
+  tensors::tensor_1d sky(get_number_of_pixels());
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, sky.size()),
+                    [&](const tbb::blocked_range<size_t> &range) {
+                      for (size_t pixel = range.begin(); pixel != range.end();
+                           ++pixel) {
+                        sky[pixel] = multiply_row(flat_values, pixel);
+                      }
+                    });
+  return sky;
+}
+
+tensors::tensor_1d
+ProjectionOperator::operator()(const tensors::tensor_3d &values,
+                               const std::vector<size_t> &pixels) const {
+  auto flat_values = flatten(values);
+  tensors::tensor_1d sky(pixels.size());
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, sky.size()),
+                    [&](const tbb::blocked_range<size_t> &range) {
+                      for (size_t i = range.begin(); i != range.end(); ++i) {
+                        sky[i] = multiply_row(flat_values, pixels[i]);
+                      }
+                    });
+  return sky;
+}
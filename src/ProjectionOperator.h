@@ -0,0 +1,154 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_PROJECTIONOPERATOR_H
+#define GAMMA_SKY_SRC_PROJECTIONOPERATOR_H
+
+#include "PixelDirections.h"
+#include "grids.h"
+#include "tensors.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Sparse matrix in CSR format that maps an emissivity volume onto the sky.
+ *
+ * For a fixed observer, grid and set of sky pixels, the line of sight integral
+ * is linear in the emissivities: every radial sample contributes fixed
+ * trilinear weights to 8 grid points. Row `pixel` of the operator holds the
+ * summed weights of all grid points touched by the line of sight of that
+ * pixel, such that evaluating a sky reduces to a sparse matrix-vector product.
+ */
+class ProjectionOperator {
+public:
+  /**
+   * Parameters of the lines of sight besides the grid and the observer: the
+   * radial step size and the parameters that determine the pixel directions.
+   */
+  struct line_of_sight_geometry {
+    // radial step size in kpc
+    double radial_step_size;
+    // longitude and latitude of the line of sight in radian
+    double longitude;
+    double latitude;
+    // HEALPix pixel of the first row
+    size_t first_pixel;
+
+    bool operator==(const line_of_sight_geometry &other) const {
+      return radial_step_size == other.radial_step_size &&
+             longitude == other.longitude && latitude == other.latitude &&
+             first_pixel == other.first_pixel;
+    }
+  };
+
+  /**
+   * Assembles the operator by marching along every line of sight once.
+   * @param geometry radial step size and parameters of the pixel directions
+   * @param grid cartesian grid relative to the observer in kpc
+   * @param directions directions of the lines of sight of the pixels
+   */
+  ProjectionOperator(const line_of_sight_geometry &geometry,
+                     const grids::cartesian_grid_3d &grid,
+                     const PixelDirections &directions);
+  /**
+   * Wraps an already assembled operator, e.g., one that was read from a file.
+   * @param geometry radial step size and parameters of the pixel directions
+   *                 the operator was assembled for
+   * @param grid_centers {x, y, z} centers of the grid relative to the observer
+   *                     in kpc the operator was assembled for
+   * @param row_offsets the weights of pixel i are located within
+   *                    [row_offsets[i], row_offsets[i + 1])
+   * @param column_indices flat grid indices (x * n_y + y) * n_z + z
+   * @param weights weights in cm
+   */
+  ProjectionOperator(const line_of_sight_geometry &geometry,
+                     std::array<std::vector<double>, 3> grid_centers,
+                     std::vector<std::uint64_t> row_offsets,
+                     std::vector<std::uint32_t> column_indices,
+                     std::vector<float> weights);
+  /**
+   * Evaluates the line of sight integrals of all pixels.
+   * @param values values[x][y][z] at the grid points
+   * @return sky[pixel]
+   */
+  tensors::tensor_1d operator()(const tensors::tensor_3d &values) const;
+  /**
+   * Evaluates the line of sight integrals of a subset of the pixels.
+   * @param values values[x][y][z] at the grid points
+   * @param pixels rows of the operator
+   * @return sky[i] of the pixel pixels[i]
+   */
+  tensors::tensor_1d operator()(const tensors::tensor_3d &values,
+                                const std::vector<size_t> &pixels) const;
+
+  [[nodiscard]] size_t get_number_of_pixels() const {
+    return row_offsets.size() - 1;
+  }
+  [[nodiscard]] const std::array<size_t, 3> &get_grid_dimensions() const {
+    return grid_dimensions;
+  }
+  /**
+   * @return {x, y, z} centers of the grid relative to the observer in kpc,
+   *         which identify the grid and the observer of the operator
+   */
+  [[nodiscard]] const std::array<std::vector<double>, 3> &
+  get_grid_centers() const {
+    return grid_centers;
+  }
+  /**
+   * @return radial step size and parameters of the pixel directions, which
+   *         identify the lines of sight of the operator besides its grid
+   */
+  [[nodiscard]] const line_of_sight_geometry &get_geometry() const {
+    return geometry;
+  }
+  [[nodiscard]] const std::vector<std::uint64_t> &get_row_offsets() const {
+    return row_offsets;
+  }
+  [[nodiscard]] const std::vector<std::uint32_t> &get_column_indices() const {
+    return column_indices;
+  }
+  [[nodiscard]] const std::vector<float> &get_weights() const {
+    return weights;
+  }
+
+private:
+  struct Entry {
+    std::uint32_t column_index;
+    double weight;
+  };
+
+  line_of_sight_geometry geometry;
+  std::array<size_t, 3> grid_dimensions{};
+  std::array<std::vector<double>, 3> grid_centers;
+  std::vector<std::uint64_t> row_offsets;
+  std::vector<std::uint32_t> column_indices;
+  std::vector<float> weights;
+
+  /**
+   * Collects the merged weights of a single line of sight.
+   * @return entries sorted by their column index
+   */
+  std::vector<Entry> assemble_row(double radial_step_size,
+                                  const grids::cartesian_grid_3d &grid,
+                                  const std::array<grids::axis_lookup, 3> &axes,
+                                  const std::array<double, 3> &direction) const;
+  void check_consistency() const;
+  /**
+   * @return flat copy of the values such that the column indices can address
+   *         them
+   */
+  [[nodiscard]] std::vector<double>
+  flatten(const tensors::tensor_3d &values) const;
+  [[nodiscard]] double multiply_row(const std::vector<double> &flat_values,
+                                    size_t pixel) const {
+    double integral{};
+    for (auto i = row_offsets[pixel]; i != row_offsets[pixel + 1]; ++i) {
+      integral += weights[i] * flat_values[column_indices[i]];
+    }
+    return integral;
+  }
+};
+
+#endif // GAMMA_SKY_SRC_PROJECTIONOPERATOR_H
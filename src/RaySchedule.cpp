@@ -0,0 +1,122 @@
+// Author: Stefan Lepperdinger
+#include "RaySchedule.h"
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+
+RaySchedule::policy RaySchedule::parse_policy(const std::string &name) {
+  if (name == "equal_count") {
+    return policy::equal_count;
+  }
+  if (name == "cost_balanced") {
+    return policy::cost_balanced;
+  }
+  throw std::invalid_argument("Unknown ray scheduling '" + name +
+                              "'. Please set the parameter ray_scheduling in "
+                              "the parameter file to either 'equal_count' or "
+                              "'cost_balanced'.");
+}
+
+double RaySchedule::estimate_cost(const grids::cartesian_grid_3d &grid,
+                                  double radial_step_size,
+                                  const std::array<double, 3> &direction) {
+  // the line of sight leaves the grid (the box spanned by the outermost
+  // centers, see cartesian_grid_3d::is_within_grid) at the nearest face
+  // ahead of the observer
+  std::array<const std::vector<double> *, 3> axes{
+      &grid.x_centers, &grid.y_centers, &grid.z_centers};
+  double exit_distance = std::numeric_limits<double>::infinity();
+  for (size_t axis{}; axis != 3; ++axis) {
+    if (direction[axis] == 0.) {
+      continue;
+    }
+    double face =
+        direction[axis] > 0. ? axes[axis]->back() : axes[axis]->front();
+    exit_distance = std::min(exit_distance, face / direction[axis]);
+  }
+  return std::max(exit_distance, 0.) / radial_step_size + 1.;
+}
+
+RaySchedule::RaySchedule(size_t number_of_values, size_t number_of_workers)
+    : number_of_values(number_of_values),
+      number_of_workers(std::max(number_of_workers, size_t{1})) {}
+
+RaySchedule::RaySchedule(const std::vector<double> &costs,
+                         size_t number_of_workers)
+    : number_of_values(costs.size()),
+      number_of_workers(std::max(number_of_workers, size_t{1})) {
+  // prefix_sums[value] = cost of the values [0, value)
+  std::vector<double> prefix_sums(number_of_values + 1);
+  std::partial_sum(costs.cbegin(), costs.cend(), prefix_sums.begin() + 1);
+  double total_cost = prefix_sums.back();
+
+  // consecutive tiles of equal predicted cost, every tile with at least one
+  // value
+  size_t number_of_tiles =
+      std::min(this->number_of_workers * tiles_per_worker, number_of_values);
+  tile_edges.push_back(0);
+  for (size_t tile{1}; tile < number_of_tiles; ++tile) {
+    double target = total_cost * static_cast<double>(tile) /
+                    static_cast<double>(number_of_tiles);
+    auto edge = static_cast<size_t>(
+        std::lower_bound(prefix_sums.cbegin(), prefix_sums.cend(), target) -
+        prefix_sums.cbegin());
+    edge = std::clamp(edge, tile_edges.back() + 1,
+                      number_of_values - (number_of_tiles - tile));
+    tile_edges.push_back(edge);
+  }
+  tile_edges.push_back(number_of_values);
+
+  // dynamic scheduling: every tile goes to the worker that is idle first
+  std::priority_queue<double, std::vector<double>, std::greater<>> loads;
+  for (size_t worker{}; worker != this->number_of_workers; ++worker) {
+    loads.push(0.);
+  }
+  for (size_t tile{}; tile + 1 < tile_edges.size(); ++tile) {
+    double load = loads.top();
+    loads.pop();
+    loads.push(load + prefix_sums[tile_edges[tile + 1]] -
+               prefix_sums[tile_edges[tile]]);
+  }
+  while (!loads.empty()) {
+    predicted_loads.predicted_maximum =
+        std::max(predicted_loads.predicted_maximum, loads.top());
+    loads.pop();
+  }
+  for (size_t worker{}; worker != this->number_of_workers; ++worker) {
+    size_t first = number_of_values * worker / this->number_of_workers;
+    size_t last = number_of_values * (worker + 1) / this->number_of_workers;
+    predicted_loads.equal_count_maximum =
+        std::max(predicted_loads.equal_count_maximum,
+                 prefix_sums[last] - prefix_sums[first]);
+  }
+  predicted_loads.predicted_mean =
+      total_cost / static_cast<double>(this->number_of_workers);
+}
+
+RaySchedule::load_balance RaySchedule::get_load_balance() const {
+  auto loads = predicted_loads;
+  double total_busy_time{};
+  for (double busy_time : busy_times) {
+    loads.measured_maximum = std::max(loads.measured_maximum, busy_time);
+    total_busy_time += busy_time;
+  }
+  // workers without any tile count as idle
+  loads.measured_mean = total_busy_time / static_cast<double>(std::max(
+                                              number_of_workers,
+                                              busy_times.size()));
+  return loads;
+}
+
+RaySchedule::load_balance &
+RaySchedule::load_balance::operator+=(const load_balance &other) {
+  predicted_maximum += other.predicted_maximum;
+  equal_count_maximum += other.equal_count_maximum;
+  predicted_mean += other.predicted_mean;
+  measured_maximum += other.measured_maximum;
+  measured_mean += other.measured_mean;
+  return *this;
+}
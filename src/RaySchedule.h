@@ -0,0 +1,175 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_RAYSCHEDULE_H
+#define GAMMA_SKY_SRC_RAYSCHEDULE_H
+
+#include "grids.h"
+#include <array>
+#include <chrono>
+#include <string>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
+#include <tbb/partitioner.h>
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Splits the lines of sight of a sky into tiles of similar cost.
+ *
+ * The cost of a line of sight varies by orders of magnitude: lines of sight
+ * along the disk traverse the whole grid, while lines of sight towards the
+ * poles leave it after a few radial steps. With the policy "equal_count", the
+ * lines of sight are split by their count (every value is its own tile and
+ * TBB chooses the chunks). With the policy "cost_balanced", the cost of every
+ * line of sight is predicted up front by the number of radial steps up to the
+ * boundary of the grid, and the values are split into consecutive tiles of
+ * equal predicted cost (several per worker), which are the units of the work
+ * stealing and of the split among the NUMA nodes.
+ */
+class RaySchedule {
+public:
+  enum class policy { equal_count, cost_balanced };
+
+  /**
+   * Predicted and measured loads of the workers.
+   */
+  struct load_balance {
+    // predicted cost of the most loaded worker, if the tiles are handed to
+    // the least loaded worker in their order
+    double predicted_maximum{};
+    // predicted cost of the most loaded worker with one chunk of equal count
+    // per worker
+    double equal_count_maximum{};
+    // predicted cost per worker
+    double predicted_mean{};
+    // measured busy time of the busiest worker in seconds
+    double measured_maximum{};
+    // measured busy time per worker in seconds
+    double measured_mean{};
+
+    load_balance &operator+=(const load_balance &other);
+    /**
+     * @return predicted load of the most loaded worker relative to the mean
+     *         load (1: perfectly balanced)
+     */
+    [[nodiscard]] double get_predicted_imbalance() const {
+      return predicted_mean > 0. ? predicted_maximum / predicted_mean : 1.;
+    }
+    /**
+     * @return predicted imbalance of chunks of equal count
+     */
+    [[nodiscard]] double get_equal_count_imbalance() const {
+      return predicted_mean > 0. ? equal_count_maximum / predicted_mean : 1.;
+    }
+    /**
+     * @return measured busy time of the busiest worker relative to the mean
+     *         busy time
+     */
+    [[nodiscard]] double get_measured_imbalance() const {
+      return measured_mean > 0. ? measured_maximum / measured_mean : 1.;
+    }
+  };
+
+  // tiles per worker, which leaves room for the work stealing to even out
+  // mispredicted costs
+  static constexpr size_t tiles_per_worker = 8;
+
+  /**
+   * @param name either "equal_count" or "cost_balanced"
+   * @throws std::invalid_argument for other names
+   */
+  static policy parse_policy(const std::string &name);
+
+  /**
+   * Predicts the cost of a line of sight in units of the cost of a radial
+   * step (a line of sight costs one step besides its steps).
+   * @param grid grid relative to the observer
+   * @param direction unit vector of the line of sight
+   * @return number of radial steps within the grid plus 1
+   */
+  static double estimate_cost(const grids::cartesian_grid_3d &grid,
+                              double radial_step_size,
+                              const std::array<double, 3> &direction);
+
+  /**
+   * Schedules the values by count (policy "equal_count").
+   * @param number_of_values number of lines of sight
+   * @param number_of_workers number of workers that share the values
+   */
+  RaySchedule(size_t number_of_values, size_t number_of_workers);
+  /**
+   * Schedules the values in consecutive tiles of equal predicted cost
+   * (policy "cost_balanced").
+   * @param costs costs[value] predicted cost of the line of sight of the value
+   * @param number_of_workers number of workers that share the tiles
+   */
+  RaySchedule(const std::vector<double> &costs, size_t number_of_workers);
+
+  /**
+   * @return number of tiles (the number of values for "equal_count")
+   */
+  [[nodiscard]] size_t get_number_of_tiles() const {
+    return tile_edges.empty() ? number_of_values : tile_edges.size() - 1;
+  }
+  /**
+   * @return values [first, last) of the tile
+   */
+  [[nodiscard]] std::array<size_t, 2> get_tile(size_t tile) const {
+    if (tile_edges.empty()) {
+      return {tile, tile + 1};
+    }
+    return {tile_edges[tile], tile_edges[tile + 1]};
+  }
+  /**
+   * Calls body(values) in parallel for ranges of the values of the tiles
+   * [first_tile, last_tile) and measures the busy time of the workers.
+   * @param body body(const tbb::blocked_range<size_t> &values)
+   */
+  template <typename Body>
+  void run(size_t first_tile, size_t last_tile, const Body &body) const;
+  /**
+   * @return predicted loads (only for "cost_balanced") and measured loads of
+   *         the runs so far
+   */
+  [[nodiscard]] load_balance get_load_balance() const;
+
+private:
+  size_t number_of_values;
+  size_t number_of_workers;
+  // tile t covers the values [tile_edges[t], tile_edges[t + 1]) (empty for
+  // "equal_count")
+  std::vector<size_t> tile_edges;
+  load_balance predicted_loads;
+  // busy time of every worker that ran a part of the tiles in seconds
+  mutable tbb::enumerable_thread_specific<double> busy_times;
+};
+
+template <typename Body>
+void RaySchedule::run(size_t first_tile, size_t last_tile,
+                      const Body &body) const {
+  auto timed_body = [&](const tbb::blocked_range<size_t> &values) {
+    auto start = std::chrono::steady_clock::now();
+    body(values);
+    std::chrono::duration<double> duration =
+        std::chrono::steady_clock::now() - start;
+    busy_times.local() += duration.count();
+  };
+  if (tile_edges.empty()) {
+    tbb::parallel_for(tbb::blocked_range<size_t>(first_tile, last_tile),
+                      timed_body);
+    return;
+  }
+  // every tile is a task of its own
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(first_tile, last_tile, 1),
+      [&](const tbb::blocked_range<size_t> &tiles) {
+        for (size_t tile = tiles.begin(); tile != tiles.end(); ++tile) {
+          timed_body(tbb::blocked_range<size_t>(tile_edges[tile],
+                                                tile_edges[tile + 1]));
+        }
+      },
+      tbb::simple_partitioner());
+}
+
+#endif // GAMMA_SKY_SRC_RAYSCHEDULE_H
@@ -1,9 +1,18 @@
 // Author: Stefan Lepperdinger
 #include "Sky.h"
+#include "ConeTracingIntegral.h"
+#include "EnergyDecomposition.h"
 #include "mathematics.h"
 #include <LineOfSightIntegral.h>
 #include <algorithm>
-#include <execution>
+#include <cmath>
+#include <future>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
 
 Sky::Sky(const std::vector<double> &energies,
          const tensors::tensor_4d &emissivities,
@@ -15,17 +24,45 @@ Sky::Sky(const std::vector<double> &energies,
       radial_step_size(parameters.radial_step_size),
       healpix_order(parameters.healpix_order),
       line_of_sight_longitude(parameters.line_of_sight_longitude),
-      line_of_sight_latitude(parameters.line_of_sight_latitude) {
+      line_of_sight_latitude(parameters.line_of_sight_latitude),
+      energy_decomposition_components(
+          parameters.energy_decomposition_components),
+      requested_energies(parameters.requested_energies),
+      energy_bands(parameters.energy_bands),
+      distance_bin_edges(parameters.distance_bin_edges),
+      observer_gradient(parameters.observer_gradient),
+      out_of_core_brick_planes(static_cast<size_t>(
+          std::max(parameters.out_of_core_brick_planes, 0))),
+      cone_tracing(parameters.cone_tracing),
+      skipping_tolerance(parameters.skipping_tolerance),
+      symmetry_tolerance(parameters.symmetry_tolerance),
+      volume_compression(
+          CompressedVolume::parse_encoding(parameters.volume_compression)),
+      ray_scheduling(RaySchedule::parse_policy(parameters.ray_scheduling)),
+      placement(NumaPlacement::parse_policy(parameters.numa_policy),
+                parameters.huge_pages) {
 
+  if (parameters.energy_indices) {
+    energy_indices = *parameters.energy_indices;
+  } else {
+    energy_indices.resize(energies.size());
+    std::iota(energy_indices.begin(), energy_indices.end(), 0);
+  }
   check_parameters();
-  initialize_sky_pixels();
+  if (!requested_energies.empty()) {
+    check_parameter(!parameters.energy_indices,
+                    "Requested energies can't be combined with the energy "
+                    "indices of a shard. Please check the parameter "
+                    "requested_energies_in_MeV in the parameter file.");
+    initialize_requested_energies();
+  }
+  initialize_sky_pixels(parameters.pixel_range);
   initialize_relative_emissivity_grid();
 }
 
 void Sky::check_parameter(bool condition, const std::string &message) {
   if (!condition) {
-    std::cerr << "error: " << message << '\n';
-    std::exit(1);
+    throw std::invalid_argument(message);
   }
 }
 
@@ -51,22 +88,159 @@ void Sky::check_parameters() const {
                   "The line of sight latitude has to be within the interval "
                   "[-90°, 90°]. Please check the parameter "
                   "line_of_sight_latitude_in_degrees in the parameter file.");
+  check_parameter(skipping_tolerance >= 0.,
+                  "The empty space skipping tolerance has to be "
+                  "non-negative. Please check the parameter "
+                  "empty_space_skipping_tolerance in the parameter file.");
+  check_parameter(
+      volume_compression == CompressedVolume::encoding::none ||
+          (!cone_tracing && skipping_tolerance == 0.),
+      "Compressed volumes can't be combined with cone tracing or empty space "
+      "skipping. Please check the parameters volume_compression, "
+      "cone_tracing and empty_space_skipping_tolerance in the parameter "
+      "file.");
+  if (!distance_bin_edges.empty()) {
+    check_parameter(distance_bin_edges.size() >= 2 &&
+                        distance_bin_edges.front() >= 0. &&
+                        std::adjacent_find(distance_bin_edges.cbegin(),
+                                           distance_bin_edges.cend(),
+                                           std::greater_equal<>()) ==
+                            distance_bin_edges.cend(),
+                    "The distance bins need at least 2 non-negative and "
+                    "ascending edges. Please check the parameter "
+                    "distance_bins_in_kpc in the parameter file.");
+    check_parameter(
+        !cone_tracing && volume_compression == CompressedVolume::encoding::none,
+        "Distance-resolved skies can't be combined with cone tracing or "
+        "compressed volumes. Please check the parameters distance_bins_in_kpc, "
+        "cone_tracing and volume_compression in the parameter file.");
+  }
+  check_parameter(
+      !observer_gradient ||
+          (!cone_tracing &&
+           volume_compression == CompressedVolume::encoding::none),
+      "Observer gradients can't be combined with cone tracing or compressed "
+      "volumes. Please check the parameters observer_gradient, cone_tracing "
+      "and volume_compression in the parameter file.");
+  check_parameter(
+      out_of_core_brick_planes == 0 ||
+          (!cone_tracing &&
+           volume_compression == CompressedVolume::encoding::none &&
+           skipping_tolerance == 0.),
+      "Out-of-core bricks can't be combined with cone tracing, compressed "
+      "volumes or empty space skipping. Please check the parameters "
+      "out_of_core_brick_planes, cone_tracing, volume_compression and "
+      "empty_space_skipping_tolerance in the parameter file.");
+  check_parameter(
+      0 <= energy_decomposition_components &&
+          static_cast<size_t>(energy_decomposition_components) <=
+              energies.size(),
+      "The number of energy decomposition components has to be within the "
+      "interval [0, number of energies]. Please check the parameter "
+      "energy_decomposition_components in the parameter file.");
+  check_parameter(std::all_of(energy_indices.cbegin(), energy_indices.cend(),
+                              [&](size_t index) {
+                                return index < energies.size();
+                              }),
+                  "The energy indices of the shard have to be smaller than "
+                  "the number of energies of the input file.");
+  if (!energy_bands.empty()) {
+    check_parameter(energies.front() > 0. &&
+                        std::is_sorted(energies.cbegin(), energies.cend()),
+                    "Energy bands require positive and ascending energies in "
+                    "the input file.");
+  }
+  for (const auto &band : energy_bands) {
+    // the energies are stored in single precision
+    double tolerance = 1e-6;
+    check_parameter(band[0] < band[1] &&
+                        energies.front() * (1. - tolerance) <= band[0] &&
+                        band[1] <= energies.back() * (1. + tolerance),
+                    "The energy bands have to be non-empty and within the "
+                    "energy range of the input file. Please check the "
+                    "parameter energy_bands_in_MeV in the parameter file.");
+  }
+}
+
+void Sky::initialize_requested_energies() {
+  check_parameter(energies.front() > 0. &&
+                      std::is_sorted(energies.cbegin(), energies.cend()),
+                  "Requested energies require positive and ascending "
+                  "energies in the input file.");
+  // the energies of the input file are stored in single precision
+  double tolerance = 1e-6;
+  std::vector<bool> is_bracketing(energies.size());
+  for (double energy : requested_energies) {
+    check_parameter(energies.front() * (1. - tolerance) <= energy &&
+                        energy <= energies.back() * (1. + tolerance),
+                    "The requested energies have to be within the energy "
+                    "range of the input file. Please check the parameter "
+                    "requested_energies_in_MeV in the parameter file.");
+    auto bracket = mathematics::find_log_bracket(
+        energies,
+        std::clamp(energy, energies.front(), energies.back()));
+    // energies of the input file aren't interpolated
+    if (std::abs(energy / energies[bracket.lower] - 1.) <= tolerance) {
+      bracket = {bracket.lower, bracket.lower, 0.};
+    } else if (std::abs(energy / energies[bracket.upper] - 1.) <= tolerance) {
+      bracket = {bracket.upper, bracket.upper, 0.};
+    }
+    is_bracketing[bracket.lower] = true;
+    is_bracketing[bracket.upper] = true;
+    requested_brackets.push_back(bracket);
+  }
+  energy_indices.clear();
+  for (size_t energy{}; energy != energies.size(); ++energy) {
+    if (is_bracketing[energy]) {
+      energy_indices.push_back(energy);
+    }
+  }
+}
+
+void Sky::initialize_sky_pixels(
+    const std::optional<std::array<size_t, 2>> &selected_pixel_range) {
+  healpix_base.Set(healpix_order, RING);
+  number_of_sky_pixels = healpix_base.Npix();
+  pixel_size = std::sqrt(mathematics::four_pi /
+                         static_cast<double>(number_of_sky_pixels));
+  symmetry.emplace(healpix_base, line_of_sight_longitude,
+                   line_of_sight_latitude);
+  pixel_range = selected_pixel_range.value_or(
+      std::array<size_t, 2>{0, number_of_sky_pixels});
+  check_parameter(pixel_range[0] < pixel_range[1] &&
+                      pixel_range[1] <= number_of_sky_pixels,
+                  "The pixel range of the shard has to be non-empty and "
+                  "within the number of HEALPix pixels.");
 }
 
-void Sky::initialize_sky_pixels() {
-  Healpix_Map<double> healpix_map(healpix_order, RING);
-  number_of_sky_pixels = healpix_map.Npix();
-  sky_coordinates = tensors::make_2d_tensor({number_of_sky_pixels, 2});
-  for (size_t i{}; i != number_of_sky_pixels; ++i) {
-    auto pixel = healpix_map.pix2ang(static_cast<int>(i));
-    auto longitude = pixel.phi;
-    auto latitude = mathematics::half_pi - pixel.theta;
+std::array<double, 3> Sky::compute_direction(size_t pixel) const {
+  auto angles =
+      healpix_base.pix2ang(static_cast<int>(pixel_range[0] + pixel));
+  auto longitude = angles.phi;
+  auto latitude = mathematics::half_pi - angles.theta;
+
+  // add the direction in which the observer looks
+  longitude += line_of_sight_longitude;
+  latitude += line_of_sight_latitude;
+
+  return PixelDirections::make_direction(longitude, latitude);
+}
 
-    // add the direction in which the observer looks
-    longitude += line_of_sight_longitude;
-    latitude += line_of_sight_latitude;
+PixelDirections Sky::make_pixel_directions() const {
+  PixelDirections directions(pixel_range[1] - pixel_range[0]);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, directions.size()),
+                    [&](const tbb::blocked_range<size_t> &range) {
+                      for (size_t pixel = range.begin(); pixel != range.end();
+                           ++pixel) {
+                        directions.set(pixel, compute_direction(pixel));
+                      }
+                    });
+  return directions;
+}
 
-    sky_coordinates[i] = {longitude, latitude};
+void Sky::store_pixel_directions() {
+  if (pixel_directions.empty()) {
+    pixel_directions = make_pixel_directions();
   }
 }
 
@@ -85,25 +259,595 @@ void Sky::initialize_relative_emissivity_grid() {
       emissivity_grid.z_boundaries, xyz_observer_location[2]);
   relative_emissivity_grid.z_centers =
       make_relative_grid(emissivity_grid.z_centers, xyz_observer_location[2]);
+  line_of_sight.emplace(radial_step_size, relative_emissivity_grid);
 }
 
 tensors::tensor_2d Sky::compute_gamma_skies() {
-  auto number_of_energies = energies.size();
+  tensors::tensor_2d skies(energy_indices.size());
+  compute_gamma_skies({}, collect_into(skies));
+  return skies;
+}
+
+void Sky::compute_gamma_skies(const std::vector<bool> &skipped_rows,
+                              const sky_consumer &consume) {
+  auto is_skipped = [&](size_t row) {
+    return !skipped_rows.empty() && skipped_rows[row];
+  };
+  if (energy_decomposition_components > 0) {
+    // nothing left to compute
+    if (!skipped_rows.empty() &&
+        std::all_of(skipped_rows.cbegin(), skipped_rows.cend(),
+                    [](bool skipped) { return skipped; })) {
+      return;
+    }
+    EnergyDecomposition decomposition(
+        emissivities, static_cast<size_t>(energy_decomposition_components));
+    tensors::tensor_2d basis_skies;
+    for (const auto &basis_volume : decomposition.get_basis_volumes()) {
+      basis_skies.push_back(compute_gamma_sky(basis_volume));
+    }
+    energy_decomposition_errors = decomposition.get_truncation_errors();
+    auto all_skies = decomposition.reconstruct_skies(basis_skies);
+    for (size_t row{}; row != energy_indices.size(); ++row) {
+      if (!is_skipped(row)) {
+        consume(row, all_skies[energy_indices[row]]);
+      }
+    }
+    return;
+  }
+
+  for (size_t row{}; row != energy_indices.size(); ++row) {
+    if (is_skipped(row)) {
+      continue;
+    }
+    auto energy = energy_indices[row];
+    if (energy < compressed_emissivities.size() &&
+        compressed_emissivities[energy]) {
+      auto sky = compute_gamma_sky(*compressed_emissivities[energy]);
+      compressed_emissivities[energy].reset();
+      consume(row, sky);
+    } else {
+      consume(row, compute_gamma_sky(emissivities[energy]));
+    }
+  }
+}
+
+void Sky::compress_emissivity(size_t energy) {
+  check_parameter(volume_compression != CompressedVolume::encoding::none &&
+                      !cone_tracing && !projection_operator,
+                  "Only volumes that are integrated along the lines of sight "
+                  "can be compressed. Please check the parameters "
+                  "volume_compression, cone_tracing and "
+                  "use_projection_operator in the parameter file.");
+  if (compressed_emissivities.empty()) {
+    compressed_emissivities.resize(emissivities.size());
+  }
+  const auto &emissivity = emissivities[energy];
+  compressed_emissivities[energy] = compressed_emissivity{
+      compress_volume(emissivity), find_mirrors(emissivity)};
+}
+
+CompressedVolume
+Sky::compress_volume(const tensors::tensor_3d &emissivity) const {
+  CompressedVolume volume(emissivity, volume_compression);
+  compression_error =
+      std::max(compression_error, volume.get_maximum_relative_error());
+  return volume;
+}
+
+tensors::tensor_2d
+Sky::compute_progressive_gamma_skies(const preview_consumer &consume_preview) {
+  check_parameter(pixel_range[0] == 0 &&
+                      pixel_range[1] == number_of_sky_pixels,
+                  "Progressive previews require all pixels of the sky.");
+  std::optional<EnergyDecomposition> decomposition;
+  if (energy_decomposition_components > 0) {
+    decomposition.emplace(emissivities,
+                          static_cast<size_t>(energy_decomposition_components));
+    energy_decomposition_errors = decomposition->get_truncation_errors();
+  }
+  // volumes whose skies are computed in every level: the basis volumes of the
+  // decomposition or the volumes of the energies
+  std::vector<const tensors::tensor_3d *> volumes;
+  // compressed_volumes[i] compressed copy of volumes[i] (null without
+  // compression), which is compressed once for all levels
+  std::vector<const CompressedVolume *> compressed_volumes;
+  std::vector<std::optional<CompressedVolume>> level_compressions;
+  // replicas of the uncompressed volumes[i] on the NUMA nodes, which are
+  // replicated once for all levels as well
+  std::vector<std::optional<NumaPlacement::replicas>> level_replicas;
+  if (decomposition) {
+    for (const auto &basis_volume : decomposition->get_basis_volumes()) {
+      volumes.push_back(&basis_volume);
+    }
+  } else {
+    for (auto energy : energy_indices) {
+      volumes.push_back(&emissivities[energy]);
+    }
+  }
+  compressed_volumes.resize(volumes.size());
+  level_compressions.resize(volumes.size());
+  if (volume_compression != CompressedVolume::encoding::none) {
+    for (size_t i{}; i != volumes.size(); ++i) {
+      // the volumes of compress_emissivity are used as they are
+      if (!decomposition) {
+        auto energy = energy_indices[i];
+        if (energy < compressed_emissivities.size() &&
+            compressed_emissivities[energy]) {
+          compressed_volumes[i] = &compressed_emissivities[energy]->volume;
+          continue;
+        }
+      }
+      level_compressions[i] = compress_volume(*volumes[i]);
+      compressed_volumes[i] = &*level_compressions[i];
+    }
+  }
+  level_replicas.resize(volumes.size());
+  for (size_t i{}; i != volumes.size(); ++i) {
+    if (!compressed_volumes[i] && !projection_operator) {
+      level_replicas[i] = placement.replicate(*volumes[i]);
+    }
+  }
+
   auto skies =
-      tensors::make_2d_tensor({number_of_energies, number_of_sky_pixels});
-  for (size_t energy{}; energy != number_of_energies; ++energy) {
-    LineOfSightIntegral integral(radial_step_size, relative_emissivity_grid,
-                                 emissivities[energy]);
-    auto &sky = skies[energy];
-    std::transform(std::execution::par, sky_coordinates.cbegin(),
-                   sky_coordinates.cend(), sky.begin(),
-                   [&](const auto &coordinates) {
-                     return integral(coordinates[0], coordinates[1]);
-                   });
+      tensors::make_2d_tensor({energy_indices.size(), number_of_sky_pixels});
+  for (int order{}; order <= healpix_order; ++order) {
+    size_t stride = size_t{1} << (2 * (healpix_order - order));
+    // RING indices of the pixels that are new in this level
+    std::vector<size_t> pixels;
+    for (size_t nested{}; nested < number_of_sky_pixels; nested += stride) {
+      if (order == 0 || nested % (4 * stride) != 0) {
+        pixels.push_back(healpix_base.nest2ring(static_cast<int>(nested)));
+      }
+    }
+
+    tensors::tensor_2d level_skies;
+    auto pixel_of = [&pixels](size_t value) { return pixels[value]; };
+    for (size_t i{}; i != volumes.size(); ++i) {
+      if (compressed_volumes[i]) {
+        level_skies.push_back(
+            integrate(*compressed_volumes[i], pixels.size(), pixel_of));
+      } else if (level_replicas[i]) {
+        level_skies.push_back(
+            integrate(*level_replicas[i], pixels.size(), pixel_of));
+      } else {
+        level_skies.push_back(compute_gamma_sky(*volumes[i], pixels));
+      }
+    }
+    if (decomposition) {
+      auto all_skies = decomposition->reconstruct_skies(level_skies);
+      level_skies.clear();
+      for (auto energy : energy_indices) {
+        level_skies.push_back(std::move(all_skies[energy]));
+      }
+    }
+    for (size_t row{}; row != skies.size(); ++row) {
+      for (size_t i{}; i != pixels.size(); ++i) {
+        skies[row][pixels[i]] = level_skies[row][i];
+      }
+    }
+
+    if (order == healpix_order) {
+      break;
+    }
+    Healpix_Base preview_map(order, RING);
+    auto number_of_preview_pixels = static_cast<size_t>(preview_map.Npix());
+    auto preview_skies = tensors::make_2d_tensor(
+        {energy_indices.size(), number_of_preview_pixels});
+    for (size_t nested{}; nested != number_of_preview_pixels; ++nested) {
+      auto preview_pixel = preview_map.nest2ring(static_cast<int>(nested));
+      auto descendant =
+          healpix_base.nest2ring(static_cast<int>(nested * stride));
+      for (size_t row{}; row != skies.size(); ++row) {
+        preview_skies[row][preview_pixel] = skies[row][descendant];
+      }
+    }
+    consume_preview(order, preview_skies);
+  }
+  for (auto energy : energy_indices) {
+    if (energy < compressed_emissivities.size()) {
+      compressed_emissivities[energy].reset();
+    }
+  }
+  return skies;
+}
+
+tensors::tensor_2d Sky::compute_gamma_band_skies() {
+  tensors::tensor_2d band_skies(energy_bands.size());
+  compute_gamma_band_skies({}, collect_into(band_skies));
+  return band_skies;
+}
+
+void Sky::compute_gamma_band_skies(const std::vector<bool> &skipped_rows,
+                                   const sky_consumer &consume) {
+  for (size_t row{}; row != energy_bands.size(); ++row) {
+    if (!skipped_rows.empty() && skipped_rows[row]) {
+      continue;
+    }
+    const auto &band = energy_bands[row];
+    auto weights =
+        mathematics::log_trapezoid_weights(energies, band[0], band[1]);
+    auto band_emissivity = tensors::linear_combination(emissivities, weights);
+    consume(row, compute_gamma_sky(band_emissivity));
+  }
+}
+
+tensors::tensor_2d
+Sky::interpolate_requested_skies(const tensors::tensor_2d &skies) const {
+  auto sky_of = [&](size_t energy) -> const tensors::tensor_1d & {
+    auto row = std::lower_bound(energy_indices.cbegin(), energy_indices.cend(),
+                                energy) -
+               energy_indices.cbegin();
+    return skies[static_cast<size_t>(row)];
+  };
+  tensors::tensor_2d requested_skies;
+  for (const auto &bracket : requested_brackets) {
+    const auto &lower_sky = sky_of(bracket.lower);
+    const auto &upper_sky = sky_of(bracket.upper);
+    tensors::tensor_1d sky(lower_sky.size());
+    for (size_t pixel{}; pixel != sky.size(); ++pixel) {
+      sky[pixel] = mathematics::log_log_interpolate(
+          lower_sky[pixel], upper_sky[pixel], bracket.weight);
+    }
+    requested_skies.push_back(std::move(sky));
+  }
+  return requested_skies;
+}
+
+Sky::sky_consumer Sky::collect_into(tensors::tensor_2d &skies) {
+  return [&skies](size_t row, const tensors::tensor_1d &sky) {
+    skies[row] = sky;
+  };
+}
+
+tensors::tensor_1d
+Sky::compute_gamma_sky(const tensors::tensor_3d &emissivity) const {
+  if (projection_operator) {
+    return (*projection_operator)(emissivity);
+  }
+  if (volume_compression != CompressedVolume::encoding::none) {
+    return compute_gamma_sky(compressed_emissivity{
+        compress_volume(emissivity), find_mirrors(emissivity)});
+  }
+  auto skies = integrate_independent_pixels(
+      find_mirrors(emissivity),
+      [&](size_t number_of_values, const auto &pixel_of) {
+        tensors::tensor_2d rows(1);
+        rows[0] = integrate(placement.replicate(emissivity), number_of_values,
+                            pixel_of);
+        return rows;
+      });
+  return std::move(skies[0]);
+}
+
+tensors::tensor_1d
+Sky::compute_gamma_sky(const compressed_emissivity &emissivity) const {
+  auto skies = integrate_independent_pixels(
+      emissivity.mirrors, [&](size_t number_of_values, const auto &pixel_of) {
+        tensors::tensor_2d rows(1);
+        rows[0] = integrate(emissivity.volume, number_of_values, pixel_of);
+        return rows;
+      });
+  return std::move(skies[0]);
+}
+
+tensors::tensor_2d
+Sky::compute_gamma_component_skies(const tensors::tensor_4d &components) const {
+  if (projection_operator || cone_tracing) {
+    tensors::tensor_2d skies;
+    for (const auto &component : components) {
+      skies.push_back(compute_gamma_sky(component));
+    }
+    return skies;
+  }
+  unsigned mirrors = ~0u;
+  for (const auto &component : components) {
+    mirrors &= find_mirrors(component);
+  }
+  return integrate_independent_pixels(
+      mirrors, [&](size_t number_of_values, const auto &pixel_of) {
+        auto skies =
+            tensors::make_2d_tensor({components.size(), number_of_values});
+        // the components are evaluated on the shared grid of the integral
+        const auto &integral = *line_of_sight;
+        auto schedule = make_ray_schedule(number_of_values, pixel_of);
+        schedule.run(
+            0, schedule.get_number_of_tiles(),
+            [&](const tbb::blocked_range<size_t> &range) {
+              // scratch of the task, which is reused by all of its pixels
+              std::vector<double> values;
+              for (size_t i = range.begin(); i != range.end(); ++i) {
+                integral(get_direction(pixel_of(i)), components, values);
+                for (size_t component{}; component != values.size();
+                     ++component) {
+                  skies[component][i] = values[component];
+                }
+              }
+            });
+        ray_load_balance += schedule.get_load_balance();
+        return skies;
+      });
+}
+
+tensors::tensor_2d
+Sky::compute_distance_resolved_sky(const tensors::tensor_3d &emissivity) const {
+  // the distances and histograms of mirrored pixels are mirrored as well
+  return integrate_independent_pixels(
+      find_mirrors(emissivity),
+      [&](size_t number_of_values, const auto &pixel_of) {
+        auto rows = tensors::make_2d_tensor(
+            {distance_bin_edges.size() + 1, number_of_values});
+        auto schedule = make_ray_schedule(number_of_values, pixel_of);
+        placement.run(
+            emissivity, schedule.get_number_of_tiles(),
+            [&](const tensors::tensor_3d &volume, size_t first, size_t last) {
+              LineOfSightIntegral integral(*line_of_sight, volume);
+              schedule.run(
+                  first, last, [&](const tbb::blocked_range<size_t> &range) {
+                    LineOfSightIntegral::distance_profile profile{};
+                    for (size_t i = range.begin(); i != range.end(); ++i) {
+                      integral.resolve_distances(get_direction(pixel_of(i)),
+                                                 distance_bin_edges, profile);
+                      rows[0][i] = profile.integral;
+                      rows[1][i] = profile.mean_distance;
+                      for (size_t bin{}; bin != profile.histogram.size();
+                           ++bin) {
+                        rows[2 + bin][i] = profile.histogram[bin];
+                      }
+                    }
+                  });
+            });
+        ray_load_balance += schedule.get_load_balance();
+        return rows;
+      });
+}
+
+tensors::tensor_2d
+Sky::compute_observer_gradient_sky(const tensors::tensor_3d &emissivity) const {
+  return integrate_independent_pixels(
+      0, [&](size_t number_of_values, const auto &pixel_of) {
+        auto rows = tensors::make_2d_tensor({4, number_of_values});
+        auto schedule = make_ray_schedule(number_of_values, pixel_of);
+        placement.run(
+            emissivity, schedule.get_number_of_tiles(),
+            [&](const tensors::tensor_3d &volume, size_t first, size_t last) {
+              LineOfSightIntegral integral(*line_of_sight, volume);
+              schedule.run(
+                  first, last, [&](const tbb::blocked_range<size_t> &range) {
+                    for (size_t i = range.begin(); i != range.end(); ++i) {
+                      auto result = integral.differentiate_observer(
+                          get_direction(pixel_of(i)));
+                      rows[0][i] = result.integral;
+                      for (size_t axis{}; axis != 3; ++axis) {
+                        rows[1 + axis][i] = result.gradient[axis];
+                      }
+                    }
+                  });
+            });
+        ray_load_balance += schedule.get_load_balance();
+        return rows;
+      });
+}
+
+tensors::tensor_1d
+Sky::compute_out_of_core_sky(const plane_reader &read_planes) const {
+  size_t number_of_pixels = pixel_range[1] - pixel_range[0];
+  size_t last_plane = emissivity_grid.z_centers.size() - 1;
+  size_t brick_planes = out_of_core_brick_planes;
+  auto read_brick = [&](size_t first_plane) {
+    return read_planes(first_plane,
+                       std::min(brick_planes, last_plane - first_plane) + 1);
+  };
+  tensors::tensor_1d sky(number_of_pixels);
+  std::future<tensors::tensor_3d> next_brick =
+      std::async(std::launch::async, read_brick, 0);
+  for (size_t first_plane{}; first_plane < last_plane;
+       first_plane += brick_planes) {
+    auto brick = next_brick.get();
+    if (first_plane + brick_planes < last_plane) {
+      next_brick = std::async(std::launch::async, read_brick,
+                              first_plane + brick_planes);
+    }
+    // the lines of sight are integrated over the z cells of the brick only
+    placement.run(
+        brick, number_of_pixels,
+        [&](const tensors::tensor_3d &volume, size_t first, size_t last) {
+          tbb::parallel_for(
+              tbb::blocked_range<size_t>(first, last),
+              [&](const tbb::blocked_range<size_t> &range) {
+                for (size_t pixel = range.begin(); pixel != range.end();
+                     ++pixel) {
+                  sky[pixel] += line_of_sight->integrate_planes(
+                      get_direction(pixel), volume, first_plane);
+                }
+              });
+        });
+  }
+  return sky;
+}
+
+unsigned Sky::find_mirrors(const tensors::tensor_3d &emissivity) const {
+  // the pyramid levels of the cone tracing aren't mirror-symmetric
+  if (cone_tracing) {
+    return 0;
+  }
+  return symmetry->get_pixel_mirrors() &
+         SkySymmetry::detect_mirrors(relative_emissivity_grid, emissivity,
+                                     symmetry_tolerance);
+}
+
+template <typename IntegratePixels>
+tensors::tensor_2d Sky::integrate_independent_pixels(
+    unsigned mirrors, const IntegratePixels &integrate_pixels) const {
+  size_t number_of_pixels = pixel_range[1] - pixel_range[0];
+  if (mirrors == 0) {
+    return integrate_pixels(number_of_pixels,
+                            [](size_t pixel) { return pixel; });
+  }
+
+  // only the representatives of the mirrored pixels get integrated
+  auto representatives = symmetry->make_representatives(mirrors, pixel_range);
+  std::vector<size_t> independent_pixels;
+  for (size_t pixel{}; pixel != number_of_pixels; ++pixel) {
+    if (representatives[pixel] == pixel) {
+      independent_pixels.push_back(pixel);
+    }
+  }
+  auto skies = integrate_pixels(
+      independent_pixels.size(),
+      [&independent_pixels](size_t i) { return independent_pixels[i]; });
+  for (auto &sky : skies) {
+    tensors::tensor_1d full_sky(number_of_pixels);
+    for (size_t i{}; i != independent_pixels.size(); ++i) {
+      full_sky[independent_pixels[i]] = sky[i];
+    }
+    for (size_t pixel{}; pixel != number_of_pixels; ++pixel) {
+      full_sky[pixel] = full_sky[representatives[pixel]];
+    }
+    sky = std::move(full_sky);
   }
+  number_of_mirrored_values +=
+      skies.size() * (number_of_pixels - independent_pixels.size());
   return skies;
 }
 
+tensors::tensor_1d
+Sky::compute_gamma_sky(const tensors::tensor_3d &emissivity,
+                       const std::vector<size_t> &pixels) const {
+  if (projection_operator) {
+    return (*projection_operator)(emissivity, pixels);
+  }
+  if (volume_compression != CompressedVolume::encoding::none) {
+    return integrate(compress_volume(emissivity), pixels.size(),
+                     [&pixels](size_t i) { return pixels[i]; });
+  }
+  return integrate(placement.replicate(emissivity), pixels.size(),
+                   [&pixels](size_t i) { return pixels[i]; });
+}
+
+template <typename PixelOf>
+tensors::tensor_1d Sky::integrate(const NumaPlacement::replicas &emissivity,
+                                  size_t number_of_values,
+                                  const PixelOf &pixel_of) const {
+  tensors::tensor_1d sky(number_of_values);
+  auto schedule = make_ray_schedule(number_of_values, pixel_of);
+  std::mutex bound_mutex;
+  // every NUMA node integrates its part of the values with its local volume
+  auto integrate_part = [&](const tensors::tensor_3d &volume, size_t first,
+                            size_t last) {
+    auto integrate_with = [&](const auto &integral) {
+      schedule.run(first, last, [&](const tbb::blocked_range<size_t> &range) {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+          sky[i] = integral(get_direction(pixel_of(i)));
+        }
+      });
+    };
+    if (cone_tracing) {
+      integrate_with(ConeTracingIntegral(radial_step_size, pixel_size,
+                                         relative_emissivity_grid, volume));
+    } else {
+      LineOfSightIntegral integral(*line_of_sight, volume, skipping_tolerance);
+      integrate_with(integral);
+      std::lock_guard<std::mutex> lock(bound_mutex);
+      skipping_error_bound = std::max(
+          skipping_error_bound, integral.get_maximum_relative_error_bound());
+    }
+  };
+  placement.run(emissivity, schedule.get_number_of_tiles(), integrate_part);
+  ray_load_balance += schedule.get_load_balance();
+  return sky;
+}
+
+template <typename PixelOf>
+tensors::tensor_1d Sky::integrate(const CompressedVolume &emissivity,
+                                  size_t number_of_values,
+                                  const PixelOf &pixel_of) const {
+  tensors::tensor_1d sky(number_of_values);
+  auto schedule = make_ray_schedule(number_of_values, pixel_of);
+  schedule.run(0, schedule.get_number_of_tiles(),
+               [&](const tbb::blocked_range<size_t> &range) {
+                 for (size_t i = range.begin(); i != range.end(); ++i) {
+                   sky[i] =
+                       (*line_of_sight)(get_direction(pixel_of(i)), emissivity);
+                 }
+               });
+  ray_load_balance += schedule.get_load_balance();
+  return sky;
+}
+
+template <typename PixelOf>
+RaySchedule Sky::make_ray_schedule(size_t number_of_values,
+                                   const PixelOf &pixel_of) const {
+  auto number_of_workers =
+      static_cast<size_t>(tbb::this_task_arena::max_concurrency());
+  if (ray_scheduling == RaySchedule::policy::equal_count) {
+    return {number_of_values, number_of_workers};
+  }
+  std::vector<double> costs(number_of_values);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, number_of_values),
+                    [&](const tbb::blocked_range<size_t> &range) {
+                      for (size_t i = range.begin(); i != range.end(); ++i) {
+                        costs[i] = RaySchedule::estimate_cost(
+                            relative_emissivity_grid, radial_step_size,
+                            get_direction(pixel_of(i)));
+                      }
+                    });
+  return {costs, number_of_workers};
+}
+
+ProjectionOperator Sky::make_projection_operator() const {
+  if (pixel_directions.empty()) {
+    return {get_line_of_sight_geometry(), relative_emissivity_grid,
+            make_pixel_directions()};
+  }
+  return {get_line_of_sight_geometry(), relative_emissivity_grid,
+          pixel_directions};
+}
+
+ProjectionOperator::line_of_sight_geometry
+Sky::get_line_of_sight_geometry() const {
+  return {radial_step_size, line_of_sight_longitude, line_of_sight_latitude,
+          pixel_range[0]};
+}
+
+void Sky::use_projection_operator(ProjectionOperator projection_operator) {
+  check_parameter(!cone_tracing,
+                  "Cone tracing can't be combined with the projection "
+                  "operator. Please check the parameters cone_tracing and "
+                  "use_projection_operator in the parameter file.");
+  check_parameter(distance_bin_edges.empty(),
+                  "Distance-resolved skies can't be combined with the "
+                  "projection operator. Please check the parameters "
+                  "distance_bins_in_kpc and use_projection_operator in the "
+                  "parameter file.");
+  check_parameter(!observer_gradient,
+                  "Observer gradients can't be combined with the projection "
+                  "operator. Please check the parameters observer_gradient "
+                  "and use_projection_operator in the parameter file.");
+  check_parameter(volume_compression == CompressedVolume::encoding::none,
+                  "Compressed volumes can't be combined with the projection "
+                  "operator. Please check the parameters volume_compression "
+                  "and use_projection_operator in the parameter file.");
+  // the relative grid centers cover both the emissivity grid and the
+  // location of the observer
+  std::array<std::vector<double>, 3> grid_centers{
+      relative_emissivity_grid.x_centers, relative_emissivity_grid.y_centers,
+      relative_emissivity_grid.z_centers};
+  // the radial step size, the line of sight and the first pixel determine
+  // the lines of sight of the rows
+  check_parameter(
+      projection_operator.get_grid_centers() == grid_centers &&
+          projection_operator.get_number_of_pixels() ==
+              pixel_range[1] - pixel_range[0] &&
+          projection_operator.get_geometry() == get_line_of_sight_geometry(),
+      "The projection operator doesn't match the emissivity grid, the "
+      "observer location, the radial step size, the line of sight, the "
+      "HEALPix order or the pixel range of the shard. Please delete the file "
+      "given by the parameter projection_operator_file in the parameter "
+      "file.");
+  this->projection_operator = std::move(projection_operator);
+}
+
 std::vector<double> Sky::make_relative_grid(const std::vector<double> &grid,
                                             double observer_location) {
   std::vector<double> relative_grid;
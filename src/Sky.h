@@ -2,27 +2,307 @@
 #ifndef GAMMA_SKY_SRC_SKY_H
 #define GAMMA_SKY_SRC_SKY_H
 
+#include "CompressedVolume.h"
+#include "LineOfSightIntegral.h"
+#include "NumaPlacement.h"
 #include "ParameterFile.h"
+#include "PixelDirections.h"
+#include "ProjectionOperator.h"
+#include "RaySchedule.h"
+#include "SkySymmetry.h"
 #include "grids.h"
+#include "mathematics.h"
 #include "tensors.h"
-#include <healpix_map.h>
+#include <functional>
+#include <healpix_base.h>
+#include <optional>
 
 using std::size_t;
 
 class Sky {
 public:
+  /**
+   * Receives a computed sky.
+   * @param row row of the sky within the skies (selected energy or band)
+   * @param sky sky[pixel - first pixel] in MeV / (s sr cm²)
+   */
+  using sky_consumer =
+      std::function<void(size_t row, const tensors::tensor_1d &sky)>;
+  /**
+   * Receives the preview skies of a progressive computation.
+   * @param order HEALPix order of the preview
+   * @param skies skies[selected energy][RING pixel of the order] in
+   *              MeV / (s sr cm²)
+   */
+  using preview_consumer =
+      std::function<void(int order, const tensors::tensor_2d &skies)>;
+  /**
+   * Reads the z planes [first_plane, first_plane + number_of_planes) of an
+   * emissivity volume as planes[x][y][z - first_plane].
+   */
+  using plane_reader = std::function<tensors::tensor_3d(
+      size_t first_plane, size_t number_of_planes)>;
+
+  /**
+   * @throws std::invalid_argument if the parameters are invalid
+   */
   Sky(const std::vector<double> &energies,
       const tensors::tensor_4d &emissivities,
       const grids::cartesian_grid_3d &emissivity_grid,
       ParameterFile::Parameters &parameters);
+  /**
+   * Computes the skies of all selected energies (see the parameter
+   * energy_indices) within the selected pixel range. If the parameter
+   * energy_decomposition_components is positive, only the basis volumes of
+   * the truncated energy decomposition get integrated.
+   * @return skies[selected energy][pixel - first pixel] in MeV / (s sr cm²)
+   */
   tensors::tensor_2d compute_gamma_skies();
+  /**
+   * Computes the skies like compute_gamma_skies, but hands each sky to the
+   * consumer as soon as it is available instead of keeping all skies in
+   * memory.
+   * @param skipped_rows rows that are already known and don't get computed
+   *                     (empty: compute all rows)
+   */
+  void compute_gamma_skies(const std::vector<bool> &skipped_rows,
+                           const sky_consumer &consume);
+  /**
+   * Compresses the resident emissivity volume of an energy by the parameter
+   * volume_compression, such that the caller can free the double precision
+   * volume right after reading it. compute_gamma_skies and
+   * compute_progressive_gamma_skies integrate the compressed volume instead
+   * and free it after the sky of the energy.
+   * @param energy index of a computed energy whose volume is resident
+   * @throws std::invalid_argument if the volumes aren't compressed or are
+   *                               integrated by cone tracing or the
+   *                               projection operator
+   */
+  void compress_emissivity(size_t energy);
+  /**
+   * Computes the skies like compute_gamma_skies, but level by level with
+   * increasing HEALPix order o = 0, 1, ..., healpix_order. Level o computes
+   * the target order pixels whose NESTED index is a multiple of
+   * 4^(healpix_order - o), i.e., the first descendant of every order o pixel
+   * that isn't a descendant of a coarser level. After every level below the
+   * target order, the preview of that order (every pixel showing the value of
+   * its first descendant) is handed to the consumer. Every pixel is computed
+   * exactly once.
+   * @return skies[selected energy][pixel] in MeV / (s sr cm²)
+   * @throws std::invalid_argument if only a part of the pixels is selected
+   */
+  tensors::tensor_2d
+  compute_progressive_gamma_skies(const preview_consumer &consume_preview);
+  /**
+   * Interpolates the skies at the requested energies (see the parameter
+   * requested_energies_in_MeV) linearly in log-log space between the skies
+   * of the bracketing energies of the input file (linearly in ln(energy) for
+   * pixels with a non-positive bracketing sky).
+   * @param skies skies[selected energy][pixel - first pixel] of the energies
+   *              of get_energy_indices() in MeV / (s sr cm²)
+   * @return skies[requested energy][pixel - first pixel] in MeV / (s sr cm²)
+   */
+  [[nodiscard]] tensors::tensor_2d
+  interpolate_requested_skies(const tensors::tensor_2d &skies) const;
+  /**
+   * Computes the skies integrated over the energy bands of the parameter
+   * energy_bands_in_MeV. The emissivities are combined first (trapezoidal
+   * rule in ln(energy)), such that only one sky per band gets integrated.
+   * @return skies[band][pixel - first pixel] in MeV / (s sr cm²)
+   */
+  tensors::tensor_2d compute_gamma_band_skies();
+  /**
+   * Computes the band skies like compute_gamma_band_skies, but hands each sky
+   * to the consumer as soon as it is available.
+   * @param skipped_rows bands that are already known and don't get computed
+   *                     (empty: compute all bands)
+   */
+  void compute_gamma_band_skies(const std::vector<bool> &skipped_rows,
+                                const sky_consumer &consume);
+  /**
+   * Computes the sky of a single emissivity volume. Compressed volumes (see
+   * the parameter volume_compression) are compressed once and shared by the
+   * NUMA nodes.
+   * @param emissivity emissivity[x][y][z] in MeV / (s sr cm³)
+   * @return sky[pixel - first pixel] in MeV / (s sr cm²)
+   */
+  [[nodiscard]] tensors::tensor_1d
+  compute_gamma_sky(const tensors::tensor_3d &emissivity) const;
+  /**
+   * Computes the skies of several emissivity components of the same energy
+   * (e.g., pion decay, inverse Compton and bremsstrahlung). The line of sight
+   * integration traverses every line of sight once for all components.
+   * @param components components[component][x][y][z] in MeV / (s sr cm³)
+   * @return skies[component][pixel - first pixel] in MeV / (s sr cm²)
+   */
+  [[nodiscard]] tensors::tensor_2d
+  compute_gamma_component_skies(const tensors::tensor_4d &components) const;
+  /**
+   * Computes the sky of a single emissivity volume and resolves it by the
+   * distance from the observer (see the parameter distance_bins_in_kpc)
+   * along the same traversal of the lines of sight.
+   * @param emissivity emissivity[x][y][z] in MeV / (s sr cm³)
+   * @return rows[0][pixel - first pixel] sky in MeV / (s sr cm²),
+   *         rows[1][pixel - first pixel] flux-weighted mean distance in kpc
+   *         and rows[2 + bin][pixel - first pixel] part of the sky within
+   *         the distance bin in MeV / (s sr cm²)
+   */
+  [[nodiscard]] tensors::tensor_2d
+  compute_distance_resolved_sky(const tensors::tensor_3d &emissivity) const;
+  /**
+   * Computes the sky of a single emissivity volume together with its
+   * derivatives with respect to the observer location along the same
+   * traversal of the lines of sight (no mirror symmetries, since mirrored
+   * pixels have mirrored gradients).
+   * @param emissivity emissivity[x][y][z] in MeV / (s sr cm³)
+   * @return rows[0][pixel - first pixel] sky in MeV / (s sr cm²) and
+   *         rows[1 + axis][pixel - first pixel] derivative of the sky with
+   *         respect to the {x, y, z} observer location in
+   *         MeV / (s sr cm² kpc)
+   */
+  [[nodiscard]] tensors::tensor_2d
+  compute_observer_gradient_sky(const tensors::tensor_3d &emissivity) const;
+  /**
+   * Computes the sky of an emissivity volume that doesn't fit into the
+   * memory. The volume is read in bricks of out_of_core_brick_planes cells
+   * along z (consecutive bricks share a boundary plane), each brick is read
+   * once while the previous one is integrated, and the partial integrals of
+   * the lines of sight are accumulated per pixel.
+   * @param read_planes reads the z planes of the emissivity volume in
+   *                    MeV / (s sr cm³)
+   * @return sky[pixel - first pixel] in MeV / (s sr cm²)
+   */
+  [[nodiscard]] tensors::tensor_1d
+  compute_out_of_core_sky(const plane_reader &read_planes) const;
+  /**
+   * Computes a part of the sky of a single emissivity volume.
+   * @param emissivity emissivity[x][y][z] in MeV / (s sr cm³)
+   * @param pixels pixels relative to the first pixel of the pixel range
+   * @return sky[i] of the pixel pixels[i] in MeV / (s sr cm²)
+   */
+  [[nodiscard]] tensors::tensor_1d
+  compute_gamma_sky(const tensors::tensor_3d &emissivity,
+                    const std::vector<size_t> &pixels) const;
+  /**
+   * Stores the directions of the sky pixels instead of recomputing them for
+   * every sky (costs 12 bytes per pixel).
+   */
+  void store_pixel_directions();
+  /**
+   * Assembles the sparse operator that projects an emissivity volume onto the
+   * sky pixels for the current observer, grid, radial step size, line of
+   * sight, HEALPix order and pixel range.
+   */
+  [[nodiscard]] ProjectionOperator make_projection_operator() const;
+  /**
+   * Evaluates all following skies via sparse matrix-vector products instead
+   * of ray marching.
+   * @param projection_operator operator created by make_projection_operator
+   * @throws std::invalid_argument if the operator doesn't match the sky
+   */
+  void use_projection_operator(ProjectionOperator projection_operator);
+  /**
+   * @return HEALPix pixels [first, last) that are computed
+   */
+  [[nodiscard]] const std::array<size_t, 2> &get_pixel_range() const {
+    return pixel_range;
+  }
+  /**
+   * @return ascending indices of the energies that are computed
+   */
+  [[nodiscard]] const std::vector<size_t> &get_energy_indices() const {
+    return energy_indices;
+  }
+  /**
+   * @return energies in MeV at which the skies are interpolated (empty if
+   *         all selected energies are computed as they are)
+   */
+  [[nodiscard]] const std::vector<double> &get_requested_energies() const {
+    return requested_energies;
+  }
+  /**
+   * @return ascending edges of the distance bins in kpc (empty if the skies
+   *         aren't resolved by distance)
+   */
+  [[nodiscard]] const std::vector<double> &get_distance_bin_edges() const {
+    return distance_bin_edges;
+  }
+  /**
+   * @return total number of HEALPix pixels of the sky
+   */
+  [[nodiscard]] size_t get_number_of_sky_pixels() const {
+    return number_of_sky_pixels;
+  }
+  /**
+   * @return relative truncation errors of the energy decomposition per energy
+   *         (empty if no decomposition was used)
+   */
+  [[nodiscard]] const std::vector<double> &
+  get_energy_decomposition_errors() const {
+    return energy_decomposition_errors;
+  }
+  /**
+   * @return largest quantization error of the compressed volumes of all skies
+   *         computed so far relative to the maximum of their volume
+   */
+  [[nodiscard]] double get_compression_error() const {
+    return compression_error;
+  }
+  /**
+   * @return placement of the emissivity volumes on the NUMA nodes
+   */
+  [[nodiscard]] const NumaPlacement &get_placement() const {
+    return placement;
+  }
+  /**
+   * @return largest relative error bound of the empty space skipping of all
+   *         skies computed so far (0 if nothing was skipped)
+   */
+  [[nodiscard]] double get_skipping_error_bound() const {
+    return skipping_error_bound;
+  }
+  /**
+   * @return number of sky values of all skies computed so far that were
+   *         mirrored from other pixels instead of integrated
+   */
+  [[nodiscard]] size_t get_number_of_mirrored_values() const {
+    return number_of_mirrored_values;
+  }
+  /**
+   * @return predicted and measured loads of the workers summed over all skies
+   *         computed so far by ray marching or cone tracing
+   */
+  [[nodiscard]] const RaySchedule::load_balance &get_ray_load_balance() const {
+    return ray_load_balance;
+  }
 
 private:
+  /**
+   * Compressed copy of an emissivity volume.
+   */
+  struct compressed_emissivity {
+    CompressedVolume volume;
+    // mirror planes of the double precision volume
+    unsigned mirrors;
+  };
+
   static void check_parameter(bool condition,
                               const std::string &condition_string);
   void check_parameters() const;
-  void initialize_sky_pixels();
+  /**
+   * Brackets the requested energies by the energies of the input file and
+   * selects the bracketing energies as the energies that are computed.
+   */
+  void initialize_requested_energies();
+  void initialize_sky_pixels(
+      const std::optional<std::array<size_t, 2>> &selected_pixel_range);
   void initialize_relative_emissivity_grid();
+  /**
+   * @return radial step size, line of sight and first pixel, which the
+   *         projection operators of the sky are assembled for
+   */
+  [[nodiscard]] ProjectionOperator::line_of_sight_geometry
+  get_line_of_sight_geometry() const;
   /**
    * Subtracts the observer location from the grid.
    * @param grid cartesian grid
@@ -31,13 +311,100 @@ private:
    */
   static std::vector<double> make_relative_grid(const std::vector<double> &grid,
                                                 double observer_location);
+  /**
+   * Evaluates the line of sight integrals (or cone integrals) of pixels in
+   * parallel.
+   * @param emissivity replicas of the emissivity volume on the NUMA nodes
+   * @param number_of_values number of pixels that are integrated
+   * @param pixel_of pixel_of(i) is the pixel (relative to the first pixel of
+   *                 the pixel range) of sky[i]
+   * @return sky[i] in MeV / (s sr cm²)
+   */
+  template <typename PixelOf>
+  [[nodiscard]] tensors::tensor_1d
+  integrate(const NumaPlacement::replicas &emissivity,
+            size_t number_of_values, const PixelOf &pixel_of) const;
+  /**
+   * Evaluates the line of sight integrals of a compressed volume like the
+   * overload above (the nodes share the compressed volume).
+   */
+  template <typename PixelOf>
+  [[nodiscard]] tensors::tensor_1d
+  integrate(const CompressedVolume &emissivity, size_t number_of_values,
+            const PixelOf &pixel_of) const;
+  /**
+   * @return compressed copy of a volume by the parameter volume_compression
+   *         (updates the compression error)
+   */
+  [[nodiscard]] CompressedVolume
+  compress_volume(const tensors::tensor_3d &emissivity) const;
+  /**
+   * Computes the sky of a compressed volume like compute_gamma_sky.
+   */
+  [[nodiscard]] tensors::tensor_1d
+  compute_gamma_sky(const compressed_emissivity &emissivity) const;
+  /**
+   * Schedules the lines of sight of the pixels pixel_of(i) with
+   * i in [0, number_of_values) by the parameter ray_scheduling.
+   */
+  template <typename PixelOf>
+  [[nodiscard]] RaySchedule make_ray_schedule(size_t number_of_values,
+                                              const PixelOf &pixel_of) const;
+  /**
+   * @return mirror planes of the emissivity that map the sky pixels onto
+   *         pixels (0 if the symmetries aren't used)
+   */
+  [[nodiscard]] unsigned
+  find_mirrors(const tensors::tensor_3d &emissivity) const;
+  /**
+   * Evaluates skies for all pixels of the pixel range, but integrates only
+   * the representatives of the pixels that are mapped onto each other by the
+   * mirrors and copies the others.
+   * @param integrate_pixels integrate_pixels(number_of_values, pixel_of)
+   *                         returns skies[row][i] of the pixels pixel_of(i)
+   * @return skies[row][pixel - first pixel]
+   */
+  template <typename IntegratePixels>
+  [[nodiscard]] tensors::tensor_2d
+  integrate_independent_pixels(unsigned mirrors,
+                               const IntegratePixels &integrate_pixels) const;
+  /**
+   * @return collects the skies consumed by a sky_consumer
+   */
+  static sky_consumer collect_into(tensors::tensor_2d &skies);
+  /**
+   * @param pixel pixel relative to the first pixel of the pixel range
+   * @return unit vector of the line of sight
+   */
+  [[nodiscard]] std::array<double, 3> compute_direction(size_t pixel) const;
+  /**
+   * @return directions of all pixels within the pixel range (computed in
+   *         parallel)
+   */
+  [[nodiscard]] PixelDirections make_pixel_directions() const;
+  [[nodiscard]] std::array<double, 3> get_direction(size_t pixel) const {
+    if (pixel_directions.empty()) {
+      return compute_direction(pixel);
+    }
+    return pixel_directions[pixel];
+  }
 
-  // longitudes and latitudes of the sky pixels in radian
-  tensors::tensor_2d sky_coordinates;
+  // directions of the sky pixels within the pixel range (empty if they are
+  // computed on the fly)
+  PixelDirections pixel_directions;
+  // RING scheme of the target HEALPix order
+  Healpix_Base healpix_base;
   size_t number_of_sky_pixels{};
+  // HEALPix pixels [first, last) that are computed
+  std::array<size_t, 2> pixel_range{};
+  // ascending indices of the energies that are computed
+  std::vector<size_t> energy_indices;
   // the grid of the emissivities subtracted by the location of the observer in
   // kpc
   grids::cartesian_grid_3d relative_emissivity_grid;
+  // radial cells and axis lookups on the relative emissivity grid, which are
+  // built once and shared by the integrals of all volumes
+  std::optional<LineOfSightIntegral> line_of_sight;
   // energies of the emissivities in MeV
   const std::vector<double> &energies;
   // emissivities[energy][x][y][z] in MeV / (s sr cm³)
@@ -54,6 +421,47 @@ private:
   double line_of_sight_longitude;
   // latitude of the direction in which the observer looks in radian
   double line_of_sight_latitude;
+  // number of basis volumes of the energy decomposition (0: disabled)
+  int energy_decomposition_components;
+  std::vector<double> energy_decomposition_errors;
+  // energies in MeV at which the skies are interpolated (empty: disabled)
+  std::vector<double> requested_energies;
+  // requested_brackets[requested energy] indices of the bracketing energies
+  std::vector<mathematics::log_bracket> requested_brackets;
+  // {lower, upper} energy band edges in MeV
+  std::vector<std::array<double, 2>> energy_bands;
+  // ascending edges of the distance bins in kpc (empty: disabled)
+  std::vector<double> distance_bin_edges;
+  // compute the derivatives with respect to the observer location
+  bool observer_gradient;
+  // number of cells along z of the out-of-core bricks (0: disabled)
+  size_t out_of_core_brick_planes;
+  // integrate over the cones of the pixels via an emissivity pyramid
+  bool cone_tracing;
+  // angular size of a pixel in radian
+  double pixel_size{};
+  // relative tolerance of the empty space skipping (0: disabled)
+  double skipping_tolerance;
+  // updated by the const sky computations
+  mutable double skipping_error_bound{};
+  // largest relative difference of mirrored emissivities for which a mirror
+  // symmetry gets used (negative: disabled)
+  double symmetry_tolerance;
+  // set after the HEALPix order was checked
+  std::optional<SkySymmetry> symmetry;
+  mutable size_t number_of_mirrored_values{};
+  // 16 bit encoding of the integrated volumes (none: double precision)
+  CompressedVolume::encoding volume_compression;
+  mutable double compression_error{};
+  // compressed_emissivities[energy] (set from compress_emissivity until the
+  // sky of the energy is computed)
+  std::vector<std::optional<compressed_emissivity>> compressed_emissivities;
+  // split of the lines of sight among the workers
+  RaySchedule::policy ray_scheduling;
+  mutable RaySchedule::load_balance ray_load_balance;
+  NumaPlacement placement;
+  // replaces the ray marching if set
+  std::optional<ProjectionOperator> projection_operator;
 };
 
 #endif // GAMMA_SKY_SRC_SKY_H
@@ -0,0 +1,154 @@
+// Author: Stefan Lepperdinger
+#include "SkySymmetry.h"
+#include "mathematics.h"
+#include <algorithm>
+#include <cmath>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace {
+
+bool is_multiple_of(double angle, double unit) {
+  double ratio = angle / unit;
+  return std::abs(ratio - std::round(ratio)) <= 1e-9;
+}
+
+/**
+ * @return whether the points are mirror-symmetric with respect to 0
+ */
+bool is_symmetric(const std::vector<double> &points) {
+  // the grids are stored in single precision
+  double tolerance = 1e-6 * (points.back() - points.front());
+  for (size_t i{}; i != points.size(); ++i) {
+    if (std::abs(points[i] + points[points.size() - 1 - i]) > tolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+SkySymmetry::SkySymmetry(const Healpix_Base &healpix_base,
+                         double line_of_sight_longitude,
+                         double line_of_sight_latitude)
+    : healpix_base(healpix_base),
+      line_of_sight_longitude(line_of_sight_longitude),
+      line_of_sight_latitude(line_of_sight_latitude) {
+  // the longitude mirrors map l + Λ onto -l - Λ (+ 180°) for pixel
+  // longitudes l, which are pixel longitudes again if 2Λ is a multiple of 90°
+  if (is_multiple_of(2. * line_of_sight_longitude, mathematics::half_pi)) {
+    pixel_mirrors |= x_mirror | y_mirror;
+  }
+  // the latitudes are shifted instead of rotated
+  if (std::abs(line_of_sight_latitude) <= 1e-9) {
+    pixel_mirrors |= z_mirror;
+  }
+}
+
+unsigned
+SkySymmetry::detect_mirrors(const grids::cartesian_grid_3d &relative_grid,
+                            const tensors::tensor_3d &values,
+                            double tolerance) {
+  if (tolerance < 0.) {
+    return 0;
+  }
+  unsigned mirrors{};
+  if (is_symmetric(relative_grid.x_centers)) {
+    mirrors |= x_mirror;
+  }
+  if (is_symmetric(relative_grid.y_centers)) {
+    mirrors |= y_mirror;
+  }
+  if (is_symmetric(relative_grid.z_centers)) {
+    mirrors |= z_mirror;
+  }
+  if (mirrors == 0) {
+    return 0;
+  }
+
+  double maximum{};
+  for (const auto &plane : values) {
+    for (const auto &row : plane) {
+      for (double value : row) {
+        maximum = std::max(maximum, std::abs(value));
+      }
+    }
+  }
+  double absolute_tolerance = tolerance * maximum;
+  size_t x_size = values.size();
+  size_t y_size = values[0].size();
+  size_t z_size = values[0][0].size();
+  for (size_t x{}; x != x_size; ++x) {
+    for (size_t y{}; y != y_size; ++y) {
+      for (size_t z{}; z != z_size; ++z) {
+        double value = values[x][y][z];
+        if ((mirrors & x_mirror) &&
+            std::abs(value - values[x_size - 1 - x][y][z]) >
+                absolute_tolerance) {
+          mirrors &= ~x_mirror;
+        }
+        if ((mirrors & y_mirror) &&
+            std::abs(value - values[x][y_size - 1 - y][z]) >
+                absolute_tolerance) {
+          mirrors &= ~y_mirror;
+        }
+        if ((mirrors & z_mirror) &&
+            std::abs(value - values[x][y][z_size - 1 - z]) >
+                absolute_tolerance) {
+          mirrors &= ~z_mirror;
+        }
+      }
+      if (mirrors == 0) {
+        return 0;
+      }
+    }
+  }
+  return mirrors;
+}
+
+size_t SkySymmetry::mirror_pixel(size_t pixel, unsigned mirrors) const {
+  auto angles = healpix_base.pix2ang(static_cast<int>(pixel));
+  double longitude = angles.phi + line_of_sight_longitude;
+  double latitude =
+      mathematics::half_pi - angles.theta + line_of_sight_latitude;
+  if (mirrors & x_mirror) {
+    longitude = mathematics::pi - longitude;
+  }
+  if (mirrors & y_mirror) {
+    longitude = -longitude;
+  }
+  if (mirrors & z_mirror) {
+    latitude = -latitude;
+  }
+
+  double phi =
+      std::fmod(longitude - line_of_sight_longitude, mathematics::two_pi);
+  if (phi < 0.) {
+    phi += mathematics::two_pi;
+  }
+  double theta = mathematics::half_pi - (latitude - line_of_sight_latitude);
+  return static_cast<size_t>(healpix_base.ang2pix(pointing(theta, phi)));
+}
+
+std::vector<size_t> SkySymmetry::make_representatives(
+    unsigned mirrors, const std::array<size_t, 2> &pixel_range) const {
+  std::vector<size_t> representatives(pixel_range[1] - pixel_range[0]);
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, representatives.size()),
+      [&](const tbb::blocked_range<size_t> &range) {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+          size_t representative = pixel_range[0] + i;
+          // all non-empty combinations of the mirrors
+          for (unsigned combination = mirrors; combination != 0;
+               combination = (combination - 1) & mirrors) {
+            auto pixel = mirror_pixel(pixel_range[0] + i, combination);
+            if (pixel >= pixel_range[0] && pixel < pixel_range[1]) {
+              representative = std::min(representative, pixel);
+            }
+          }
+          representatives[i] = representative - pixel_range[0];
+        }
+      });
+  return representatives;
+}
@@ -0,0 +1,83 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_SKYSYMMETRY_H
+#define GAMMA_SKY_SRC_SKYSYMMETRY_H
+
+#include "grids.h"
+#include "tensors.h"
+#include <array>
+#include <healpix_base.h>
+#include <vector>
+
+using std::size_t;
+
+/**
+ * Mirror symmetries of an emissivity volume with respect to the planes
+ * x = 0, y = 0 and z = 0 through the observer.
+ *
+ * A mirror plane of the volume mirrors the sky: the plane z = 0 maps the
+ * latitude b onto -b, y = 0 maps the longitude l onto -l and x = 0 maps l
+ * onto 180° - l. The HEALPix pixel centers are symmetric with respect to the
+ * equator and to the longitudes that are multiples of 45°, so a mirror of the
+ * sky maps pixels onto pixels if the direction in which the observer looks
+ * keeps these symmetries. Only one pixel of every set of mirrored pixels has
+ * to be integrated then.
+ */
+class SkySymmetry {
+public:
+  // combinations of the mirror planes are or-ed bit masks
+  static constexpr unsigned x_mirror = 1;
+  static constexpr unsigned y_mirror = 2;
+  static constexpr unsigned z_mirror = 4;
+
+  /**
+   * @param healpix_base RING scheme of the sky
+   * @param line_of_sight_longitude longitude of the direction in which the
+   *                                observer looks in radian
+   * @param line_of_sight_latitude latitude of the direction in which the
+   *                               observer looks in radian
+   */
+  SkySymmetry(const Healpix_Base &healpix_base, double line_of_sight_longitude,
+              double line_of_sight_latitude);
+
+  /**
+   * Detects the mirror planes of a volume.
+   * @param relative_grid cartesian grid relative to the observer
+   * @param values values[x][y][z] at the grid points
+   * @param tolerance largest difference of mirrored values relative to the
+   *                  maximum absolute value (negative: no detection)
+   * @return mirror planes for which both the grid and the values are
+   *         symmetric
+   */
+  static unsigned detect_mirrors(const grids::cartesian_grid_3d &relative_grid,
+                                 const tensors::tensor_3d &values,
+                                 double tolerance);
+  /**
+   * @return mirror planes that map the HEALPix pixels onto pixels
+   */
+  [[nodiscard]] unsigned get_pixel_mirrors() const { return pixel_mirrors; }
+  /**
+   * @param pixel HEALPix pixel
+   * @param mirrors combination of pixel mirrors
+   * @return pixel mirrored at all planes of the combination
+   */
+  [[nodiscard]] size_t mirror_pixel(size_t pixel, unsigned mirrors) const;
+  /**
+   * Chooses the pixel that gets integrated for every set of pixels that are
+   * mapped onto each other by the mirrors (the smallest one within the pixel
+   * range).
+   * @param mirrors mirror planes of the volume and the pixels
+   * @param pixel_range HEALPix pixels [first, last)
+   * @return representatives[pixel - first] - first (computed in parallel)
+   */
+  [[nodiscard]] std::vector<size_t>
+  make_representatives(unsigned mirrors,
+                       const std::array<size_t, 2> &pixel_range) const;
+
+private:
+  Healpix_Base healpix_base;
+  double line_of_sight_longitude;
+  double line_of_sight_latitude;
+  unsigned pixel_mirrors{};
+};
+
+#endif // GAMMA_SKY_SRC_SKYSYMMETRY_H
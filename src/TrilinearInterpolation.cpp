@@ -1,29 +1,27 @@
 // Author: Stefan Lepperdinger
 #include "TrilinearInterpolation.h"
-#include <cmath>
 
 TrilinearInterpolation::TrilinearInterpolation(
     const grids::cartesian_grid_3d &grid, const tensors::tensor_3d &values)
-    : x_min(grid.x_centers.front()), y_min(grid.y_centers.front()),
-      z_min(grid.z_centers.front()),
-      x_step_size(grid.x_centers[1] - grid.x_centers[0]),
-      y_step_size(grid.y_centers[1] - grid.y_centers[0]),
-      z_step_size(grid.z_centers[1] - grid.z_centers[0]), values(values) {}
-
-double TrilinearInterpolation::operator()(std::array<double, 3> xyz_location) {
-  double double_x_index = (xyz_location[0] - x_min) / x_step_size;
-  double double_y_index = (xyz_location[1] - y_min) / y_step_size;
-  double double_z_index = (xyz_location[2] - z_min) / z_step_size;
-
-  // cell index
-  auto x_i = static_cast<size_t>(double_x_index);
-  auto y_i = static_cast<size_t>(double_y_index);
-  auto z_i = static_cast<size_t>(double_z_index);
-
-  // position within the unit cell
-  double x_p = double_x_index - static_cast<double>(x_i);
-  double y_p = double_y_index - static_cast<double>(y_i);
-  double z_p = double_z_index - static_cast<double>(z_i);
+    : axes(std::make_shared<const axis_lookups>(
+          axis_lookups{grids::axis_lookup(grid.x_centers),
+                       grids::axis_lookup(grid.y_centers),
+                       grids::axis_lookup(grid.z_centers)})),
+      values(values) {}
+
+TrilinearInterpolation::TrilinearInterpolation(
+    const TrilinearInterpolation &interpolation,
+    const tensors::tensor_3d &values)
+    : axes(interpolation.axes), values(values) {}
+
+double
+TrilinearInterpolation::operator()(std::array<double, 3> xyz_location) const {
+  // cell index and position within the cell
+  size_t x_i, y_i, z_i;
+  double x_p, y_p, z_p;
+  axes->x.locate(xyz_location[0], x_i, x_p);
+  axes->y.locate(xyz_location[1], y_i, y_p);
+  axes->z.locate(xyz_location[2], z_i, z_p);
 
   // see http://paulbourke.net/miscellaneous/interpolation/
   double interpolated_value =
@@ -39,3 +37,44 @@ double TrilinearInterpolation::operator()(std::array<double, 3> xyz_location) {
 
   return interpolated_value;
 }
+
+std::array<double, 4> TrilinearInterpolation::interpolate_with_gradient(
+    const std::array<double, 3> &xyz_location) const {
+  size_t x_i, y_i, z_i;
+  double x_p, y_p, z_p;
+  axes->x.locate(xyz_location[0], x_i, x_p);
+  axes->y.locate(xyz_location[1], y_i, y_p);
+  axes->z.locate(xyz_location[2], z_i, z_p);
+
+  const auto &plane = values[x_i];
+  const auto &next_plane = values[x_i + 1];
+  double v000 = plane[y_i][z_i];
+  double v100 = next_plane[y_i][z_i];
+  double v010 = plane[y_i + 1][z_i];
+  double v001 = plane[y_i][z_i + 1];
+  double v101 = next_plane[y_i][z_i + 1];
+  double v011 = plane[y_i + 1][z_i + 1];
+  double v110 = next_plane[y_i + 1][z_i];
+  double v111 = next_plane[y_i + 1][z_i + 1];
+
+  // same order of the operations as operator()
+  double value = (v000 * (1 - x_p) * (1 - y_p) * (1 - z_p) +
+                  v100 * x_p * (1 - y_p) * (1 - z_p) +
+                  v010 * (1 - x_p) * y_p * (1 - z_p) +
+                  v001 * (1 - x_p) * (1 - y_p) * z_p +
+                  v101 * x_p * (1 - y_p) * z_p + v011 * (1 - x_p) * y_p * z_p +
+                  v110 * x_p * y_p * (1 - z_p) + v111 * x_p * y_p * z_p);
+  // differences along an axis, bilinearly interpolated over the other axes
+  double d_x = (v100 - v000) * (1 - y_p) * (1 - z_p) +
+               (v110 - v010) * y_p * (1 - z_p) +
+               (v101 - v001) * (1 - y_p) * z_p + (v111 - v011) * y_p * z_p;
+  double d_y = (v010 - v000) * (1 - x_p) * (1 - z_p) +
+               (v110 - v100) * x_p * (1 - z_p) +
+               (v011 - v001) * (1 - x_p) * z_p + (v111 - v101) * x_p * z_p;
+  double d_z = (v001 - v000) * (1 - x_p) * (1 - y_p) +
+               (v101 - v100) * x_p * (1 - y_p) +
+               (v011 - v010) * (1 - x_p) * y_p + (v111 - v110) * x_p * y_p;
+  return {value, d_x * axes->x.get_inverse_cell_width(x_i),
+          d_y * axes->y.get_inverse_cell_width(y_i),
+          d_z * axes->z.get_inverse_cell_width(z_i)};
+}
@@ -4,31 +4,103 @@
 
 #include "grids.h"
 #include "tensors.h"
+#include <array>
+#include <memory>
 
 using std::size_t;
 
 class TrilinearInterpolation {
 public:
   /**
-   * @param grid linear (!) cartesian grid
+   * Cell and weights of an interpolation location, which can be shared by
+   * several volumes on the same grid.
+   */
+  struct stencil {
+    // cell index
+    size_t x, y, z;
+    // weights of the corners 000, 100, 010, 001, 101, 011, 110, 111
+    std::array<double, 8> weights;
+  };
+
+  /**
+   * @param grid cartesian grid, whose axes may be non-uniform
    * @param values values[x][y][z] at the grid points
    */
   TrilinearInterpolation(const grids::cartesian_grid_3d &grid,
                          const tensors::tensor_3d &values);
+  /**
+   * Interpolation of other values on the grid of an interpolation, which
+   * shares the axis lookups of the interpolation instead of rebuilding them.
+   * @param interpolation interpolation on the same grid
+   * @param values values[x][y][z] at the grid points
+   */
+  TrilinearInterpolation(const TrilinearInterpolation &interpolation,
+                         const tensors::tensor_3d &values);
   /**
    * Interpolates the value at the specified location.
    * @param xyz_location interpolation location
    * @return interpolated value
    */
-  double operator()(std::array<double, 3> xyz_location);
+  double operator()(std::array<double, 3> xyz_location) const;
+  /**
+   * Interpolates the value and its spatial gradient, i.e., the derivatives
+   * of the trilinear polynomial of the cell that contains the location, with
+   * a single lookup.
+   * @param xyz_location interpolation location
+   * @return {value, d/dx, d/dy, d/dz} (the value equals operator())
+   */
+  [[nodiscard]] std::array<double, 4>
+  interpolate_with_gradient(const std::array<double, 3> &xyz_location) const;
+  /**
+   * @param xyz_location interpolation location
+   * @return cell and weights of the location
+   */
+  [[nodiscard]] stencil
+  locate(const std::array<double, 3> &xyz_location) const {
+    // defined here, such that the ray marching loops can inline it
+    stencil cell{};
+    double x_p, y_p, z_p;
+    axes->x.locate(xyz_location[0], cell.x, x_p);
+    axes->y.locate(xyz_location[1], cell.y, y_p);
+    axes->z.locate(xyz_location[2], cell.z, z_p);
+    cell.weights = {(1 - x_p) * (1 - y_p) * (1 - z_p), // 000
+                    x_p * (1 - y_p) * (1 - z_p),       // 100
+                    (1 - x_p) * y_p * (1 - z_p),       // 010
+                    (1 - x_p) * (1 - y_p) * z_p,       // 001
+                    x_p * (1 - y_p) * z_p,             // 101
+                    (1 - x_p) * y_p * z_p,             // 011
+                    x_p * y_p * (1 - z_p),             // 110
+                    x_p * y_p * z_p};                  // 111
+    return cell;
+  }
+  /**
+   * Interpolates a volume on the grid of the interpolation.
+   * @param cell stencil of the location returned by locate
+   * @param volume volume[x][y][z] at the grid points
+   * @return interpolated value
+   */
+  static double interpolate(const stencil &cell,
+                            const tensors::tensor_3d &volume) {
+    const auto &w = cell.weights;
+    const auto &plane = volume[cell.x];
+    const auto &next_plane = volume[cell.x + 1];
+    return plane[cell.y][cell.z] * w[0] + next_plane[cell.y][cell.z] * w[1] +
+           plane[cell.y + 1][cell.z] * w[2] + plane[cell.y][cell.z + 1] * w[3] +
+           next_plane[cell.y][cell.z + 1] * w[4] +
+           plane[cell.y + 1][cell.z + 1] * w[5] +
+           next_plane[cell.y + 1][cell.z] * w[6] +
+           next_plane[cell.y + 1][cell.z + 1] * w[7];
+  }
 
 private:
-  double x_min;
-  double y_min;
-  double z_min;
-  double x_step_size;
-  double y_step_size;
-  double z_step_size;
+  struct axis_lookups {
+    grids::axis_lookup x;
+    grids::axis_lookup y;
+    grids::axis_lookup z;
+  };
+
+  // immutable, so they are shared by the interpolations on the same grid
+  std::shared_ptr<const axis_lookups> axes;
   // values[x][y][z] at the grid points
   const tensors::tensor_3d &values;
 };
@@ -1,5 +1,7 @@
 // Author: Stefan Lepperdinger
 #include "grids.h"
+#include <cmath>
+#include <stdexcept>
 
 namespace grids {
 bool cartesian_grid_3d::is_within_grid(
@@ -18,4 +20,53 @@ bool cartesian_grid_3d::is_within_grid(
   bool within_grid = within_x && within_y && within_z;
   return within_grid;
 }
-} // namespace grids
\ No newline at end of file
+
+axis_lookup::axis_lookup(const std::vector<double> &points)
+    : points(points) {
+  if (points.size() < 2 ||
+      !std::is_sorted(points.cbegin(), points.cend(), std::less_equal<>())) {
+    throw std::invalid_argument(
+        "axis_lookup: the grid points have to be strictly ascending");
+  }
+  first_point = points.front();
+  last_cell = points.size() - 2;
+  double mean_width =
+      (points.back() - points.front()) / static_cast<double>(last_cell + 1);
+  double minimum_width = mean_width;
+  bool uniform = true;
+  for (size_t i{}; i != last_cell + 1; ++i) {
+    double width = points[i + 1] - points[i];
+    inverse_cell_widths.push_back(1. / width);
+    minimum_width = std::min(minimum_width, width);
+    // the grids of the input files are stored in single precision, so
+    // uniform axes deviate slightly from the exact uniform points
+    double uniform_point = first_point + static_cast<double>(i) * mean_width;
+    uniform =
+        uniform && std::abs(points[i] - uniform_point) <= 1e-4 * mean_width;
+  }
+  if (uniform) {
+    inverse_bin_width = 1. / mean_width;
+    last_bin = last_cell;
+    return;
+  }
+
+  // limits the memory of strongly stretched axes, whose lookups then might
+  // have to skip a few cells
+  double maximum_number_of_bins = 1 << 22;
+  double bin_width = std::max(minimum_width, (points.back() - points.front()) /
+                                                 maximum_number_of_bins);
+  inverse_bin_width = 1. / bin_width;
+  auto number_of_bins = static_cast<size_t>(
+      std::ceil((points.back() - points.front()) * inverse_bin_width));
+  last_bin = number_of_bins - 1;
+  size_t cell{};
+  for (size_t bin{}; bin != number_of_bins; ++bin) {
+    double bin_begin = first_point + static_cast<double>(bin) * bin_width;
+    while (cell != last_cell && bin_begin >= points[cell + 1]) {
+      ++cell;
+    }
+    cell_of_bin.push_back(cell);
+  }
+}
+
+} // namespace grids
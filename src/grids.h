@@ -2,9 +2,12 @@
 #ifndef GAMMA_SKY_SRC_GRIDS_H
 #define GAMMA_SKY_SRC_GRIDS_H
 
+#include <algorithm>
 #include <array>
 #include <vector>
 
+using std::size_t;
+
 namespace grids {
 
 struct cartesian_grid_3d {
@@ -20,6 +23,73 @@ struct cartesian_grid_3d {
   [[nodiscard]] bool is_within_grid(const std::array<double, 3> &point) const;
 };
 
+/**
+ * Constant time lookup of the cell [points[i], points[i + 1]] that contains a
+ * coordinate on an axis with ascending, possibly non-uniformly spaced grid
+ * points.
+ *
+ * Non-uniform axes are covered by a table of uniform bins that aren't wider
+ * than the smallest cell. The table stores the cell at the beginning of every
+ * bin, so the cell of a coordinate is at most one cell after it.
+ */
+class axis_lookup {
+public:
+  /**
+   * @param points ascending grid points (at least 2)
+   */
+  explicit axis_lookup(const std::vector<double> &points);
+
+  /**
+   * @param coordinate location on the axis. Locations outside of the axis are
+   *                   clamped to the first or last cell.
+   * @param cell index i of the cell [points[i], points[i + 1]]
+   * @param fraction position within the cell in [0, 1]
+   */
+  void locate(double coordinate, size_t &cell, double &fraction) const {
+    double bin_position = (coordinate - first_point) * inverse_bin_width;
+    size_t bin = bin_position > 0.
+                     ? std::min(static_cast<size_t>(bin_position), last_bin)
+                     : 0;
+    if (cell_of_bin.empty()) {
+      // uniform axis: the bins are the cells
+      cell = bin;
+      fraction = bin_position - static_cast<double>(bin);
+    } else {
+      cell = cell_of_bin[bin];
+      while (cell != last_cell && coordinate >= points[cell + 1]) {
+        ++cell;
+      }
+      fraction = (coordinate - points[cell]) * inverse_cell_widths[cell];
+    }
+    fraction = std::clamp(fraction, 0., 1.);
+  }
+
+  /**
+   * @return derivative of the fraction returned by locate with respect to
+   *         the coordinate within the cell
+   */
+  [[nodiscard]] double get_inverse_cell_width(size_t cell) const {
+    return cell_of_bin.empty() ? inverse_bin_width : inverse_cell_widths[cell];
+  }
+
+  /**
+   * @return true if the points are uniformly spaced
+   */
+  [[nodiscard]] bool is_uniform() const { return cell_of_bin.empty(); }
+
+private:
+  std::vector<double> points;
+  double first_point;
+  double inverse_bin_width;
+  size_t last_bin;
+  size_t last_cell;
+  // cell_of_bin[bin] = cell that contains the beginning of the bin (empty for
+  // uniform axes)
+  std::vector<size_t> cell_of_bin;
+  // 1 / (points[i + 1] - points[i])
+  std::vector<double> inverse_cell_widths;
+};
+
 } // namespace grids
 
 #endif // GAMMA_SKY_SRC_GRIDS_H
@@ -1,6 +1,8 @@
 // Author: Stefan Lepperdinger
 #include "mathematics.h"
+#include <algorithm>
 #include <cmath>
+#include <numeric>
 
 namespace mathematics {
 
@@ -24,4 +26,129 @@ double euclidean_norm(const std::vector<double> &vector) {
   return norm;
 }
 
+std::vector<double> log_trapezoid_weights(const std::vector<double> &x,
+                                          double lower_limit,
+                                          double upper_limit) {
+  std::vector<double> weights(x.size());
+  double a = log(lower_limit);
+  double b = log(upper_limit);
+  for (size_t i{}; i + 1 < x.size(); ++i) {
+    double t0 = log(x[i]);
+    double t1 = log(x[i + 1]);
+    double h = t1 - t0;
+    // overlap of [t0, t1] and [a, b]
+    double lower = std::max(t0, a);
+    double upper = std::min(t1, b);
+    if (upper <= lower || h <= 0.) {
+      continue;
+    }
+    weights[i] += (sqr(t1 - lower) - sqr(t1 - upper)) / (2. * h);
+    weights[i + 1] += (sqr(upper - t0) - sqr(lower - t0)) / (2. * h);
+  }
+  return weights;
+}
+
+log_bracket find_log_bracket(const std::vector<double> &x, double value) {
+  auto above = std::lower_bound(x.cbegin(), x.cend(), value);
+  if (above == x.cend()) {
+    return {x.size() - 1, x.size() - 1, 0.};
+  }
+  auto upper = static_cast<size_t>(above - x.cbegin());
+  if (*above == value || upper == 0) {
+    return {upper, upper, 0.};
+  }
+  size_t lower = upper - 1;
+  double weight =
+      (log(value) - log(x[lower])) / (log(x[upper]) - log(x[lower]));
+  return {lower, upper, weight};
+}
+
+double log_log_interpolate(double lower_value, double upper_value,
+                           double weight) {
+  if (weight == 0.) {
+    return lower_value;
+  }
+  if (lower_value > 0. && upper_value > 0.) {
+    return exp((1. - weight) * log(lower_value) + weight * log(upper_value));
+  }
+  return (1. - weight) * lower_value + weight * upper_value;
+}
+
+symmetric_eigensystem
+diagonalize_symmetric_matrix(std::vector<std::vector<double>> matrix) {
+  size_t n = matrix.size();
+  std::vector<std::vector<double>> eigenvectors(n, std::vector<double>(n));
+  for (size_t i{}; i != n; ++i) {
+    eigenvectors[i][i] = 1.;
+  }
+
+  auto off_diagonal_norm = [&]() {
+    double norm{};
+    for (size_t i{}; i != n; ++i) {
+      for (size_t j{}; j != n; ++j) {
+        norm += i == j ? 0. : sqr(matrix[i][j]);
+      }
+    }
+    return sqrt(norm);
+  };
+  double diagonal_norm{};
+  for (size_t i{}; i != n; ++i) {
+    diagonal_norm += sqr(matrix[i][i]);
+  }
+  double tolerance = 1e-15 * sqrt(diagonal_norm + sqr(off_diagonal_norm()));
+
+  size_t maximum_number_of_sweeps = 100;
+  for (size_t sweep{}; sweep != maximum_number_of_sweeps; ++sweep) {
+    if (off_diagonal_norm() <= tolerance) {
+      break;
+    }
+    for (size_t p{}; p + 1 < n; ++p) {
+      for (size_t q = p + 1; q != n; ++q) {
+        if (matrix[p][q] == 0.) {
+          continue;
+        }
+        // rotation angle that annihilates matrix[p][q]
+        double theta = (matrix[q][q] - matrix[p][p]) / (2. * matrix[p][q]);
+        double t = (theta >= 0. ? 1. : -1.) /
+                   (std::abs(theta) + sqrt(sqr(theta) + 1.));
+        double c = 1. / sqrt(sqr(t) + 1.);
+        double s = t * c;
+        for (size_t k{}; k != n; ++k) {
+          double m_kp = matrix[k][p];
+          double m_kq = matrix[k][q];
+          matrix[k][p] = c * m_kp - s * m_kq;
+          matrix[k][q] = s * m_kp + c * m_kq;
+        }
+        for (size_t k{}; k != n; ++k) {
+          double m_pk = matrix[p][k];
+          double m_qk = matrix[q][k];
+          matrix[p][k] = c * m_pk - s * m_qk;
+          matrix[q][k] = s * m_pk + c * m_qk;
+        }
+        for (size_t k{}; k != n; ++k) {
+          double v_kp = eigenvectors[k][p];
+          double v_kq = eigenvectors[k][q];
+          eigenvectors[k][p] = c * v_kp - s * v_kq;
+          eigenvectors[k][q] = s * v_kp + c * v_kq;
+        }
+      }
+    }
+  }
+
+  // sort by descending eigenvalues
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return matrix[a][a] > matrix[b][b]; });
+  symmetric_eigensystem eigensystem;
+  eigensystem.eigenvectors.assign(n, std::vector<double>(n));
+  for (size_t k{}; k != n; ++k) {
+    eigensystem.eigenvalues.push_back(matrix[order[k]][order[k]]);
+    for (size_t i{}; i != n; ++i) {
+      eigensystem.eigenvectors[i][k] = eigenvectors[i][order[k]];
+    }
+  }
+  return eigensystem;
+}
+
 } // namespace mathematics
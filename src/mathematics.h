@@ -3,8 +3,11 @@
 #define GAMMA_SKY_SRC_MATHEMATICS_H
 
 #include <array>
+#include <cstddef>
 #include <vector>
 
+using std::size_t;
+
 namespace mathematics {
 
 const double half_pi{1.5707963267948966};
@@ -19,6 +22,66 @@ std::array<double, 3> spherical_to_cartesian(double radius, double longitude,
 
 double euclidean_norm(const std::vector<double> &vector);
 
+/**
+ * Computes weights w such that Σ_i w[i] f(x[i]) equals the integral of f over
+ * ln(x) within [lower_limit, upper_limit], where f is linearly interpolated in
+ * ln(x) between the sampling points (trapezoidal rule in log space).
+ * @param x ascending positive sampling points
+ * @param lower_limit lower integration limit within [x.front(), x.back()]
+ * @param upper_limit upper integration limit within [lower_limit, x.back()]
+ * @return weights w[i]
+ */
+std::vector<double> log_trapezoid_weights(const std::vector<double> &x,
+                                          double lower_limit,
+                                          double upper_limit);
+
+/**
+ * Position of a value between two consecutive sampling points in ln(x).
+ */
+struct log_bracket {
+  // indices of the sampling points below and above the value (equal if the
+  // value is a sampling point)
+  size_t lower;
+  size_t upper;
+  // ln(value) = (1 - weight) ln(x[lower]) + weight ln(x[upper])
+  double weight;
+};
+
+/**
+ * @param x ascending positive sampling points
+ * @param value value within [x.front(), x.back()]
+ * @return bracket of the value
+ */
+log_bracket find_log_bracket(const std::vector<double> &x, double value);
+
+/**
+ * Interpolates linearly in log-log space, i.e.,
+ * lower_value^(1 - weight) upper_value^weight, or linearly in the logarithm
+ * of the sampling points if one of the values isn't positive.
+ * @param weight weight of a log_bracket
+ */
+double log_log_interpolate(double lower_value, double upper_value,
+                           double weight);
+
+/**
+ * Eigenvalues and eigenvectors of a real symmetric matrix.
+ */
+struct symmetric_eigensystem {
+  // eigenvalues in descending order
+  std::vector<double> eigenvalues;
+  // eigenvectors[i][k] is the i-th component of the k-th eigenvector
+  std::vector<std::vector<double>> eigenvectors;
+};
+
+/**
+ * Diagonalizes a real symmetric matrix via cyclic Jacobi rotations.
+ * @param matrix symmetric square matrix
+ * @return eigenvalues (descending) and the corresponding orthonormal
+ *         eigenvectors
+ */
+symmetric_eigensystem
+diagonalize_symmetric_matrix(std::vector<std::vector<double>> matrix);
+
 } // namespace mathematics
 
 #endif // GAMMA_SKY_SRC_MATHEMATICS_H
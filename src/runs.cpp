@@ -0,0 +1,184 @@
+// Author: Stefan Lepperdinger
+#include "runs.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace runs {
+
+void check_emissivity_components(const ParameterFile::Parameters &parameters,
+                                 bool is_shard) {
+  const auto &patterns = parameters.emissivity_components;
+  if (patterns.empty()) {
+    return;
+  }
+  std::vector<std::string> names;
+  for (const auto &pattern : patterns) {
+    names.push_back(HDF5File::get_component_name(pattern));
+  }
+  std::sort(names.begin(), names.end());
+  if (std::adjacent_find(names.cbegin(), names.cend()) != names.cend()) {
+    throw std::invalid_argument(
+        "The names of the emissivity components have to be unique. Please "
+        "check the parameter emissivity_components in the parameter file.");
+  }
+  if (!parameters.energy_bands.empty() ||
+      parameters.energy_decomposition_components > 0 ||
+      parameters.progressive_preview || is_shard) {
+    throw std::invalid_argument(
+        "Emissivity components can't be combined with energy bands, the "
+        "energy decomposition, progressive previews or shards. Please check "
+        "the parameter emissivity_components in the parameter file.");
+  }
+}
+
+void check_distance_bins(const ParameterFile::Parameters &parameters,
+                         bool is_shard) {
+  if (parameters.distance_bin_edges.empty()) {
+    return;
+  }
+  if (!parameters.emissivity_components.empty() ||
+      parameters.energy_decomposition_components > 0 ||
+      parameters.progressive_preview || is_shard) {
+    throw std::invalid_argument(
+        "Distance-resolved skies can't be combined with emissivity "
+        "components, the energy decomposition, progressive previews or "
+        "shards. Please check the parameter distance_bins_in_kpc in the "
+        "parameter file.");
+  }
+}
+
+void check_observer_gradient(const ParameterFile::Parameters &parameters,
+                             bool is_shard) {
+  if (!parameters.observer_gradient) {
+    return;
+  }
+  if (!parameters.emissivity_components.empty() ||
+      !parameters.distance_bin_edges.empty() ||
+      parameters.energy_decomposition_components > 0 ||
+      parameters.progressive_preview ||
+      parameters.out_of_core_brick_planes > 0 || is_shard) {
+    throw std::invalid_argument(
+        "Observer gradients can't be combined with emissivity components, "
+        "distance-resolved skies, the energy decomposition, progressive "
+        "previews, out-of-core bricks or shards. Please check the parameter "
+        "observer_gradient in the parameter file.");
+  }
+}
+
+void check_out_of_core_bricks(const ParameterFile::Parameters &parameters) {
+  if (parameters.out_of_core_brick_planes == 0) {
+    return;
+  }
+  if (parameters.out_of_core_brick_planes < 0) {
+    throw std::invalid_argument(
+        "The number of brick planes has to be non-negative. Please check the "
+        "parameter out_of_core_brick_planes in the parameter file.");
+  }
+  if (!parameters.emissivity_components.empty() ||
+      !parameters.distance_bin_edges.empty() ||
+      !parameters.energy_bands.empty() ||
+      parameters.energy_decomposition_components > 0 ||
+      parameters.progressive_preview || parameters.use_projection_operator) {
+    throw std::invalid_argument(
+        "Out-of-core bricks can't be combined with emissivity components, "
+        "distance-resolved skies, energy bands, the energy decomposition, "
+        "progressive previews or the projection operator. Please check the "
+        "parameter out_of_core_brick_planes in the parameter file.");
+  }
+  // the mirror symmetries are detected on whole volumes and the predicted
+  // costs are those of whole lines of sight, not of their parts in a brick
+  if ((!parameters.ray_scheduling.empty() &&
+       parameters.ray_scheduling != "equal_count") ||
+      parameters.symmetry_tolerance >= 0.) {
+    throw std::invalid_argument(
+        "Out-of-core bricks can't be combined with the cost balanced ray "
+        "scheduling or the mirror symmetries. Please set the parameter "
+        "ray_scheduling to 'equal_count' and symmetry_tolerance to a "
+        "negative value in the parameter file.");
+  }
+}
+
+void check_requested_energies(const ParameterFile::Parameters &parameters,
+                              bool is_shard) {
+  if (parameters.requested_energies.empty()) {
+    return;
+  }
+  if (!parameters.compute_energy_skies ||
+      !parameters.emissivity_components.empty() ||
+      !parameters.distance_bin_edges.empty() ||
+      parameters.observer_gradient || is_shard) {
+    throw std::invalid_argument(
+        "Requested energies need the skies of the individual energies and "
+        "can't be combined with emissivity components, distance-resolved "
+        "skies, observer gradients or shards. Please check the parameters "
+        "requested_energies_in_MeV and compute_energy_skies in the parameter "
+        "file.");
+  }
+}
+
+void check_parameters(const ParameterFile::Parameters &parameters,
+                      bool is_shard) {
+  check_emissivity_components(parameters, is_shard);
+  check_distance_bins(parameters, is_shard);
+  check_out_of_core_bricks(parameters);
+  check_observer_gradient(parameters, is_shard);
+  check_requested_energies(parameters, is_shard);
+}
+
+void check_in_memory_outputs(const ParameterFile::Parameters &parameters,
+                             const std::string &app) {
+  if (!parameters.emissivity_components.empty() ||
+      !parameters.distance_bin_edges.empty() ||
+      parameters.observer_gradient || parameters.progressive_preview ||
+      parameters.out_of_core_brick_planes > 0) {
+    throw std::invalid_argument(
+        app + " doesn't support emissivity components, distance-resolved "
+              "skies, observer gradients, progressive previews and "
+              "out-of-core bricks. Please check the parameters "
+              "emissivity_components, distance_bins_in_kpc, "
+              "observer_gradient, progressive_preview and "
+              "out_of_core_brick_planes in the parameter file.");
+  }
+}
+
+bool has_band_skies(const ParameterFile::Parameters &parameters) {
+  const auto &energy_indices = parameters.energy_indices;
+  return !parameters.energy_bands.empty() &&
+         (!energy_indices || energy_indices->front() == 0);
+}
+
+void save_metadata(HDF5File &output_file, const Sky &sky,
+                   const ParameterFile::Parameters &parameters,
+                   const std::vector<double> &energies) {
+  bool is_shard = parameters.pixel_range || parameters.energy_indices;
+  output_file.save_energies(energies);
+  output_file.save_parameters(parameters);
+  if (is_shard) {
+    output_file.save_pixel_range(sky.get_pixel_range());
+  }
+  // the rows of the skies are the bracketing energies of the requested
+  // energies
+  if (is_shard || !sky.get_requested_energies().empty()) {
+    output_file.save_energy_indices(sky.get_energy_indices());
+  }
+  if (!sky.get_requested_energies().empty()) {
+    output_file.save_requested_energies(sky.get_requested_energies());
+  }
+}
+
+void save_error_bounds(HDF5File &output_file,
+                       const ParameterFile::Parameters &parameters,
+                       const std::vector<double> &energy_decomposition_errors,
+                       double skipping_error_bound) {
+  if (!energy_decomposition_errors.empty() &&
+      !output_file.has_dataset("energy decomposition truncation errors")) {
+    output_file.save_energy_decomposition_errors(energy_decomposition_errors);
+  }
+  // the bound of a resumed run is combined with the one of the earlier
+  // sessions
+  if (parameters.skipping_tolerance > 0.) {
+    output_file.save_skipping_error_bound(skipping_error_bound);
+  }
+}
+
+} // namespace runs
@@ -0,0 +1,107 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_RUNS_H
+#define GAMMA_SKY_SRC_RUNS_H
+
+#include "HDF5File.h"
+#include "ParameterFile.h"
+#include "Sky.h"
+#include <string>
+#include <vector>
+
+/**
+ * Validation of the parameters and output metadata shared by the apps that
+ * compute skies (gamma_sky, gamma_sky_server and gamma_sky_snapshots), such
+ * that their output files can't drift apart.
+ */
+namespace runs {
+
+/**
+ * Checks that the emissivity components can be combined with the other
+ * parameters.
+ * @throws std::invalid_argument otherwise
+ */
+void check_emissivity_components(const ParameterFile::Parameters &parameters,
+                                 bool is_shard);
+
+/**
+ * Checks that the distance-resolved skies can be combined with the other
+ * parameters.
+ * @throws std::invalid_argument otherwise
+ */
+void check_distance_bins(const ParameterFile::Parameters &parameters,
+                         bool is_shard);
+
+/**
+ * Checks that the observer gradients can be combined with the other
+ * parameters.
+ * @throws std::invalid_argument otherwise
+ */
+void check_observer_gradient(const ParameterFile::Parameters &parameters,
+                             bool is_shard);
+
+/**
+ * Checks that the out-of-core bricks can be combined with the other
+ * parameters.
+ * @throws std::invalid_argument otherwise
+ */
+void check_out_of_core_bricks(const ParameterFile::Parameters &parameters);
+
+/**
+ * Checks that the requested energies can be combined with the other
+ * parameters.
+ * @throws std::invalid_argument otherwise
+ */
+void check_requested_energies(const ParameterFile::Parameters &parameters,
+                              bool is_shard);
+
+/**
+ * Runs all of the checks above.
+ * @param is_shard true if the run computes only some pixels or energies
+ * @throws std::invalid_argument if the parameters can't be combined
+ */
+void check_parameters(const ParameterFile::Parameters &parameters,
+                      bool is_shard);
+
+/**
+ * Checks that the parameters only select outputs that are computed from the
+ * resident emissivities in a single pass. Emissivity components,
+ * distance-resolved skies, observer gradients, progressive previews and
+ * out-of-core bricks are only supported by gamma_sky.
+ * @param app name of the app for the error message
+ * @throws std::invalid_argument otherwise
+ */
+void check_in_memory_outputs(const ParameterFile::Parameters &parameters,
+                             const std::string &app);
+
+/**
+ * The band skies don't depend on the energy indices of a shard, so they are
+ * only computed by the shards that contain the first energy.
+ * @return true if the run computes the energy band skies
+ */
+bool has_band_skies(const ParameterFile::Parameters &parameters);
+
+/**
+ * Saves the energies, the parameters and the selection of the pixels and
+ * energies (pixel range, energy indices and requested energies) of a run.
+ * @param energies energies of the input file in MeV
+ */
+void save_metadata(HDF5File &output_file, const Sky &sky,
+                   const ParameterFile::Parameters &parameters,
+                   const std::vector<double> &energies);
+
+/**
+ * Saves the energy decomposition truncation errors unless the file already
+ * contains them and the empty space skipping error bound (the larger one of the
+ * saved and the given bound is kept when a run is resumed).
+ * @param energy_decomposition_errors truncation errors of the sky (empty:
+ *                                    no energy decomposition)
+ * @param skipping_error_bound error bound of the sky
+ */
+void save_error_bounds(HDF5File &output_file,
+                       const ParameterFile::Parameters &parameters,
+                       const std::vector<double> &energy_decomposition_errors,
+                       double skipping_error_bound);
+
+} // namespace runs
+
+#endif // GAMMA_SKY_SRC_RUNS_H
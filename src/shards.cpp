@@ -0,0 +1,95 @@
+// Author: Stefan Lepperdinger
+#include "shards.h"
+#include <algorithm>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+
+namespace shards {
+
+std::array<size_t, 2> parse_pixel_range(const std::string &string) {
+  std::regex regex("^([0-9]+):([0-9]+)$");
+  std::smatch match;
+  if (!std::regex_match(string, match, regex)) {
+    throw std::invalid_argument("invalid pixel range '" + string + "'");
+  }
+  std::array<size_t, 2> pixel_range{std::stoul(match[1]),
+                                     std::stoul(match[2])};
+  if (pixel_range[0] >= pixel_range[1]) {
+    throw std::invalid_argument("empty pixel range '" + string + "'");
+  }
+  return pixel_range;
+}
+
+std::vector<size_t> parse_energy_indices(const std::string &string) {
+  std::regex regex("^([0-9]+)(:([0-9]+))?$");
+  std::vector<size_t> energy_indices;
+  std::istringstream stream(string);
+  std::string element;
+  while (std::getline(stream, element, ',')) {
+    std::smatch match;
+    if (!std::regex_match(element, match, regex)) {
+      throw std::invalid_argument("invalid energy indices '" + string + "'");
+    }
+    size_t first = std::stoul(match[1]);
+    size_t last = match[3].matched ? std::stoul(match[3]) : first + 1;
+    for (size_t index = first; index < last; ++index) {
+      energy_indices.push_back(index);
+    }
+  }
+  std::sort(energy_indices.begin(), energy_indices.end());
+  energy_indices.erase(
+      std::unique(energy_indices.begin(), energy_indices.end()),
+      energy_indices.end());
+  if (energy_indices.empty()) {
+    throw std::invalid_argument("no energy indices in '" + string + "'");
+  }
+  return energy_indices;
+}
+
+bool is_partition(const std::vector<shard_specification> &shards,
+                  size_t number_of_energies, size_t number_of_pixels,
+                  std::string &problem) {
+  // pixel ranges per energy
+  std::vector<std::vector<std::array<size_t, 2>>> pixel_ranges(
+      number_of_energies);
+  for (const auto &shard : shards) {
+    if (shard.pixel_range[1] > number_of_pixels) {
+      problem = "pixel range exceeds the number of pixels";
+      return false;
+    }
+    for (auto energy : shard.energy_indices) {
+      if (energy >= number_of_energies) {
+        problem = "energy index exceeds the number of energies";
+        return false;
+      }
+      pixel_ranges[energy].push_back(shard.pixel_range);
+    }
+  }
+  for (size_t energy{}; energy != number_of_energies; ++energy) {
+    auto &ranges = pixel_ranges[energy];
+    std::sort(ranges.begin(), ranges.end());
+    size_t covered_until{};
+    for (const auto &range : ranges) {
+      if (range[0] != covered_until) {
+        std::ostringstream message;
+        message << (range[0] < covered_until ? "overlap" : "gap")
+                << " at energy index " << energy << ", pixel "
+                << std::min(range[0], covered_until);
+        problem = message.str();
+        return false;
+      }
+      covered_until = range[1];
+    }
+    if (covered_until != number_of_pixels) {
+      std::ostringstream message;
+      message << "gap at energy index " << energy << ", pixel "
+              << covered_until;
+      problem = message.str();
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace shards
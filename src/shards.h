@@ -0,0 +1,51 @@
+// Author: Stefan Lepperdinger
+#ifndef GAMMA_SKY_SRC_SHARDS_H
+#define GAMMA_SKY_SRC_SHARDS_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+using std::size_t;
+
+namespace shards {
+
+/**
+ * Part of the (energy, HEALPix pixel) sky computed by a single gamma_sky
+ * process.
+ */
+struct shard_specification {
+  // HEALPix pixels within [pixel_range[0], pixel_range[1])
+  std::array<size_t, 2> pixel_range;
+  // indices of the energies, ascending
+  std::vector<size_t> energy_indices;
+};
+
+/**
+ * @param string pixel range "first:last", where last is exclusive
+ * @return {first, last}
+ * @throws std::invalid_argument if the string is malformed
+ */
+std::array<size_t, 2> parse_pixel_range(const std::string &string);
+
+/**
+ * @param string comma separated energy indices and index ranges, e.g.,
+ *               "0,3,5:9" (the end of a range is exclusive)
+ * @return ascending unique energy indices
+ * @throws std::invalid_argument if the string is malformed
+ */
+std::vector<size_t> parse_energy_indices(const std::string &string);
+
+/**
+ * Checks whether the shards cover every (energy, pixel) combination exactly
+ * once.
+ * @param problem description of the first detected gap or overlap
+ * @return true if the shards form a partition
+ */
+bool is_partition(const std::vector<shard_specification> &shards,
+                  size_t number_of_energies, size_t number_of_pixels,
+                  std::string &problem);
+
+} // namespace shards
+
+#endif // GAMMA_SKY_SRC_SHARDS_H
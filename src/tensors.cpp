@@ -1,5 +1,6 @@
 // Author: Stefan Lepperdinger
 #include "tensors.h"
+#include <tbb/parallel_for.h>
 
 namespace tensors {
 
@@ -27,4 +28,27 @@ tensor_4d make_4d_tensor(std::array<size_t, 4> dimensions,
   return dimension_0;
 }
 
+tensor_3d linear_combination(const tensor_4d &tensors,
+                             const std::vector<double> &weights) {
+  size_t x_dimension = tensors.front().size();
+  size_t y_dimension = tensors.front().front().size();
+  size_t z_dimension = tensors.front().front().front().size();
+  auto combination = make_3d_tensor({x_dimension, y_dimension, z_dimension});
+  tbb::parallel_for(size_t{}, x_dimension, [&](size_t x) {
+    for (size_t i{}; i != tensors.size(); ++i) {
+      double weight = weights[i];
+      if (weight == 0.) {
+        continue;
+      }
+      const auto &plane = tensors[i][x];
+      for (size_t y{}; y != y_dimension; ++y) {
+        for (size_t z{}; z != z_dimension; ++z) {
+          combination[x][y][z] += weight * plane[y][z];
+        }
+      }
+    }
+  });
+  return combination;
+}
+
 } // namespace tensors
\ No newline at end of file
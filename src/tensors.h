@@ -23,6 +23,14 @@ tensor_3d make_3d_tensor(std::array<size_t, 3> dimensions,
 tensor_4d make_4d_tensor(std::array<size_t, 4> dimensions,
                          double initialization_value = 0.);
 
+/**
+ * @param tensors tensors[i][x][y][z] with equal dimensions
+ * @param weights weights[i]
+ * @return Σ_i weights[i] tensors[i]
+ */
+tensor_3d linear_combination(const tensor_4d &tensors,
+                             const std::vector<double> &weights);
+
 } // namespace tensors
 
 #endif // GAMMA_SKY_SRC_TENSORS_H
\ No newline at end of file
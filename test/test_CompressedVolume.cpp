@@ -0,0 +1,186 @@
+// Author: Stefan Lepperdinger
+#include "CompressedVolume.h"
+#include "LineOfSightIntegral.h"
+#include "grids.h"
+#include "mathematics.h"
+#include "tensors.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace CompressedVolume_test {
+
+using encoding = CompressedVolume::encoding;
+
+/**
+ * @return emissivity-like values, which decrease by 12 orders of magnitude
+ *         and contain a zero and a negative value
+ */
+tensors::tensor_3d create_values() {
+  auto values = tensors::make_3d_tensor({10, 9, 8});
+  for (size_t x{}; x != 10; ++x) {
+    for (size_t y{}; y != 9; ++y) {
+      for (size_t z{}; z != 8; ++z) {
+        double exponent = -0.04 * static_cast<double>(x * 72 + y * 8 + z);
+        values[x][y][z] = 3e-26 * std::exp(exponent) *
+                          (1. + 0.3 * std::sin(static_cast<double>(x + z)));
+      }
+    }
+  }
+  values[4][4][4] = 0.;
+  values[5][5][5] *= -1.;
+  return values;
+}
+
+/**
+ * @return largest error of a decoded value relative to the original value
+ *         (or to the maximum for fp16 values below the normal range)
+ */
+double bound(encoding value_encoding, double value, double maximum,
+             double log_range) {
+  double magnitude = std::abs(value);
+  switch (value_encoding) {
+  case encoding::fp16:
+    return std::max(std::ldexp(magnitude, -11), std::ldexp(maximum, -25));
+  case encoding::bfloat16:
+    return std::ldexp(magnitude, -8);
+  default:
+    return std::expm1(0.5 * log_range / 32766.) * magnitude;
+  }
+}
+
+TEST(CompressedVolume, parse_encoding) {
+  EXPECT_EQ(CompressedVolume::parse_encoding("fp16"), encoding::fp16);
+  EXPECT_EQ(CompressedVolume::parse_encoding("bfloat16"), encoding::bfloat16);
+  EXPECT_EQ(CompressedVolume::parse_encoding("log16"), encoding::log16);
+  EXPECT_THROW(CompressedVolume::parse_encoding("fp8"), std::invalid_argument);
+}
+
+TEST(CompressedVolume, round_trip) {
+  auto values = create_values();
+  double maximum{};
+  double minimum = INFINITY;
+  for (const auto &plane : values) {
+    for (const auto &row : plane) {
+      for (double value : row) {
+        maximum = std::max(maximum, std::abs(value));
+        if (value != 0.) {
+          minimum = std::min(minimum, std::abs(value));
+        }
+      }
+    }
+  }
+  double log_range = std::log(maximum / minimum);
+  for (auto value_encoding :
+       {encoding::fp16, encoding::bfloat16, encoding::log16}) {
+    CompressedVolume volume(values, value_encoding);
+    double maximum_error{};
+    for (size_t x{}; x != 10; ++x) {
+      for (size_t y{}; y != 9; ++y) {
+        for (size_t z{}; z != 8; ++z) {
+          double value = values[x][y][z];
+          double error = std::abs(volume(x, y, z) - value);
+          // slack for the single precision intermediate
+          ASSERT_LE(error,
+                    1.001 * bound(value_encoding, value, maximum, log_range))
+              << "encoding " << static_cast<int>(value_encoding) << " at "
+              << x << ' ' << y << ' ' << z;
+          maximum_error = std::max(maximum_error, error / maximum);
+        }
+      }
+    }
+    EXPECT_NEAR(volume.get_maximum_relative_error(), maximum_error,
+                1e-3 * maximum_error);
+    EXPECT_EQ(volume(4, 4, 4), 0.);
+    EXPECT_LT(volume(5, 5, 5), 0.);
+  }
+}
+
+TEST(CompressedVolume, line_of_sight_integral) {
+  grids::cartesian_grid_3d grid;
+  for (size_t i{}; i != 41; ++i) {
+    grid.x_centers.push_back(-10. + 0.5 * static_cast<double>(i));
+  }
+  grid.y_centers = grid.x_centers;
+  grid.z_centers = {-2., -1., 0., 1., 2.};
+  auto values = tensors::make_3d_tensor({41, 41, 5});
+  for (size_t x{}; x != 41; ++x) {
+    for (size_t y{}; y != 41; ++y) {
+      for (size_t z{}; z != 5; ++z) {
+        double radius = std::hypot(grid.x_centers[x], grid.y_centers[y]);
+        values[x][y][z] = 1e-26 * std::exp(-radius / 3. -
+                                           std::abs(grid.z_centers[z]));
+      }
+    }
+  }
+  LineOfSightIntegral integral(0.01, grid, values);
+  for (auto value_encoding :
+       {encoding::fp16, encoding::bfloat16, encoding::log16}) {
+    CompressedVolume volume(values, value_encoding);
+    // the values are positive, so the relative error of an integral is
+    // bounded by the largest relative error of a value
+    double relative_bound =
+        value_encoding == encoding::fp16
+            ? std::ldexp(1., -11)
+            : (value_encoding == encoding::bfloat16 ? std::ldexp(1., -8)
+                                                    : 1e-3);
+    for (double longitude : {0., 0.7, 2., 4.}) {
+      for (double latitude : {0., 0.1, -0.3}) {
+        auto direction =
+            mathematics::spherical_to_cartesian(1., longitude, latitude);
+        double expected = integral(direction);
+        EXPECT_NEAR(integral(direction, volume), expected,
+                    1.001 * relative_bound * expected);
+      }
+    }
+  }
+}
+
+TEST(CompressedVolume, reads_only_codes) {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = {-2., -1., 0., 1., 2.};
+  grid.y_centers = grid.x_centers;
+  grid.z_centers = {-1., 0., 1.};
+  auto values = tensors::make_3d_tensor({5, 5, 3});
+  for (size_t x{}; x != 5; ++x) {
+    for (size_t y{}; y != 5; ++y) {
+      for (size_t z{}; z != 3; ++z) {
+        values[x][y][z] = 1. + static_cast<double>(x + 2 * y + 3 * z);
+      }
+    }
+  }
+  std::array<double, 3> direction{0.6, 0.48, 0.64};
+  for (auto value_encoding :
+       {encoding::fp16, encoding::bfloat16, encoding::log16}) {
+    auto copy = values;
+    CompressedVolume volume(copy, value_encoding);
+    LineOfSightIntegral integral(0.01, grid);
+    double expected = integral(direction, volume);
+    // 2 bytes per value, the double precision volume can be freed
+    size_t table_bytes =
+        value_encoding == encoding::log16 ? 32768 * sizeof(float) : 0;
+    EXPECT_EQ(volume.get_number_of_bytes(), 5 * 5 * 3 * 2 + table_bytes);
+    tensors::tensor_3d().swap(copy);
+    EXPECT_EQ(integral(direction, volume), expected);
+    // the decoded corners are interpolated like the decoded values
+    auto cell = TrilinearInterpolation(grid, values).locate({0.3, -0.7, 0.2});
+    double interpolated{};
+    std::array<std::array<size_t, 3>, 8> corners{{{0, 0, 0},
+                                                  {1, 0, 0},
+                                                  {0, 1, 0},
+                                                  {0, 0, 1},
+                                                  {1, 0, 1},
+                                                  {0, 1, 1},
+                                                  {1, 1, 0},
+                                                  {1, 1, 1}}};
+    for (size_t corner{}; corner != 8; ++corner) {
+      const auto &offset = corners[corner];
+      interpolated +=
+          cell.weights[corner] *
+          volume(cell.x + offset[0], cell.y + offset[1], cell.z + offset[2]);
+    }
+    EXPECT_NEAR(volume.interpolate(cell), interpolated, 1e-12 * interpolated);
+  }
+}
+
+} // namespace CompressedVolume_test
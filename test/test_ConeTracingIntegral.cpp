@@ -0,0 +1,107 @@
+// Author: Stefan Lepperdinger
+#include "ConeTracingIntegral.h"
+#include "EmissivityPyramid.h"
+#include "LineOfSightIntegral.h"
+#include "PixelDirections.h"
+#include "grids.h"
+#include "tensors.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace test_ConeTracingIntegral {
+
+std::vector<double> create_1d_grid(const std::array<double, 2> &interval,
+                                   unsigned int number_of_points) {
+  std::vector<double> grid;
+  grid.reserve(number_of_points);
+  double step_size = (interval[1] - interval[0]) / (number_of_points - 1);
+  for (unsigned int i{0}; i != number_of_points; ++i) {
+    grid.push_back(interval[0] + i * step_size);
+  }
+  return grid;
+}
+
+grids::cartesian_grid_3d create_grid() {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = create_1d_grid({-8., 8.}, 64);
+  grid.y_centers = create_1d_grid({-6., 6.}, 48);
+  grid.z_centers = create_1d_grid({-2., 2.}, 16);
+  return grid;
+}
+
+tensors::tensor_3d create_grid_values(const grids::cartesian_grid_3d &grid) {
+  auto values = tensors::make_3d_tensor(
+      {grid.x_centers.size(), grid.y_centers.size(), grid.z_centers.size()});
+  for (size_t x{}; x != grid.x_centers.size(); ++x) {
+    for (size_t y{}; y != grid.y_centers.size(); ++y) {
+      for (size_t z{}; z != grid.z_centers.size(); ++z) {
+        values[x][y][z] = 1e-21 * (2. + sin(grid.x_centers[x]) *
+                                            cos(grid.y_centers[y]) *
+                                            exp(-grid.z_centers[z]));
+      }
+    }
+  }
+  return values;
+}
+
+double mean(const tensors::tensor_3d &values) {
+  double sum{};
+  size_t count{};
+  for (const auto &plane : values) {
+    for (const auto &row : plane) {
+      for (double value : row) {
+        sum += value;
+        ++count;
+      }
+    }
+  }
+  return sum / static_cast<double>(count);
+}
+
+TEST(EmissivityPyramid, levels) {
+  auto grid = create_grid();
+  auto values = create_grid_values(grid);
+  EmissivityPyramid pyramid(grid, values);
+  // 64 x 48 x 16 -> 32 x 24 x 8 -> 16 x 12 x 4 -> 8 x 6 x 2 -> 4 x 3 x 2
+  // -> 2 x 3 x 2
+  ASSERT_EQ(pyramid.get_number_of_levels(), 6);
+  EXPECT_EQ(pyramid.get_values(3).size(), 8);
+  EXPECT_EQ(pyramid.get_values(3)[0].size(), 6);
+  EXPECT_EQ(pyramid.get_values(3)[0][0].size(), 2);
+  EXPECT_EQ(pyramid.get_grid(3).z_centers.size(), 2);
+  for (size_t level{1}; level != pyramid.get_number_of_levels(); ++level) {
+    EXPECT_GT(pyramid.get_cell_size(level), pyramid.get_cell_size(level - 1));
+  }
+  // the pairs of the first 3 levels are complete, so the mean is preserved
+  EXPECT_NEAR(mean(pyramid.get_values(3)), mean(values), 1e-12 * mean(values));
+}
+
+TEST(ConeTracingIntegral, narrow_cones_match_line_of_sight_integral) {
+  double radial_step_size = 0.01;
+  auto grid = create_grid();
+  auto values = create_grid_values(grid);
+  LineOfSightIntegral line_of_sight_integral(radial_step_size, grid, values);
+  ConeTracingIntegral cone_integral(radial_step_size, 1e-6, grid, values);
+  for (const auto &coordinates : tensors::tensor_2d{
+           {0., 0.}, {1.3, 0.2}, {3.1, -0.4}, {4.4, 1.1}}) {
+    auto direction =
+        PixelDirections::make_direction(coordinates[0], coordinates[1]);
+    double expected = line_of_sight_integral(direction);
+    EXPECT_NEAR(cone_integral(direction), expected, 1e-9 * expected);
+  }
+}
+
+TEST(ConeTracingIntegral, wide_cones) {
+  double radial_step_size = 0.01;
+  auto grid = create_grid();
+  auto values = create_grid_values(grid);
+  LineOfSightIntegral line_of_sight_integral(radial_step_size, grid, values);
+  // HEALPix order 3
+  ConeTracingIntegral cone_integral(radial_step_size, 0.128, grid, values);
+  auto direction = PixelDirections::make_direction(0.3, 0.1);
+  double expected = line_of_sight_integral(direction);
+  // the smooth values average out little, but the far samples are coarse
+  EXPECT_NEAR(cone_integral(direction), expected, 0.05 * expected);
+}
+
+} // namespace test_ConeTracingIntegral
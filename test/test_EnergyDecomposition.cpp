@@ -0,0 +1,80 @@
+// Author: Stefan Lepperdinger
+#include "EnergyDecomposition.h"
+#include "tensors.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace test_EnergyDecomposition {
+
+/**
+ * Volumes that are linear combinations of two spatial profiles with energy
+ * dependent coefficients spanning several orders of magnitude.
+ */
+tensors::tensor_4d create_rank_2_volumes(size_t number_of_energies) {
+  auto volumes = tensors::make_4d_tensor({number_of_energies, 6, 5, 4});
+  for (size_t energy{}; energy != number_of_energies; ++energy) {
+    double a = pow(10., -static_cast<double>(energy));
+    double b = 0.3 * pow(10., -1.5 * static_cast<double>(energy));
+    for (size_t x{}; x != 6; ++x) {
+      for (size_t y{}; y != 5; ++y) {
+        for (size_t z{}; z != 4; ++z) {
+          double profile_1 = exp(-0.3 * static_cast<double>(x + y + z));
+          double profile_2 = 1. + sin(static_cast<double>(x * y + z));
+          volumes[energy][x][y][z] = a * profile_1 + b * profile_2;
+        }
+      }
+    }
+  }
+  return volumes;
+}
+
+TEST(test_EnergyDecomposition, exact_for_sufficient_rank) {
+  auto volumes = create_rank_2_volumes(7);
+  EnergyDecomposition decomposition(volumes, 2);
+  ASSERT_EQ(decomposition.get_basis_volumes().size(), 2);
+
+  // use the sum over z as a linear "sky" with one pixel per (x, y)
+  auto project = [](const tensors::tensor_3d &volume) {
+    tensors::tensor_1d sky;
+    for (const auto &plane : volume) {
+      for (const auto &row : plane) {
+        double sum{};
+        for (double value : row) {
+          sum += value;
+        }
+        sky.push_back(sum);
+      }
+    }
+    return sky;
+  };
+  tensors::tensor_2d basis_skies;
+  for (const auto &basis_volume : decomposition.get_basis_volumes()) {
+    basis_skies.push_back(project(basis_volume));
+  }
+  auto skies = decomposition.reconstruct_skies(basis_skies);
+
+  ASSERT_EQ(skies.size(), volumes.size());
+  for (size_t energy{}; energy != volumes.size(); ++energy) {
+    auto expected = project(volumes[energy]);
+    for (size_t pixel{}; pixel != expected.size(); ++pixel) {
+      EXPECT_NEAR(skies[energy][pixel], expected[pixel],
+                  1e-8 * std::abs(expected[pixel]));
+    }
+    EXPECT_NEAR(decomposition.get_truncation_errors()[energy], 0., 1e-6);
+  }
+}
+
+TEST(test_EnergyDecomposition, truncation_error) {
+  auto volumes = create_rank_2_volumes(7);
+  EnergyDecomposition decomposition(volumes, 1);
+  const auto &errors = decomposition.get_truncation_errors();
+  double maximum_error{};
+  for (double error : errors) {
+    EXPECT_GE(error, 0.);
+    EXPECT_LE(error, 1.);
+    maximum_error = std::max(maximum_error, error);
+  }
+  EXPECT_GT(maximum_error, 1e-3);
+}
+
+} // namespace test_EnergyDecomposition
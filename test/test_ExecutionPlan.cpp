@@ -0,0 +1,140 @@
+// Author: Stefan Lepperdinger
+#include "ExecutionPlan.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace test_ExecutionPlan {
+
+// 100 x 100 x 20 grid (about 1.6 MB per volume), 10 energies, HEALPix order 6
+ExecutionPlan::Problem problem{{100, 100, 20}, 10, 10, 0, 49152};
+
+TEST(ExecutionPlan, unlimited_memory) {
+  ParameterFile::Parameters parameters{};
+  ExecutionPlan plan(problem, parameters);
+  EXPECT_EQ(plan.get_number_of_resident_energies(), 10);
+  EXPECT_TRUE(plan.stores_pixel_directions());
+  EXPECT_TRUE(plan.streams_skies());
+  EXPECT_FALSE(plan.loads_all_energies());
+}
+
+TEST(ExecutionPlan, limited_memory) {
+  double volume = ExecutionPlan::estimate_volume_memory({100, 100, 20});
+  double directions = ExecutionPlan::estimate_pixel_directions_memory(49152);
+  ParameterFile::Parameters parameters{};
+  parameters.max_memory =
+      ExecutionPlan::base_memory + 5.5 * volume + directions;
+  ExecutionPlan plan(problem, parameters);
+  EXPECT_TRUE(plan.stores_pixel_directions());
+  EXPECT_GE(plan.get_number_of_resident_energies(), 4);
+  EXPECT_LT(plan.get_number_of_resident_energies(), 10);
+  EXPECT_LE(plan.get_estimated_memory(), parameters.max_memory);
+
+  // without the memory for the pixel directions (but with the representatives
+  // of mirrored pixels)
+  parameters.max_memory = ExecutionPlan::base_memory + 2.4 * volume;
+  ExecutionPlan small_plan(problem, parameters);
+  EXPECT_FALSE(small_plan.stores_pixel_directions());
+  EXPECT_EQ(small_plan.get_number_of_resident_energies(), 1);
+
+  parameters.max_memory = ExecutionPlan::base_memory + 0.5 * volume;
+  EXPECT_THROW(ExecutionPlan(problem, parameters), std::invalid_argument);
+}
+
+TEST(ExecutionPlan, progressive_preview) {
+  double volume = ExecutionPlan::estimate_volume_memory({100, 100, 20});
+  ParameterFile::Parameters parameters{};
+  parameters.progressive_preview = true;
+  parameters.max_memory = ExecutionPlan::base_memory + 100. * volume;
+  ExecutionPlan plan(problem, parameters);
+  EXPECT_FALSE(plan.streams_skies());
+  EXPECT_EQ(plan.get_number_of_resident_energies(), 10);
+
+  // the previews are dropped instead of refusing the run
+  parameters.max_memory = ExecutionPlan::base_memory + 3. * volume;
+  ExecutionPlan streamed_plan(problem, parameters);
+  EXPECT_TRUE(streamed_plan.streams_skies());
+
+  // the NUMA replicas of all volumes are kept for all levels
+  parameters.max_memory = 0.;
+  auto replicated_problem = problem;
+  replicated_problem.number_of_volume_replicas = 2;
+  ExecutionPlan replicated_plan(replicated_problem, parameters);
+  EXPECT_FALSE(replicated_plan.streams_skies());
+  EXPECT_NEAR(replicated_plan.get_estimated_memory() -
+                  ExecutionPlan(problem, parameters).get_estimated_memory(),
+              2. * 10. * volume, 1.);
+}
+
+TEST(ExecutionPlan, out_of_core_bricks) {
+  double volume = ExecutionPlan::estimate_volume_memory({100, 100, 20});
+  ParameterFile::Parameters parameters{};
+  parameters.max_memory = ExecutionPlan::base_memory + 2. * volume;
+  EXPECT_THROW(ExecutionPlan(problem, parameters), std::invalid_argument);
+
+  // two bricks of 4 cells along z fit where a single volume doesn't
+  parameters.out_of_core_brick_planes = 4;
+  ExecutionPlan plan(problem, parameters);
+  EXPECT_TRUE(plan.integrates_bricks());
+  EXPECT_EQ(plan.get_number_of_resident_energies(), 0);
+  EXPECT_LE(plan.get_estimated_memory(), parameters.max_memory);
+}
+
+TEST(ExecutionPlan, energy_decomposition) {
+  double volume = ExecutionPlan::estimate_volume_memory({100, 100, 20});
+  ParameterFile::Parameters parameters{};
+  parameters.energy_decomposition_components = 2;
+  parameters.max_memory = ExecutionPlan::base_memory + 100. * volume;
+  ExecutionPlan plan(problem, parameters);
+  EXPECT_TRUE(plan.loads_all_energies());
+  EXPECT_EQ(plan.get_number_of_resident_energies(), 10);
+
+  parameters.max_memory = ExecutionPlan::base_memory + 5. * volume;
+  EXPECT_THROW(ExecutionPlan(problem, parameters), std::invalid_argument);
+}
+
+TEST(ExecutionPlan, compressed_volumes) {
+  double volume = ExecutionPlan::estimate_volume_memory({100, 100, 20});
+  double compressed_volume =
+      ExecutionPlan::estimate_compressed_volume_memory({100, 100, 20});
+  ParameterFile::Parameters parameters{};
+  parameters.max_memory = ExecutionPlan::base_memory + 3.5 * volume;
+  ExecutionPlan plan(problem, parameters);
+  EXPECT_FALSE(plan.keeps_compressed_volumes());
+
+  // the compressed volumes replace the resident double precision volumes
+  parameters.volume_compression = "fp16";
+  ExecutionPlan compressed_plan(problem, parameters);
+  EXPECT_TRUE(compressed_plan.keeps_compressed_volumes());
+  EXPECT_GT(compressed_plan.get_number_of_resident_energies(),
+            plan.get_number_of_resident_energies());
+  EXPECT_LE(compressed_plan.get_estimated_memory(), parameters.max_memory);
+
+  // the progressive previews keep all volumes compressed as well
+  parameters.progressive_preview = true;
+  parameters.max_memory = 0.;
+  EXPECT_TRUE(ExecutionPlan(problem, parameters).keeps_compressed_volumes());
+  parameters.progressive_preview = false;
+
+  // the compressed volumes are shared by the NUMA nodes
+  auto replicated_problem = problem;
+  replicated_problem.number_of_volume_replicas = 2;
+  ExecutionPlan replicated_plan(replicated_problem, parameters);
+  EXPECT_TRUE(replicated_plan.keeps_compressed_volumes());
+  EXPECT_DOUBLE_EQ(replicated_plan.get_estimated_memory(),
+                   ExecutionPlan(problem, parameters).get_estimated_memory());
+
+  // the energy bands need the double precision volumes, next to which a
+  // single compressed copy is integrated
+  auto band_problem = replicated_problem;
+  band_problem.number_of_band_skies = 2;
+  ExecutionPlan band_plan(band_problem, parameters);
+  EXPECT_FALSE(band_plan.keeps_compressed_volumes());
+  parameters.volume_compression = "none";
+  band_problem.number_of_volume_replicas = 0;
+  ExecutionPlan uncompressed_plan(band_problem, parameters);
+  EXPECT_NEAR(band_plan.get_estimated_memory() -
+                  uncompressed_plan.get_estimated_memory(),
+              compressed_volume, 1.);
+}
+
+} // namespace test_ExecutionPlan
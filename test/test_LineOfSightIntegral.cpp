@@ -58,4 +58,182 @@ TEST(LineOfSightIntegral, sin2) {
   EXPECT_NEAR(expected, integral(longitude, latitude), tolerance);
 }
 
+TEST(LineOfSightIntegral, components) {
+  double radial_step_size_in_kpc = 0.001;
+  auto grid = create_grid();
+  tensors::tensor_4d components{create_grid_values(grid),
+                                create_grid_values(grid)};
+  for (auto &plane : components[1]) {
+    for (auto &row : plane) {
+      row[1] *= 3.;
+    }
+  }
+  LineOfSightIntegral integral(radial_step_size_in_kpc, grid, components[0]);
+  LineOfSightIntegral second_integral(radial_step_size_in_kpc, grid,
+                                      components[1]);
+
+  for (double latitude : {0., 0.3, -0.2}) {
+    auto direction = mathematics::spherical_to_cartesian(1., 0.1, latitude);
+    auto integrals = integral(direction, components);
+    ASSERT_EQ(integrals.size(), 2);
+    EXPECT_NEAR(integrals[0], integral(direction), 1e-12 * integrals[0]);
+    EXPECT_NEAR(integrals[1], second_integral(direction),
+                1e-12 * integrals[1]);
+    std::vector<double> buffer{1., 2., 3.};
+    integral(direction, components, buffer);
+    EXPECT_EQ(buffer, integrals);
+  }
+}
+
+TEST(LineOfSightIntegral, distances) {
+  double radial_step_size_in_kpc = 0.001;
+  auto grid = create_grid();
+  auto grid_values = create_grid_values(grid);
+  LineOfSightIntegral integral(radial_step_size_in_kpc, grid, grid_values);
+  std::array<double, 3> direction{1., 0., 0.};
+
+  auto profile = integral.resolve_distances(direction, {0., 1., 2., 4.});
+  ASSERT_EQ(profile.histogram.size(), 3);
+  EXPECT_NEAR(profile.integral, integral(direction), 1e-12 * profile.integral);
+  double histogram_sum = profile.histogram[0] + profile.histogram[1] +
+                         profile.histogram[2];
+  EXPECT_NEAR(histogram_sum, profile.integral, 1e-12 * profile.integral);
+  // ∫_0^1 sin²(r) dr / ∫_0^π sin²(r) dr
+  double expected_fraction = (0.5 - std::sin(2.) / 4.) / mathematics::half_pi;
+  EXPECT_NEAR(profile.histogram[0] / profile.integral, expected_fraction,
+              1e-3);
+  // sin² is symmetric with respect to π/2
+  EXPECT_NEAR(profile.mean_distance, mathematics::half_pi, 1e-3);
+
+  // radial cells outside of the bins are only part of the integral
+  auto truncated_profile = integral.resolve_distances(direction, {0., 1.});
+  EXPECT_EQ(truncated_profile.histogram[0], profile.histogram[0]);
+  EXPECT_EQ(truncated_profile.integral, profile.integral);
+
+  // a reused profile gets reset
+  integral.resolve_distances(direction, {0., 1., 2., 4.}, truncated_profile);
+  EXPECT_EQ(truncated_profile.histogram, profile.histogram);
+  EXPECT_EQ(truncated_profile.mean_distance, profile.mean_distance);
+}
+
+TEST(LineOfSightIntegral, planes) {
+  double radial_step_size_in_kpc = 0.001;
+  auto grid = create_grid();
+  grid.z_centers = {-1.5, -1., -0.4, 0., 0.3, 1., 1.5};
+  auto grid_values = tensors::make_3d_tensor(
+      {grid.x_centers.size(), grid.y_centers.size(), grid.z_centers.size()});
+  for (size_t x{}; x != grid.x_centers.size(); ++x) {
+    for (size_t y{}; y != grid.y_centers.size(); ++y) {
+      for (size_t z{}; z != grid.z_centers.size(); ++z) {
+        grid_values[x][y][z] =
+            mathematics::sqr(sin(grid.x_centers[x])) + static_cast<double>(z);
+      }
+    }
+  }
+  LineOfSightIntegral integral(radial_step_size_in_kpc, grid, grid_values);
+
+  // bricks of 2 cells along z that share their boundary planes
+  for (double latitude : {0., 0.3, -0.2, 0.5}) {
+    auto direction = mathematics::spherical_to_cartesian(1., 0.1, latitude);
+    double sum{};
+    for (size_t first_plane{}; first_plane < 6; first_plane += 2) {
+      tensors::tensor_3d planes(grid_values.size());
+      for (size_t x{}; x != planes.size(); ++x) {
+        for (const auto &row : grid_values[x]) {
+          planes[x].emplace_back(row.cbegin() + first_plane,
+                                 row.cbegin() + first_plane + 3);
+        }
+      }
+      double part = integral.integrate_planes(direction, planes, first_plane);
+      // the horizontal line of sight stays within the z cell [0, 0.3]
+      if (latitude == 0. && first_plane != 2) {
+        EXPECT_EQ(part, 0.);
+      }
+      sum += part;
+    }
+    EXPECT_NEAR(sum, integral(direction), 1e-12 * sum);
+  }
+}
+
+TEST(LineOfSightIntegral, observer_gradient) {
+  double radial_step_size_in_kpc = 0.001;
+  double kpc_to_cm = 3.0856775814913673e+21;
+  grids::cartesian_grid_3d grid;
+  for (size_t i{}; i != 31; ++i) {
+    grid.x_centers.push_back(-3. + 0.2 * static_cast<double>(i));
+  }
+  grid.y_centers = grid.x_centers;
+  grid.z_centers = {-1., -0.5, 0., 0.5, 1.};
+  // linear emissivity, which the trilinear interpolation reproduces
+  std::array<double, 3> slope{0.3, -0.2, 0.5};
+  auto emissivity = [&](const std::array<double, 3> &point) {
+    return 2. + slope[0] * point[0] + slope[1] * point[1] +
+           slope[2] * point[2];
+  };
+  auto grid_values = tensors::make_3d_tensor({31, 31, 5});
+  for (size_t x{}; x != 31; ++x) {
+    for (size_t y{}; y != 31; ++y) {
+      for (size_t z{}; z != 5; ++z) {
+        grid_values[x][y][z] = emissivity(
+            {grid.x_centers[x], grid.y_centers[y], grid.z_centers[z]});
+      }
+    }
+  }
+  LineOfSightIntegral integral(radial_step_size_in_kpc, grid, grid_values);
+
+  for (double latitude : {0., 0.1, -0.6}) {
+    auto direction = mathematics::spherical_to_cartesian(1., 0.4, latitude);
+    auto result = integral.differentiate_observer(direction);
+    EXPECT_EQ(result.integral, integral(direction));
+    // d/do ∫_0^s(o) emissivity(o + r direction) dr
+    //   = slope s + emissivity(s direction) ds/do
+    double exit_distance = 3. / direction[0];
+    size_t exit_axis = 0;
+    if (std::abs(direction[2]) * exit_distance > 1.) {
+      exit_distance = 1. / std::abs(direction[2]);
+      exit_axis = 2;
+    }
+    double exit_value =
+        emissivity({exit_distance * direction[0], exit_distance * direction[1],
+                    exit_distance * direction[2]});
+    for (size_t axis{}; axis != 3; ++axis) {
+      double expected = slope[axis] * exit_distance;
+      if (axis == exit_axis) {
+        expected -= exit_value / direction[axis];
+      }
+      expected *= kpc_to_cm;
+      EXPECT_NEAR(result.gradient[axis], expected,
+                  1e-3 * std::abs(kpc_to_cm * exit_value / direction[0]))
+          << "latitude " << latitude << ", axis " << axis;
+    }
+  }
+}
+
+TEST(LineOfSightIntegral, shared_setup) {
+  double radial_step_size_in_kpc = 0.001;
+  auto grid = create_grid();
+  auto grid_values = create_grid_values(grid);
+  auto other_values = grid_values;
+  for (auto &plane : other_values) {
+    plane[1][1] *= 3.;
+  }
+  // the setup has no values, so its integrals only see the shared grid
+  LineOfSightIntegral setup(radial_step_size_in_kpc, grid);
+  for (const auto *values : {&grid_values, &other_values}) {
+    for (double skipping_tolerance : {0., 1e-3}) {
+      LineOfSightIntegral integral(radial_step_size_in_kpc, grid, *values,
+                                   skipping_tolerance);
+      LineOfSightIntegral shared(setup, *values, skipping_tolerance);
+      for (double latitude : {0., 0.3, -0.5}) {
+        auto direction = mathematics::spherical_to_cartesian(1., 2., latitude);
+        EXPECT_EQ(shared(direction), integral(direction));
+        EXPECT_EQ(shared.differentiate_observer(direction).gradient,
+                  integral.differentiate_observer(direction).gradient);
+      }
+      EXPECT_EQ(shared.get_maximum_relative_error_bound(),
+                integral.get_maximum_relative_error_bound());
+    }
+  }
+}
+
 } // namespace LineOfSightIntegral_test
\ No newline at end of file
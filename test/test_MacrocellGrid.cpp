@@ -0,0 +1,90 @@
+// Author: Stefan Lepperdinger
+#include "LineOfSightIntegral.h"
+#include "MacrocellGrid.h"
+#include "grids.h"
+#include "tensors.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace test_MacrocellGrid {
+
+std::vector<double> create_1d_grid(double lower, double upper,
+                                   size_t number_of_points) {
+  std::vector<double> grid;
+  double step_size =
+      (upper - lower) / static_cast<double>(number_of_points - 1);
+  for (size_t i{}; i != number_of_points; ++i) {
+    grid.push_back(lower + static_cast<double>(i) * step_size);
+  }
+  return grid;
+}
+
+grids::cartesian_grid_3d create_grid() {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = create_1d_grid(-16., 16., 65);
+  grid.y_centers = create_1d_grid(-16., 16., 65);
+  grid.z_centers = create_1d_grid(-8., 8., 33);
+  return grid;
+}
+
+// bright disk around the observer at the origin within a faint halo
+tensors::tensor_3d create_disk(const grids::cartesian_grid_3d &grid) {
+  auto values = tensors::make_3d_tensor(
+      {grid.x_centers.size(), grid.y_centers.size(), grid.z_centers.size()});
+  for (size_t x{}; x != grid.x_centers.size(); ++x) {
+    for (size_t y{}; y != grid.y_centers.size(); ++y) {
+      for (size_t z{}; z != grid.z_centers.size(); ++z) {
+        double radius = std::hypot(grid.x_centers[x], grid.y_centers[y]);
+        values[x][y][z] =
+            1e-21 * (std::exp(-radius / 3. - std::abs(grid.z_centers[z]) / .2) +
+                     1e-7);
+      }
+    }
+  }
+  return values;
+}
+
+TEST(test_MacrocellGrid, block_maxima) {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = create_1d_grid(0., 4., 5);
+  grid.y_centers = create_1d_grid(0., 2., 3);
+  grid.z_centers = create_1d_grid(0., 2., 3);
+  auto values = tensors::make_3d_tensor({5, 3, 3});
+  values[2][0][0] = -3.;
+  values[4][2][2] = 5.;
+  MacrocellGrid macrocells(grid, values, 2);
+
+  auto lower_block = macrocells.locate({.5, .5, .5});
+  auto upper_block = macrocells.locate({3.5, .5, .5});
+  EXPECT_NE(lower_block, upper_block);
+  // the grid point on the boundary belongs to both blocks
+  EXPECT_EQ(macrocells.get_maximum(lower_block), 3.);
+  EXPECT_EQ(macrocells.get_maximum(upper_block), 5.);
+  EXPECT_DOUBLE_EQ(macrocells.get_exit_distance(lower_block, {1., 0., 0.}), 2.);
+  EXPECT_DOUBLE_EQ(
+      macrocells.get_exit_distance(lower_block, {0.6, 0.8, 0.}), 2.5);
+}
+
+TEST(test_MacrocellGrid, skipping_error_bound) {
+  auto grid = create_grid();
+  auto values = create_disk(grid);
+  LineOfSightIntegral integral(.01, grid, values);
+  LineOfSightIntegral unchanged_integral(.01, grid, values, 0.);
+  double tolerance = 1e-3;
+  LineOfSightIntegral skipping_integral(.01, grid, values, tolerance);
+
+  for (double longitude : {0., 1., 2.5, 4.}) {
+    for (double latitude : {0., .05, .3, -1.}) {
+      double expected = integral(longitude, latitude);
+      EXPECT_EQ(unchanged_integral(longitude, latitude), expected);
+      double skipped = skipping_integral(longitude, latitude);
+      EXPECT_LE(skipped, expected);
+      EXPECT_LE(expected - skipped, tolerance * expected);
+    }
+  }
+  EXPECT_EQ(unchanged_integral.get_maximum_relative_error_bound(), 0.);
+  EXPECT_GT(skipping_integral.get_maximum_relative_error_bound(), 0.);
+  EXPECT_LE(skipping_integral.get_maximum_relative_error_bound(), tolerance);
+}
+
+} // namespace test_MacrocellGrid
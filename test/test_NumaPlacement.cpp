@@ -0,0 +1,124 @@
+// Author: Stefan Lepperdinger
+#include "NumaPlacement.h"
+#include "tensors.h"
+#include <algorithm>
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <mutex>
+#include <stdexcept>
+
+namespace NumaPlacement_test {
+
+tensors::tensor_3d create_volume() {
+  auto volume = tensors::make_3d_tensor({6, 5, 4});
+  for (size_t x{}; x != 6; ++x) {
+    for (size_t y{}; y != 5; ++y) {
+      for (size_t z{}; z != 4; ++z) {
+        volume[x][y][z] = static_cast<double>(100 * x + 10 * y + z);
+      }
+    }
+  }
+  return volume;
+}
+
+TEST(NumaPlacement, parse_policy) {
+  EXPECT_EQ(NumaPlacement::parse_policy("first_touch"),
+            NumaPlacement::policy::first_touch);
+  EXPECT_EQ(NumaPlacement::parse_policy("replicate"),
+            NumaPlacement::policy::replicate);
+  EXPECT_THROW(NumaPlacement::parse_policy("spread"), std::invalid_argument);
+}
+
+TEST(NumaPlacement, run) {
+  auto volume = create_volume();
+  size_t number_of_values = 1001;
+  for (auto policy : {NumaPlacement::policy::first_touch,
+                      NumaPlacement::policy::replicate}) {
+    for (bool huge_pages : {false, true}) {
+      NumaPlacement placement(policy, huge_pages);
+      std::vector<int> visits(number_of_values);
+      std::mutex mutex;
+      placement.run(volume, number_of_values,
+                    [&](const tensors::tensor_3d &local_volume, size_t first,
+                        size_t last) {
+                      std::lock_guard<std::mutex> lock(mutex);
+                      EXPECT_EQ(local_volume, volume);
+                      for (size_t i = first; i != last; ++i) {
+                        ++visits[i];
+                      }
+                    });
+      for (int count : visits) {
+        ASSERT_EQ(count, 1);
+      }
+    }
+  }
+}
+
+TEST(NumaPlacement, replicas) {
+  auto volume = create_volume();
+  for (auto policy : {NumaPlacement::policy::first_touch,
+                      NumaPlacement::policy::replicate}) {
+    NumaPlacement placement(policy, false);
+    auto replicas = placement.replicate(volume);
+    // the runs over the replicas reuse the same local volumes
+    std::vector<const tensors::tensor_3d *> local_volumes;
+    std::mutex mutex;
+    for (int run{}; run != 2; ++run) {
+      std::vector<const tensors::tensor_3d *> run_volumes;
+      placement.run(replicas, 100,
+                    [&](const tensors::tensor_3d &local_volume, size_t,
+                        size_t) {
+                      std::lock_guard<std::mutex> lock(mutex);
+                      EXPECT_EQ(local_volume, volume);
+                      run_volumes.push_back(&local_volume);
+                    });
+      std::sort(run_volumes.begin(), run_volumes.end());
+      if (run == 0) {
+        local_volumes = run_volumes;
+      }
+      EXPECT_EQ(run_volumes, local_volumes);
+    }
+    if (placement.get_number_of_replicas() == 0) {
+      EXPECT_EQ(&replicas.get_volume(0), &volume);
+    }
+  }
+}
+
+TEST(NumaPlacement, advise_huge_pages) {
+  auto volume = tensors::make_3d_tensor({64, 64, 64});
+  NumaPlacement::advise_huge_pages(volume);
+  volume[63][63][63] = 1.;
+  EXPECT_EQ(volume[63][63][63], 1.);
+}
+
+TEST(NumaPlacement, huge_page_ranges) {
+  // 16 MB, such that whole huge pages lie within the planes
+  auto volume = tensors::make_3d_tensor({32, 256, 256});
+  std::uintptr_t huge_page_size = std::uintptr_t{1} << 21;
+  auto ranges = NumaPlacement::find_huge_page_ranges(volume);
+  ASSERT_FALSE(ranges.empty());
+  std::uintptr_t covered{};
+  for (const auto &range : ranges) {
+    EXPECT_EQ(range[0] % huge_page_size, 0);
+    EXPECT_EQ(range[1] % huge_page_size, 0);
+    EXPECT_LT(range[0], range[1]);
+    covered += range[1] - range[0];
+    // the ranges are rounded inwards: the first and the last byte of every
+    // huge page lie within the row arrays and rows of the planes
+    for (auto page = range[0]; page != range[1]; page += huge_page_size) {
+      for (auto address : {page, page + huge_page_size - 1}) {
+        bool in_plane = false;
+        for (const auto &plane : volume) {
+          auto begin = reinterpret_cast<std::uintptr_t>(plane.data());
+          auto end = reinterpret_cast<std::uintptr_t>(plane.back().data() +
+                                                      plane.back().size());
+          in_plane = in_plane || (begin <= address + 64 && address < end + 64);
+        }
+        EXPECT_TRUE(in_plane);
+      }
+    }
+  }
+  EXPECT_GE(covered, 4 * huge_page_size);
+}
+
+} // namespace NumaPlacement_test
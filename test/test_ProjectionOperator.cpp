@@ -0,0 +1,80 @@
+// Author: Stefan Lepperdinger
+#include "LineOfSightIntegral.h"
+#include "ProjectionOperator.h"
+#include "grids.h"
+#include "mathematics.h"
+#include "tensors.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace test_ProjectionOperator {
+
+std::vector<double> create_1d_grid(const std::array<double, 2> &interval,
+                                   unsigned int number_of_points) {
+  std::vector<double> grid;
+  grid.reserve(number_of_points);
+  double step_size = (interval[1] - interval[0]) / (number_of_points - 1);
+  for (unsigned int i{0}; i != number_of_points; ++i) {
+    grid.push_back(interval[0] + i * step_size);
+  }
+  return grid;
+}
+
+grids::cartesian_grid_3d create_grid() {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = create_1d_grid({-4.1, 3.3}, 17);
+  grid.y_centers = create_1d_grid({-2.7, 3.9}, 12);
+  grid.z_centers = create_1d_grid({-1.2, 1.4}, 9);
+  return grid;
+}
+
+tensors::tensor_3d create_grid_values(const grids::cartesian_grid_3d &grid) {
+  auto values = tensors::make_3d_tensor(
+      {grid.x_centers.size(), grid.y_centers.size(), grid.z_centers.size()});
+  for (size_t x{}; x != grid.x_centers.size(); ++x) {
+    for (size_t y{}; y != grid.y_centers.size(); ++y) {
+      for (size_t z{}; z != grid.z_centers.size(); ++z) {
+        values[x][y][z] = 1e-21 * (2. + sin(grid.x_centers[x]) *
+                                            cos(grid.y_centers[y]) *
+                                            exp(-grid.z_centers[z]));
+      }
+    }
+  }
+  return values;
+}
+
+TEST(test_ProjectionOperator, matches_line_of_sight_integral) {
+  double radial_step_size = 0.01;
+  auto grid = create_grid();
+  auto values = create_grid_values(grid);
+  tensors::tensor_2d sky_coordinates = {
+      {0., 0.}, {1.3, 0.2}, {3.1, -0.4}, {4.4, 1.1}, {5.9, -1.5}};
+
+  PixelDirections directions(sky_coordinates);
+  ProjectionOperator projection_operator({radial_step_size, 0., 0., 0}, grid,
+                                         directions);
+  EXPECT_EQ(projection_operator.get_geometry().radial_step_size,
+            radial_step_size);
+  LineOfSightIntegral integral(radial_step_size, grid, values);
+  auto sky = projection_operator(values);
+
+  ASSERT_EQ(sky.size(), sky_coordinates.size());
+  for (size_t pixel{}; pixel != sky.size(); ++pixel) {
+    double expected = integral(directions[pixel]);
+    EXPECT_NEAR(sky[pixel], expected, 1e-6 * expected);
+  }
+}
+
+TEST(test_ProjectionOperator, merged_columns) {
+  auto grid = create_grid();
+  PixelDirections directions(tensors::tensor_2d{{0.7, 0.3}});
+  ProjectionOperator projection_operator({0.001, 0., 0., 0}, grid, directions);
+  const auto &row_offsets = projection_operator.get_row_offsets();
+  const auto &column_indices = projection_operator.get_column_indices();
+  ASSERT_EQ(row_offsets.size(), 2);
+  for (auto i = row_offsets[0] + 1; i < row_offsets[1]; ++i) {
+    EXPECT_LT(column_indices[i - 1], column_indices[i]);
+  }
+}
+
+} // namespace test_ProjectionOperator
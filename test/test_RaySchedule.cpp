@@ -0,0 +1,105 @@
+// Author: Stefan Lepperdinger
+#include "RaySchedule.h"
+#include "grids.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace RaySchedule_test {
+
+/**
+ * @return costs of a sky in RING order: a few expensive lines of sight along
+ *         the disk in the middle and cheap ones towards the poles
+ */
+std::vector<double> create_costs() {
+  std::vector<double> costs(1000);
+  for (size_t i{}; i != costs.size(); ++i) {
+    double latitude = 3. * (static_cast<double>(i) / 999. - 0.5);
+    costs[i] = 1. + 400. * std::exp(-latitude * latitude / 0.02);
+  }
+  return costs;
+}
+
+TEST(RaySchedule, parse_policy) {
+  EXPECT_EQ(RaySchedule::parse_policy("equal_count"),
+            RaySchedule::policy::equal_count);
+  EXPECT_EQ(RaySchedule::parse_policy("cost_balanced"),
+            RaySchedule::policy::cost_balanced);
+  EXPECT_THROW(RaySchedule::parse_policy("longest"), std::invalid_argument);
+}
+
+TEST(RaySchedule, estimate_cost) {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = {-10., 0., 20.};
+  grid.y_centers = {-5., 5.};
+  grid.z_centers = {-2., 0., 2.};
+  double step = 0.5;
+  EXPECT_DOUBLE_EQ(RaySchedule::estimate_cost(grid, step, {1., 0., 0.}),
+                   20. / step + 1.);
+  EXPECT_DOUBLE_EQ(RaySchedule::estimate_cost(grid, step, {-1., 0., 0.}),
+                   10. / step + 1.);
+  EXPECT_DOUBLE_EQ(RaySchedule::estimate_cost(grid, step, {0., 0., -1.}),
+                   2. / step + 1.);
+  // leaves through the z face before the x face
+  double c = std::sqrt(0.5);
+  EXPECT_DOUBLE_EQ(RaySchedule::estimate_cost(grid, step, {c, 0., c}),
+                   2. / c / step + 1.);
+}
+
+TEST(RaySchedule, cost_balanced_tiles) {
+  auto costs = create_costs();
+  double total_cost = std::accumulate(costs.cbegin(), costs.cend(), 0.);
+  double maximum_cost = *std::max_element(costs.cbegin(), costs.cend());
+  size_t number_of_workers = 4;
+  RaySchedule schedule(costs, number_of_workers);
+  size_t number_of_tiles = schedule.get_number_of_tiles();
+  ASSERT_EQ(number_of_tiles, number_of_workers * RaySchedule::tiles_per_worker);
+
+  // consecutive, non-empty tiles of nearly equal cost
+  size_t next_value{};
+  for (size_t tile{}; tile != number_of_tiles; ++tile) {
+    auto [first, last] = schedule.get_tile(tile);
+    EXPECT_EQ(first, next_value);
+    EXPECT_LT(first, last);
+    double tile_cost = std::accumulate(costs.cbegin() + first,
+                                       costs.cbegin() + last, 0.);
+    EXPECT_LE(tile_cost,
+              total_cost / static_cast<double>(number_of_tiles) +
+                  2. * maximum_cost);
+    next_value = last;
+  }
+  EXPECT_EQ(next_value, costs.size());
+
+  // the disk lines of sight end up in the chunks of the middle workers
+  auto load_balance = schedule.get_load_balance();
+  EXPECT_DOUBLE_EQ(load_balance.predicted_mean,
+                   total_cost / static_cast<double>(number_of_workers));
+  EXPECT_GT(load_balance.get_equal_count_imbalance(), 1.8);
+  EXPECT_LT(load_balance.get_predicted_imbalance(), 1.1);
+  EXPECT_GE(load_balance.get_predicted_imbalance(), 1.);
+}
+
+TEST(RaySchedule, run) {
+  auto costs = create_costs();
+  for (const auto &schedule :
+       {RaySchedule(costs.size(), 4), RaySchedule(costs, 4)}) {
+    std::vector<std::atomic<int>> visits(costs.size());
+    schedule.run(0, schedule.get_number_of_tiles(),
+                 [&](const tbb::blocked_range<size_t> &values) {
+                   for (size_t i = values.begin(); i != values.end(); ++i) {
+                     ++visits[i];
+                   }
+                 });
+    EXPECT_TRUE(std::all_of(visits.cbegin(), visits.cend(),
+                            [](const auto &count) { return count == 1; }));
+    auto load_balance = schedule.get_load_balance();
+    EXPECT_GE(load_balance.measured_maximum, load_balance.measured_mean);
+  }
+  EXPECT_EQ(RaySchedule(costs.size(), 4).get_number_of_tiles(), costs.size());
+}
+
+} // namespace RaySchedule_test
@@ -0,0 +1,171 @@
+// Author: Stefan Lepperdinger
+#include "ParameterFile.h"
+#include "Sky.h"
+#include "grids.h"
+#include "tensors.h"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+namespace Sky_test {
+
+grids::cartesian_grid_3d create_grid() {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = {-1., 0., 1.};
+  grid.x_boundaries = {-1.5, -0.5, 0.5};
+  grid.y_centers = grid.x_centers;
+  grid.y_boundaries = grid.x_boundaries;
+  grid.z_centers = grid.x_centers;
+  grid.z_boundaries = grid.x_boundaries;
+  return grid;
+}
+
+ParameterFile::Parameters
+create_parameters(const std::vector<double> &requested_energies) {
+  ParameterFile::Parameters parameters{};
+  parameters.radial_step_size = 0.1;
+  parameters.symmetry_tolerance = 1e-6;
+  parameters.volume_compression = "none";
+  parameters.numa_policy = "first_touch";
+  parameters.ray_scheduling = "equal_count";
+  parameters.compute_energy_skies = true;
+  parameters.requested_energies = requested_energies;
+  return parameters;
+}
+
+const std::vector<double> energies = {1e2, 1e3, 1e4, 1e5, 1e6};
+
+TEST(Sky, requested_energies) {
+  tensors::tensor_4d emissivities(energies.size());
+  auto grid = create_grid();
+  // 1e4 is an energy of the input file within single precision
+  auto parameters = create_parameters({150., 1e4 * (1. + 1e-7)});
+  Sky sky(energies, emissivities, grid, parameters);
+  // only the bracketing energies are computed
+  EXPECT_EQ(sky.get_energy_indices(), (std::vector<size_t>{0, 1, 2}));
+  EXPECT_EQ(sky.get_requested_energies(), parameters.requested_energies);
+
+  tensors::tensor_2d skies = {{1., 2.}, {0.1, 0.}, {5., 6.}};
+  auto requested_skies = sky.interpolate_requested_skies(skies);
+  ASSERT_EQ(requested_skies.size(), 2);
+  double weight = std::log(1.5) / std::log(10.);
+  // log-log interpolation, or linear in ln(energy) for non-positive skies
+  EXPECT_NEAR(requested_skies[0][0], std::pow(0.1, weight), 1e-12);
+  EXPECT_NEAR(requested_skies[0][1], 2. * (1. - weight), 1e-12);
+  // energies of the input file are copied
+  EXPECT_EQ(requested_skies[1], skies[2]);
+}
+
+TEST(Sky, requested_energies_out_of_range) {
+  tensors::tensor_4d emissivities(energies.size());
+  auto grid = create_grid();
+  for (double energy : {50., 2e6}) {
+    auto parameters = create_parameters({1e3, energy});
+    EXPECT_THROW(Sky(energies, emissivities, grid, parameters),
+                 std::invalid_argument);
+  }
+  // the energy indices of a shard can't be combined with requested energies
+  auto parameters = create_parameters({1e3});
+  parameters.energy_indices = std::vector<size_t>{0, 1};
+  EXPECT_THROW(Sky(energies, emissivities, grid, parameters),
+               std::invalid_argument);
+}
+
+TEST(Sky, projection_operator_grid) {
+  tensors::tensor_4d emissivities(energies.size());
+  auto grid = create_grid();
+  auto parameters = create_parameters({});
+  auto projection_operator =
+      Sky(energies, emissivities, grid, parameters).make_projection_operator();
+  EXPECT_NO_THROW(Sky(energies, emissivities, grid, parameters)
+                      .use_projection_operator(projection_operator));
+
+  // same grid dimensions, but a different observer or grid
+  auto moved_parameters = parameters;
+  moved_parameters.xyz_observer_location = {0.5, 0., 0.};
+  EXPECT_THROW(Sky(energies, emissivities, grid, moved_parameters)
+                   .use_projection_operator(projection_operator),
+               std::invalid_argument);
+  auto stretched_grid = grid;
+  stretched_grid.z_centers = {-2., 0., 2.};
+  EXPECT_THROW(Sky(energies, emissivities, stretched_grid, parameters)
+                   .use_projection_operator(projection_operator),
+               std::invalid_argument);
+
+  // same grid and number of pixels, but different lines of sight
+  auto refined_parameters = parameters;
+  refined_parameters.radial_step_size *= 0.5;
+  auto rotated_parameters = parameters;
+  rotated_parameters.line_of_sight_longitude += 0.1;
+  auto tilted_parameters = parameters;
+  tilted_parameters.line_of_sight_latitude += 0.1;
+  std::vector<ParameterFile::Parameters> other_lines_of_sight{
+      refined_parameters, rotated_parameters, tilted_parameters};
+  for (auto &other_parameters : other_lines_of_sight) {
+    EXPECT_THROW(Sky(energies, emissivities, grid, other_parameters)
+                     .use_projection_operator(projection_operator),
+                 std::invalid_argument);
+  }
+  // same number of pixels, but a different part of the sky
+  auto first_half = parameters;
+  first_half.pixel_range = std::array<size_t, 2>{0, 6};
+  auto second_half = parameters;
+  second_half.pixel_range = std::array<size_t, 2>{6, 12};
+  auto half_operator = Sky(energies, emissivities, grid, first_half)
+                           .make_projection_operator();
+  EXPECT_NO_THROW(Sky(energies, emissivities, grid, first_half)
+                      .use_projection_operator(half_operator));
+  EXPECT_THROW(Sky(energies, emissivities, grid, second_half)
+                   .use_projection_operator(half_operator),
+               std::invalid_argument);
+}
+
+TEST(Sky, compress_emissivity) {
+  auto grid = create_grid();
+  tensors::tensor_4d emissivities(energies.size());
+  for (size_t energy{}; energy != energies.size(); ++energy) {
+    emissivities[energy] = tensors::make_3d_tensor({3, 3, 3});
+    for (size_t x{}; x != 3; ++x) {
+      for (size_t y{}; y != 3; ++y) {
+        for (size_t z{}; z != 3; ++z) {
+          emissivities[energy][x][y][z] =
+              static_cast<double>(1 + energy + x * y + z);
+        }
+      }
+    }
+  }
+  auto parameters = create_parameters({});
+  parameters.volume_compression = "fp16";
+  Sky sky(energies, emissivities, grid, parameters);
+  auto skies = sky.compute_gamma_skies();
+
+  // the double precision volumes can be freed after the compression
+  auto resident_emissivities = emissivities;
+  Sky compressed_sky(energies, resident_emissivities, grid, parameters);
+  for (size_t energy{}; energy != energies.size(); ++energy) {
+    compressed_sky.compress_emissivity(energy);
+    tensors::tensor_3d().swap(resident_emissivities[energy]);
+  }
+  EXPECT_EQ(compressed_sky.compute_gamma_skies(), skies);
+  EXPECT_EQ(compressed_sky.get_compression_error(),
+            sky.get_compression_error());
+
+  // the progressive skies compress every volume once for all levels
+  auto ignore_preview = [](int, const tensors::tensor_2d &) {};
+  auto progressive_skies = sky.compute_progressive_gamma_skies(ignore_preview);
+  for (size_t energy{}; energy != energies.size(); ++energy) {
+    resident_emissivities[energy] = emissivities[energy];
+    compressed_sky.compress_emissivity(energy);
+    tensors::tensor_3d().swap(resident_emissivities[energy]);
+  }
+  EXPECT_EQ(compressed_sky.compute_progressive_gamma_skies(ignore_preview),
+            progressive_skies);
+
+  parameters.volume_compression = "none";
+  Sky uncompressed_sky(energies, emissivities, grid, parameters);
+  EXPECT_THROW(uncompressed_sky.compress_emissivity(0),
+               std::invalid_argument);
+}
+
+} // namespace Sky_test
@@ -0,0 +1,125 @@
+// Author: Stefan Lepperdinger
+#include "LineOfSightIntegral.h"
+#include "SkySymmetry.h"
+#include "grids.h"
+#include "mathematics.h"
+#include "tensors.h"
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace test_SkySymmetry {
+
+std::vector<double> create_1d_grid(double lower, double upper,
+                                   size_t number_of_points) {
+  std::vector<double> grid;
+  double step_size =
+      (upper - lower) / static_cast<double>(number_of_points - 1);
+  for (size_t i{}; i != number_of_points; ++i) {
+    grid.push_back(lower + static_cast<double>(i) * step_size);
+  }
+  return grid;
+}
+
+// grid relative to an observer in the plane z = 0, but not at y = 0
+grids::cartesian_grid_3d create_grid() {
+  grids::cartesian_grid_3d grid;
+  grid.x_centers = create_1d_grid(-6., 6., 25);
+  grid.y_centers = create_1d_grid(-5., 7., 25);
+  grid.z_centers = create_1d_grid(-2., 2., 17);
+  return grid;
+}
+
+tensors::tensor_3d create_values(const grids::cartesian_grid_3d &grid) {
+  auto values = tensors::make_3d_tensor(
+      {grid.x_centers.size(), grid.y_centers.size(), grid.z_centers.size()});
+  for (size_t x{}; x != grid.x_centers.size(); ++x) {
+    for (size_t y{}; y != grid.y_centers.size(); ++y) {
+      for (size_t z{}; z != grid.z_centers.size(); ++z) {
+        values[x][y][z] =
+            1e-21 *
+            std::exp(-std::abs(grid.z_centers[z]) - grid.y_centers[y] / 4.) *
+            (2. + std::cos(grid.x_centers[x]));
+      }
+    }
+  }
+  return values;
+}
+
+TEST(test_SkySymmetry, detect_mirrors) {
+  auto grid = create_grid();
+  auto values = create_values(grid);
+  EXPECT_EQ(SkySymmetry::detect_mirrors(grid, values, 1e-6),
+            SkySymmetry::x_mirror | SkySymmetry::z_mirror);
+  EXPECT_EQ(SkySymmetry::detect_mirrors(grid, values, -1.), 0);
+
+  // keeps the x mirror symmetry
+  values[3][4][2] *= 1.001;
+  values[21][4][2] *= 1.001;
+  EXPECT_EQ(SkySymmetry::detect_mirrors(grid, values, 1e-6),
+            SkySymmetry::x_mirror);
+  EXPECT_EQ(SkySymmetry::detect_mirrors(grid, values, 1e-2),
+            SkySymmetry::x_mirror | SkySymmetry::z_mirror);
+}
+
+TEST(test_SkySymmetry, pixel_mirrors) {
+  Healpix_Base healpix_base(3, RING);
+  auto all = SkySymmetry::x_mirror | SkySymmetry::y_mirror |
+             SkySymmetry::z_mirror;
+  EXPECT_EQ(SkySymmetry(healpix_base, mathematics::pi, 0.).get_pixel_mirrors(),
+            all);
+  EXPECT_EQ(SkySymmetry(healpix_base, 0.5, 0.).get_pixel_mirrors(),
+            SkySymmetry::z_mirror);
+  EXPECT_EQ(SkySymmetry(healpix_base, mathematics::half_pi / 2., 0.1)
+                .get_pixel_mirrors(),
+            SkySymmetry::x_mirror | SkySymmetry::y_mirror);
+
+  SkySymmetry symmetry(healpix_base, mathematics::pi, 0.);
+  for (size_t pixel{}; pixel != static_cast<size_t>(healpix_base.Npix());
+       ++pixel) {
+    auto angles = healpix_base.pix2ang(static_cast<int>(pixel));
+    auto mirrored = healpix_base.pix2ang(static_cast<int>(
+        symmetry.mirror_pixel(pixel, SkySymmetry::z_mirror)));
+    EXPECT_NEAR(mirrored.theta, mathematics::pi - angles.theta, 1e-12);
+    EXPECT_NEAR(mirrored.phi, angles.phi, 1e-12);
+    for (unsigned mirrors{1}; mirrors <= all; ++mirrors) {
+      EXPECT_EQ(symmetry.mirror_pixel(symmetry.mirror_pixel(pixel, mirrors),
+                                      mirrors),
+                pixel);
+    }
+  }
+}
+
+TEST(test_SkySymmetry, mirrored_integrals) {
+  auto grid = create_grid();
+  auto values = create_values(grid);
+  Healpix_Base healpix_base(2, RING);
+  double line_of_sight_longitude = mathematics::pi;
+  SkySymmetry symmetry(healpix_base, line_of_sight_longitude, 0.);
+  auto mirrors = symmetry.get_pixel_mirrors() &
+                 SkySymmetry::detect_mirrors(grid, values, 1e-6);
+  auto representatives = symmetry.make_representatives(
+      mirrors, {0, static_cast<size_t>(healpix_base.Npix())});
+
+  LineOfSightIntegral integral(.01, grid, values);
+  auto integrate = [&](size_t pixel) {
+    auto angles = healpix_base.pix2ang(static_cast<int>(pixel));
+    return integral(angles.phi + line_of_sight_longitude,
+                    mathematics::half_pi - angles.theta);
+  };
+  size_t number_of_representatives{};
+  for (size_t pixel{}; pixel != representatives.size(); ++pixel) {
+    ASSERT_LE(representatives[pixel], pixel);
+    EXPECT_EQ(representatives[representatives[pixel]], representatives[pixel]);
+    if (representatives[pixel] == pixel) {
+      ++number_of_representatives;
+    } else {
+      double expected = integrate(pixel);
+      EXPECT_NEAR(integrate(representatives[pixel]), expected,
+                  1e-6 * expected);
+    }
+  }
+  // two mirror planes: about a quarter of the pixels get integrated
+  EXPECT_LT(number_of_representatives, representatives.size() / 3);
+}
+
+} // namespace test_SkySymmetry
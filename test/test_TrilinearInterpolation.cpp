@@ -68,4 +68,43 @@ TEST(test_TrilinearInterpolation, linear_scalar_field) {
   EXPECT_NEAR(linear_scalar_field(xyz), interpolation(xyz), tolerance);
 }
 
+TEST(test_TrilinearInterpolation, non_uniform_grid) {
+  // refined z-resolution near the plane
+  auto grid = create_3d_grid();
+  grid.z_centers = {-21., -6., -2., -1., -0.5, -0.25, 0., 0.1,
+                    0.25, 0.5, 1., 2., 6., 9.};
+  auto grid_values = create_grid_values(grid);
+  TrilinearInterpolation interpolation(grid, grid_values);
+  double tolerance = 1e-10;
+  for (double z : {-20.9, -3.3, -0.3, 0.05, 0.2, 0.7, 1.5, 8.99}) {
+    std::array<double, 3> xyz{3.93, -8.03, z};
+    EXPECT_NEAR(linear_scalar_field(xyz), interpolation(xyz), tolerance);
+  }
+}
+
+TEST(test_TrilinearInterpolation, gradient) {
+  auto grid = create_3d_grid();
+  auto grid_values = create_grid_values(grid);
+  auto non_uniform_grid = grid;
+  non_uniform_grid.z_centers = {-21., -6., -2., -1., 0., 0.1, 2., 6., 9.};
+  auto non_uniform_values = create_grid_values(non_uniform_grid);
+  TrilinearInterpolation interpolation(grid, grid_values);
+  TrilinearInterpolation non_uniform_interpolation(non_uniform_grid,
+                                                   non_uniform_values);
+  double tolerance = 1e-10;
+  for (const auto &xyz : {std::array<double, 3>{3.93, -8.03, 0.43},
+                          std::array<double, 3>{-4.76, 1.44, 0.05}}) {
+    EXPECT_EQ(interpolation.interpolate_with_gradient(xyz)[0],
+              interpolation(xyz));
+    for (const auto &result :
+         {interpolation.interpolate_with_gradient(xyz),
+          non_uniform_interpolation.interpolate_with_gradient(xyz)}) {
+      EXPECT_NEAR(result[0], linear_scalar_field(xyz), tolerance);
+      EXPECT_NEAR(result[1], 0.435, tolerance);
+      EXPECT_NEAR(result[2], 3.21, tolerance);
+      EXPECT_NEAR(result[3], -.3, tolerance);
+    }
+  }
+}
+
 } // namespace test_TrilinearInterpolation
@@ -1,6 +1,7 @@
 // Author: Stefan Lepperdinger
 #include "grids.h"
 #include <gtest/gtest.h>
+#include <stdexcept>
 
 TEST(grids, is_within_grid) {
   grids::cartesian_grid_3d grid;
@@ -17,3 +18,38 @@ TEST(grids, is_within_grid) {
   EXPECT_EQ(false, grid.is_within_grid({0., -32., 0.}));
   EXPECT_EQ(false, grid.is_within_grid({0., 0., -20.}));
 }
+
+TEST(grids, axis_lookup_uniform) {
+  grids::axis_lookup axis({-1., 0.5, 2., 3.5});
+  EXPECT_TRUE(axis.is_uniform());
+  size_t cell;
+  double fraction;
+  axis.locate(1., cell, fraction);
+  EXPECT_EQ(cell, 1);
+  EXPECT_NEAR(fraction, 1. / 3., 1e-12);
+  // locations outside of the axis are clamped
+  axis.locate(3.5, cell, fraction);
+  EXPECT_EQ(cell, 2);
+  EXPECT_DOUBLE_EQ(fraction, 1.);
+  axis.locate(-2., cell, fraction);
+  EXPECT_EQ(cell, 0);
+  EXPECT_DOUBLE_EQ(fraction, 0.);
+}
+
+TEST(grids, axis_lookup_non_uniform) {
+  std::vector<double> points{-4., -1., -0.5, -0.25, 0., 0.25, 0.5, 1., 4.};
+  grids::axis_lookup axis(points);
+  EXPECT_FALSE(axis.is_uniform());
+  size_t cell;
+  double fraction;
+  for (size_t i{}; i + 1 != points.size(); ++i) {
+    double location = points[i] + 0.3 * (points[i + 1] - points[i]);
+    axis.locate(location, cell, fraction);
+    EXPECT_EQ(cell, i);
+    EXPECT_NEAR(fraction, 0.3, 1e-12);
+  }
+  axis.locate(4., cell, fraction);
+  EXPECT_EQ(cell, points.size() - 2);
+  EXPECT_DOUBLE_EQ(fraction, 1.);
+  EXPECT_THROW(grids::axis_lookup({1., 1., 2.}), std::invalid_argument);
+}
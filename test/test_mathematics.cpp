@@ -1,6 +1,7 @@
 // Author: Stefan Lepperdinger
 #include "mathematics.h"
 #include <array>
+#include <cmath>
 #include <gtest/gtest.h>
 #include <vector>
 
@@ -93,4 +94,90 @@ TEST(mathematics, spherical_to_cartesian) {
   EXPECT_NEAR(result[z], 31.00523663, tolerance);
 }
 
+TEST(mathematics, log_trapezoid_weights) {
+  double tolerance = 1e-10;
+  std::vector<double> x = {1., 10., 100., 1000.};
+  double ln_10 = log(10.);
+
+  // f = 1 integrates to the length of the interval in ln(x)
+  auto weights = log_trapezoid_weights(x, 1., 1000.);
+  EXPECT_NEAR(weights[0] + weights[1] + weights[2] + weights[3], 3. * ln_10,
+              tolerance);
+  EXPECT_NEAR(weights[0], .5 * ln_10, tolerance);
+  EXPECT_NEAR(weights[1], ln_10, tolerance);
+
+  // f = ln(x) is linear in ln(x) and therefore integrated exactly
+  weights = log_trapezoid_weights(x, 15., 300.);
+  double integral{};
+  for (size_t i{}; i != x.size(); ++i) {
+    integral += weights[i] * log(x[i]);
+  }
+  double expected = .5 * (sqr(log(300.)) - sqr(log(15.)));
+  EXPECT_NEAR(integral, expected, tolerance);
+  EXPECT_NEAR(weights[0], 0., tolerance);
+}
+
+TEST(mathematics, find_log_bracket) {
+  double tolerance = 1e-12;
+  std::vector<double> x = {1., 10., 100., 1000.};
+  auto bracket = find_log_bracket(x, sqrt(10.) * 10.);
+  EXPECT_EQ(bracket.lower, 1);
+  EXPECT_EQ(bracket.upper, 2);
+  EXPECT_NEAR(bracket.weight, .5, tolerance);
+
+  // sampling points and the ends of the interval aren't interpolated
+  for (size_t i{}; i != x.size(); ++i) {
+    bracket = find_log_bracket(x, x[i]);
+    EXPECT_EQ(bracket.lower, i);
+    EXPECT_EQ(bracket.upper, i);
+    EXPECT_EQ(bracket.weight, 0.);
+  }
+}
+
+TEST(mathematics, log_log_interpolate) {
+  double tolerance = 1e-12;
+  // power laws are interpolated exactly: f = 3 x^-2.7 between x = 10 and 100
+  std::vector<double> x = {10., 100.};
+  auto f = [](double x) { return 3. * pow(x, -2.7); };
+  double value = 42.;
+  auto bracket = find_log_bracket(x, value);
+  EXPECT_NEAR(log_log_interpolate(f(10.), f(100.), bracket.weight) / f(value),
+              1., tolerance);
+  EXPECT_EQ(log_log_interpolate(f(10.), f(100.), 0.), f(10.));
+
+  // linear in ln(x) if a value isn't positive
+  EXPECT_NEAR(log_log_interpolate(0., 2., .25), .5, tolerance);
+  EXPECT_NEAR(log_log_interpolate(-1., 1., .5), 0., tolerance);
+}
+
+TEST(mathematics, diagonalize_symmetric_matrix) {
+  double tolerance = 1e-10;
+  std::vector<std::vector<double>> matrix = {{4., 1., -2., 0.5},
+                                             {1., 3., 0., 1.},
+                                             {-2., 0., 5., -1.},
+                                             {0.5, 1., -1., 2.}};
+  auto eigensystem = diagonalize_symmetric_matrix(matrix);
+  const auto &eigenvalues = eigensystem.eigenvalues;
+  const auto &eigenvectors = eigensystem.eigenvectors;
+  ASSERT_EQ(eigenvalues.size(), 4);
+
+  // trace is preserved and the eigenvalues are sorted
+  EXPECT_NEAR(eigenvalues[0] + eigenvalues[1] + eigenvalues[2] + eigenvalues[3],
+              14., tolerance);
+  for (size_t k{1}; k != 4; ++k) {
+    EXPECT_GE(eigenvalues[k - 1], eigenvalues[k]);
+  }
+
+  // matrix v_k = lambda_k v_k
+  for (size_t k{}; k != 4; ++k) {
+    for (size_t i{}; i != 4; ++i) {
+      double product{};
+      for (size_t j{}; j != 4; ++j) {
+        product += matrix[i][j] * eigenvectors[j][k];
+      }
+      EXPECT_NEAR(product, eigenvalues[k] * eigenvectors[i][k], tolerance);
+    }
+  }
+}
+
 } // namespace mathematics
@@ -0,0 +1,106 @@
+// Author: Stefan Lepperdinger
+#include "HDF5File.h"
+#include "ParameterFile.h"
+#include "runs.h"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace test_runs {
+
+TEST(runs, check_parameters) {
+  ParameterFile::Parameters parameters{};
+  EXPECT_NO_THROW(runs::check_parameters(parameters, true));
+
+  parameters.emissivity_components = {"pi0_*", "ics_*"};
+  EXPECT_NO_THROW(runs::check_parameters(parameters, false));
+  EXPECT_THROW(runs::check_parameters(parameters, true),
+               std::invalid_argument);
+  parameters.emissivity_components = {"pi0_*", "pi0_*"};
+  EXPECT_THROW(runs::check_parameters(parameters, false),
+               std::invalid_argument);
+  parameters.emissivity_components.clear();
+
+  parameters.observer_gradient = true;
+  parameters.distance_bin_edges = {0., 1.};
+  EXPECT_THROW(runs::check_parameters(parameters, false),
+               std::invalid_argument);
+  parameters.distance_bin_edges.clear();
+  parameters.out_of_core_brick_planes = -1;
+  parameters.observer_gradient = false;
+  EXPECT_THROW(runs::check_parameters(parameters, false),
+               std::invalid_argument);
+  // the bricks support neither the cost balanced scheduling nor the mirror
+  // symmetries
+  parameters.out_of_core_brick_planes = 4;
+  parameters.symmetry_tolerance = 1e-6;
+  EXPECT_THROW(runs::check_parameters(parameters, false),
+               std::invalid_argument);
+  parameters.symmetry_tolerance = -1.;
+  EXPECT_NO_THROW(runs::check_parameters(parameters, false));
+  parameters.ray_scheduling = "cost_balanced";
+  EXPECT_THROW(runs::check_parameters(parameters, false),
+               std::invalid_argument);
+  parameters.ray_scheduling = "equal_count";
+  EXPECT_NO_THROW(runs::check_parameters(parameters, false));
+  parameters.out_of_core_brick_planes = 0;
+
+  parameters.requested_energies = {150.};
+  EXPECT_THROW(runs::check_parameters(parameters, false),
+               std::invalid_argument);
+  parameters.compute_energy_skies = true;
+  EXPECT_NO_THROW(runs::check_parameters(parameters, false));
+  EXPECT_THROW(runs::check_parameters(parameters, true),
+               std::invalid_argument);
+}
+
+TEST(runs, check_in_memory_outputs) {
+  ParameterFile::Parameters parameters{};
+  parameters.energy_bands = {{1e3, 1e4}};
+  parameters.energy_decomposition_components = 2;
+  EXPECT_NO_THROW(runs::check_in_memory_outputs(parameters, "app"));
+  parameters.distance_bin_edges = {0., 1.};
+  EXPECT_THROW(runs::check_in_memory_outputs(parameters, "app"),
+               std::invalid_argument);
+  parameters.distance_bin_edges.clear();
+  parameters.out_of_core_brick_planes = 4;
+  EXPECT_THROW(runs::check_in_memory_outputs(parameters, "app"),
+               std::invalid_argument);
+}
+
+TEST(runs, has_band_skies) {
+  ParameterFile::Parameters parameters{};
+  EXPECT_FALSE(runs::has_band_skies(parameters));
+  parameters.energy_bands = {{1e3, 1e4}};
+  EXPECT_TRUE(runs::has_band_skies(parameters));
+  // only the shard with the first energy computes the band skies
+  parameters.energy_indices = std::vector<size_t>{0, 1};
+  EXPECT_TRUE(runs::has_band_skies(parameters));
+  parameters.energy_indices = std::vector<size_t>{2, 3};
+  EXPECT_FALSE(runs::has_band_skies(parameters));
+}
+
+TEST(runs, save_error_bounds) {
+  std::string file_path =
+      (std::filesystem::temp_directory_path() / "test_runs_bounds.h5").string();
+  ParameterFile::Parameters parameters{};
+  parameters.skipping_tolerance = 1e-3;
+  {
+    HDF5File file(file_path, 'w');
+    runs::save_error_bounds(file, parameters, {}, 2e-4);
+    EXPECT_DOUBLE_EQ(file.read_skipping_error_bound(), 2e-4);
+  }
+  // the bound of a resumed run covers the skies of both sessions
+  {
+    HDF5File file(file_path, 'a');
+    runs::save_error_bounds(file, parameters, {}, 1e-4);
+    EXPECT_DOUBLE_EQ(file.read_skipping_error_bound(), 2e-4);
+    runs::save_error_bounds(file, parameters, {}, 5e-4);
+    EXPECT_DOUBLE_EQ(file.read_skipping_error_bound(), 5e-4);
+  }
+  std::filesystem::remove(file_path);
+}
+
+} // namespace test_runs
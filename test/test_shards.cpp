@@ -0,0 +1,45 @@
+// Author: Stefan Lepperdinger
+#include "shards.h"
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace test_shards {
+
+TEST(shards, parse_pixel_range) {
+  auto pixel_range = shards::parse_pixel_range("128:3072");
+  EXPECT_EQ(pixel_range[0], 128);
+  EXPECT_EQ(pixel_range[1], 3072);
+  EXPECT_THROW(shards::parse_pixel_range("12"), std::invalid_argument);
+  EXPECT_THROW(shards::parse_pixel_range("5:5"), std::invalid_argument);
+  EXPECT_THROW(shards::parse_pixel_range("-1:5"), std::invalid_argument);
+}
+
+TEST(shards, parse_energy_indices) {
+  std::vector<size_t> expected{0, 3, 5, 6, 7, 8};
+  EXPECT_EQ(shards::parse_energy_indices("0,5:9,3"), expected);
+  EXPECT_EQ(shards::parse_energy_indices("3,3"), std::vector<size_t>{3});
+  EXPECT_THROW(shards::parse_energy_indices("a"), std::invalid_argument);
+  EXPECT_THROW(shards::parse_energy_indices("4:4"), std::invalid_argument);
+}
+
+TEST(shards, is_partition) {
+  std::string problem;
+  std::vector<shards::shard_specification> partition = {
+      {{0, 10}, {0, 1, 2}}, {{10, 48}, {0, 1}}, {{10, 48}, {2}}};
+  EXPECT_TRUE(shards::is_partition(partition, 3, 48, problem));
+
+  auto gap = partition;
+  gap[1].pixel_range = {11, 48};
+  EXPECT_FALSE(shards::is_partition(gap, 3, 48, problem));
+  EXPECT_EQ(problem, "gap at energy index 0, pixel 10");
+
+  auto overlap = partition;
+  overlap[2].energy_indices = {1, 2};
+  EXPECT_FALSE(shards::is_partition(overlap, 3, 48, problem));
+  EXPECT_EQ(problem, "overlap at energy index 1, pixel 10");
+
+  EXPECT_FALSE(shards::is_partition(partition, 4, 48, problem));
+  EXPECT_FALSE(shards::is_partition(partition, 3, 49, problem));
+}
+
+} // namespace test_shards